@@ -42,8 +42,12 @@
 #include <derivative_dynmat.h>
 #include <kgrid.h>
 #include <tetrahedron_method.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define KB 8.6173382568083159E-05
+#define PI 3.14159265358979323846
 
 /* PHPYCONST is defined in dynmat.h */
 
@@ -53,12 +57,29 @@ static PyObject * py_perm_trans_symmetrize_fc(PyObject *self, PyObject *args);
 static PyObject *
 py_perm_trans_symmetrize_compact_fc(PyObject *self, PyObject *args);
 static PyObject * py_transpose_compact_fc(PyObject *self, PyObject *args);
+static PyObject * py_get_omp_max_threads(PyObject *self, PyObject *args);
+static PyObject * py_set_omp_num_threads(PyObject *self, PyObject *args);
+static PyObject * py_get_omp_proc_bind(PyObject *self, PyObject *args);
 static PyObject * py_get_dynamical_matrix(PyObject *self, PyObject *args);
+static PyObject * py_get_dynamical_matrices(PyObject *self, PyObject *args);
 static PyObject * py_get_nac_dynamical_matrix(PyObject *self, PyObject *args);
 static PyObject * py_get_dipole_dipole(PyObject *self, PyObject *args);
 static PyObject * py_get_dipole_dipole_q0(PyObject *self, PyObject *args);
 static PyObject * py_get_derivative_dynmat(PyObject *self, PyObject *args);
 static PyObject * py_get_thermal_properties(PyObject *self, PyObject *args);
+static PyObject *
+py_get_gruneisen_thermal_properties(PyObject *self, PyObject *args);
+static PyObject * py_get_phonon_moments(PyObject *self, PyObject *args);
+static PyObject *
+py_get_dynamic_structure_factor(PyObject *self, PyObject *args);
+static PyObject * py_get_unfolding_weights(PyObject *self, PyObject *args);
+static PyObject * py_get_band_connections(PyObject *self, PyObject *args);
+static PyObject * py_rotate_eigenvectors(PyObject *self, PyObject *args);
+static PyObject *
+py_get_degenerate_set_representations(PyObject *self, PyObject *args);
+static PyObject *
+py_get_random_displacements(PyObject *self, PyObject *args);
+static PyObject * py_get_least_displacements(PyObject *self, PyObject *args);
 static PyObject * py_distribute_fc2(PyObject *self, PyObject *args);
 static PyObject * py_compute_permutation(PyObject *self, PyObject *args);
 static PyObject * py_gsv_copy_smallest_vectors(PyObject *self, PyObject *args);
@@ -113,6 +134,91 @@ static double get_entropy(const double temperature,
                                 const double f);
 static double get_heat_capacity(const double temperature,
                                       const double f);
+static void get_dynamic_structure_factor(double *S,
+                                         PHPYCONST double (*Q_cart)[3],
+                                         PHPYCONST double (*G)[3],
+                                         PHPYCONST double (*pos)[3],
+                                         const double *masses,
+                                         const double *scat_factors,
+                                         const double *DW,
+                                         const double *freqs,
+                                         const double *eigvecs,
+                                         const int num_Q,
+                                         const int num_patom,
+                                         const int num_band,
+                                         const double temperature,
+                                         const double cutoff_frequency,
+                                         const double unit_conversion);
+static void get_unfolding_weights(double *weights,
+                                  const double *eigvecs,
+                                  const double *phases,
+                                  const int *index_map,
+                                  const int num_qpoints,
+                                  const int num_trans,
+                                  const int num_sites,
+                                  const int num_rows,
+                                  const int num_band);
+static void get_degenerate_set_representations(double *reps,
+                                               const double *eigvecs,
+                                               const int *band_starts,
+                                               const int num_sets,
+                                               const int *permutation,
+                                               const double *phases,
+                                               const double *rotation,
+                                               const int num_atom,
+                                               const int num_band);
+static void rotate_eigenvectors(double *rot_eigvecs,
+                                double *eigvals_dD,
+                                const double *eigvals,
+                                const double *eigvecs,
+                                const double *dD,
+                                const int num_band,
+                                const double cutoff);
+static void get_hermitian_eigensystem(double *eigvals,
+                                      double *eigvecs,
+                                      double *mat,
+                                      const int size);
+static void get_band_connection(int *connection,
+                                const double *overlaps,
+                                const int num_band);
+static void get_random_displacements(double *u,
+                                     const double *A_ii,
+                                     const double *phase_ii,
+                                     const double *A_ij,
+                                     const double *phase_ij,
+                                     const int *s2pp,
+                                     const double *masses,
+                                     const int num_snapshots,
+                                     const int num_atom,
+                                     const int num_ii,
+                                     const int num_ij,
+                                     const int num_dim,
+                                     const int num_band,
+                                     const int num_cells,
+                                     const unsigned long key0,
+                                     const unsigned long key1,
+                                     const long snapshot_offset);
+static int get_least_displacements(int (*disps)[3],
+                                   PHPYCONST int (*rotations)[3][3],
+                                   const int *site_sym,
+                                   const int num_site_sym,
+                                   PHPYCONST int (*directions)[3],
+                                   const int num_directions,
+                                   const int is_plusminus,
+                                   const int is_trigonal);
+static int get_integer_determinant(const int a[3],
+                                   const int b[3],
+                                   const int c[3]);
+static void multiply_integer_matrix_vector(int v[3],
+                                           PHPYCONST int r[3][3],
+                                           const int w[3]);
+static void get_normal_random_numbers(double *z,
+                                      const int num,
+                                      const unsigned int key[2],
+                                      const unsigned int counter_1,
+                                      const unsigned int counter_2,
+                                      const unsigned int counter_3);
+static void philox4x32(unsigned int ctr[4], const unsigned int key_in[2]);
 static void set_index_permutation_symmetry_fc(double * fc,
                                               const int natom);
 static void set_translational_symmetry_fc(double * fc,
@@ -163,8 +269,16 @@ static PyMethodDef _phonopy_methods[] = {
   {"transpose_compact_fc", py_transpose_compact_fc,
    METH_VARARGS,
    "Transpose compact force constants"},
+  {"omp_max_threads", py_get_omp_max_threads, METH_VARARGS,
+   "Number of OpenMP threads of parallel regions of calling thread"},
+  {"set_omp_num_threads", py_set_omp_num_threads, METH_VARARGS,
+   "Set number of OpenMP threads of parallel regions of calling thread"},
+  {"omp_proc_bind", py_get_omp_proc_bind, METH_VARARGS,
+   "OpenMP thread affinity policy"},
   {"dynamical_matrix", py_get_dynamical_matrix, METH_VARARGS,
    "Dynamical matrix"},
+  {"dynamical_matrices", py_get_dynamical_matrices, METH_VARARGS,
+   "Dynamical matrices at q-points"},
   {"nac_dynamical_matrix", py_get_nac_dynamical_matrix, METH_VARARGS,
    "NAC dynamical matrix"},
   {"dipole_dipole", py_get_dipole_dipole, METH_VARARGS,
@@ -175,6 +289,25 @@ static PyMethodDef _phonopy_methods[] = {
    "Q derivative of dynamical matrix"},
   {"thermal_properties", py_get_thermal_properties, METH_VARARGS,
    "Thermal properties"},
+  {"gruneisen_thermal_properties", py_get_gruneisen_thermal_properties,
+   METH_VARARGS, "Thermal properties at volumes by mode Gruneisen parameters"},
+  {"phonon_moments", py_get_phonon_moments, METH_VARARGS,
+   "Accumulate sums of powers of frequencies for phonon moments"},
+  {"dynamic_structure_factor", py_get_dynamic_structure_factor, METH_VARARGS,
+   "Coherent one-phonon dynamic structure factor"},
+  {"unfolding_weights", py_get_unfolding_weights, METH_VARARGS,
+   "Unfolding weights of supercell phonon modes"},
+  {"degenerate_set_representations", py_get_degenerate_set_representations,
+   METH_VARARGS, "Representation matrices of degenerate sets by ground "
+   "representation"},
+  {"rotate_eigenvectors", py_rotate_eigenvectors, METH_VARARGS,
+   "Diagonalize perturbation in degenerate subspaces at q-points"},
+  {"band_connections", py_get_band_connections, METH_VARARGS,
+   "Band connections by maximum overlap of eigenvectors"},
+  {"random_displacements", py_get_random_displacements, METH_VARARGS,
+   "Random displacements of harmonic oscillators by Philox streams"},
+  {"least_displacements", py_get_least_displacements, METH_VARARGS,
+   "Least displacement directions of independent atoms by site symmetry"},
   {"distribute_fc2", py_distribute_fc2,
    METH_VARARGS,
    "Distribute force constants for all atoms in atom_list using precomputed symmetry mappings."},
@@ -635,6 +768,50 @@ static PyObject * py_transpose_compact_fc(PyObject *self, PyObject *args)
   Py_RETURN_NONE;
 }
 
+/* Without OpenMP, one thread is reported and setting is ignored. */
+static PyObject * py_get_omp_max_threads(PyObject *self, PyObject *args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+#ifdef _OPENMP
+  return PyLong_FromLong((long) omp_get_max_threads());
+#else
+  return PyLong_FromLong(1);
+#endif
+}
+
+static PyObject * py_set_omp_num_threads(PyObject *self, PyObject *args)
+{
+  int num_threads;
+
+  if (!PyArg_ParseTuple(args, "i", &num_threads)) {
+    return NULL;
+  }
+
+#ifdef _OPENMP
+  omp_set_num_threads(num_threads);
+#endif
+
+  Py_RETURN_NONE;
+}
+
+/* omp_proc_bind_t: 0 (false), 1 (true), 2 (master), 3 (close), */
+/* 4 (spread). -1 when OpenMP is unavailable. */
+static PyObject * py_get_omp_proc_bind(PyObject *self, PyObject *args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+#if defined(_OPENMP) && _OPENMP >= 201307
+  return PyLong_FromLong((long) omp_get_proc_bind());
+#else
+  return PyLong_FromLong(-1);
+#endif
+}
+
 static PyObject * py_get_dynamical_matrix(PyObject *self, PyObject *args)
 {
   PyArrayObject* py_dynamical_matrix;
@@ -656,8 +833,10 @@ static PyObject * py_get_dynamical_matrix(PyObject *self, PyObject *args)
   int* p2s_map;
   int num_patom;
   int num_satom;
+  int with_openmp;
 
-  if (!PyArg_ParseTuple(args, "OOOOOOOO",
+  with_openmp = 1;
+  if (!PyArg_ParseTuple(args, "OOOOOOOO|i",
                         &py_dynamical_matrix,
                         &py_force_constants,
                         &py_q,
@@ -665,7 +844,8 @@ static PyObject * py_get_dynamical_matrix(PyObject *self, PyObject *args)
                         &py_multiplicities,
                         &py_masses,
                         &py_s2p_map,
-                        &py_p2s_map)) {
+                        &py_p2s_map,
+                        &with_openmp)) {
     return NULL;
   }
 
@@ -691,7 +871,97 @@ static PyObject * py_get_dynamical_matrix(PyObject *self, PyObject *args)
                                 s2p_map,
                                 p2s_map,
                                 NULL,
-                                1);
+                                with_openmp);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject * py_get_dynamical_matrices(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_dynamical_matrices;
+  PyArrayObject* py_force_constants;
+  PyArrayObject* py_shortest_vectors;
+  PyArrayObject* py_qpoints;
+  PyArrayObject* py_multiplicities;
+  PyArrayObject* py_masses;
+  PyArrayObject* py_s2p_map;
+  PyArrayObject* py_p2s_map;
+
+  double* dm;
+  double* fc;
+  double (*qpoints)[3];
+  double (*svecs)[27][3];
+  double* m;
+  int* multi;
+  int* s2p_map;
+  int* p2s_map;
+  int num_qpoints;
+  int num_patom;
+  int num_satom;
+  int parallel_level;
+  int i;
+  long adrs_shift;
+
+  parallel_level = 0;
+  if (!PyArg_ParseTuple(args, "OOOOOOOO|i",
+                        &py_dynamical_matrices,
+                        &py_force_constants,
+                        &py_qpoints,
+                        &py_shortest_vectors,
+                        &py_multiplicities,
+                        &py_masses,
+                        &py_s2p_map,
+                        &py_p2s_map,
+                        &parallel_level)) {
+    return NULL;
+  }
+
+  dm = (double*)PyArray_DATA(py_dynamical_matrices);
+  fc = (double*)PyArray_DATA(py_force_constants);
+  qpoints = (double(*)[3])PyArray_DATA(py_qpoints);
+  svecs = (double(*)[27][3])PyArray_DATA(py_shortest_vectors);
+  m = (double*)PyArray_DATA(py_masses);
+  multi = (int*)PyArray_DATA(py_multiplicities);
+  s2p_map = (int*)PyArray_DATA(py_s2p_map);
+  p2s_map = (int*)PyArray_DATA(py_p2s_map);
+  num_qpoints = PyArray_DIMS(py_qpoints)[0];
+  num_patom = PyArray_DIMS(py_p2s_map)[0];
+  num_satom = PyArray_DIMS(py_s2p_map)[0];
+  adrs_shift = (long)num_patom * num_patom * 18;
+
+  /* parallel_level: 0 (over q-points) or 1 (over atom pairs) */
+  if (parallel_level == 1) {
+    for (i = 0; i < num_qpoints; i++) {
+      dym_get_dynamical_matrix_at_q(dm + adrs_shift * i,
+                                    num_patom,
+                                    num_satom,
+                                    fc,
+                                    qpoints[i],
+                                    svecs,
+                                    multi,
+                                    m,
+                                    s2p_map,
+                                    p2s_map,
+                                    NULL,
+                                    1);
+    }
+  } else {
+#pragma omp parallel for
+    for (i = 0; i < num_qpoints; i++) {
+      dym_get_dynamical_matrix_at_q(dm + adrs_shift * i,
+                                    num_patom,
+                                    num_satom,
+                                    fc,
+                                    qpoints[i],
+                                    svecs,
+                                    multi,
+                                    m,
+                                    s2p_map,
+                                    p2s_map,
+                                    NULL,
+                                    0);
+    }
+  }
 
   Py_RETURN_NONE;
 }
@@ -725,9 +995,11 @@ static PyObject * py_get_nac_dynamical_matrix(PyObject *self, PyObject *args)
   int num_satom;
 
   int n;
+  int with_openmp;
   double (*charge_sum)[3][3];
 
-  if (!PyArg_ParseTuple(args, "OOOOOOOOOOd",
+  with_openmp = 1;
+  if (!PyArg_ParseTuple(args, "OOOOOOOOOOd|i",
                         &py_dynamical_matrix,
                         &py_force_constants,
                         &py_q,
@@ -738,7 +1010,8 @@ static PyObject * py_get_nac_dynamical_matrix(PyObject *self, PyObject *args)
                         &py_p2s_map,
                         &py_q_cart,
                         &py_born,
-                        &factor))
+                        &factor,
+                        &with_openmp))
     return NULL;
 
   dm = (double*)PyArray_DATA(py_dynamical_matrix);
@@ -770,7 +1043,7 @@ static PyObject * py_get_nac_dynamical_matrix(PyObject *self, PyObject *args)
                                 s2p_map,
                                 p2s_map,
                                 charge_sum,
-                                1);
+                                with_openmp);
 
   free(charge_sum);
 
@@ -1066,6 +1339,636 @@ static PyObject * py_get_thermal_properties(PyObject *self, PyObject *args)
   Py_RETURN_NONE;
 }
 
+/* Thermal properties at volumes with frequencies extrapolated by */
+/* mode Gruneisen parameters, omega(V)^2 = omega(V0)^2 (V/V0)^(-2 gamma). */
+/* Zero point energy of positive frequencies is included in free energy. */
+static PyObject *
+py_get_gruneisen_thermal_properties(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_thermal_props;
+  PyArrayObject* py_volume_ratios;
+  PyArrayObject* py_temperatures;
+  PyArrayObject* py_eigenvalues;
+  PyArrayObject* py_gammas;
+  PyArrayObject* py_weights;
+
+  double unit_conversion;
+  double cutoff_frequency;
+
+  double *thermal_props;
+  double *volume_ratios;
+  double *temperatures;
+  double *eigvals;
+  double *gammas;
+  int *w;
+  int num_volumes;
+  int num_temp;
+  int num_phonons;
+  int num_bands;
+
+  int i, j, k;
+  double f, e, t, sum_w, x, y, one_minus_y, log_1my;
+  double *freqs;
+  double *tp;
+
+  if (!PyArg_ParseTuple(args, "OOOOOOdd",
+                        &py_thermal_props,
+                        &py_volume_ratios,
+                        &py_temperatures,
+                        &py_eigenvalues,
+                        &py_gammas,
+                        &py_weights,
+                        &unit_conversion,
+                        &cutoff_frequency)) {
+    return NULL;
+  }
+
+  thermal_props = (double*)PyArray_DATA(py_thermal_props);
+  volume_ratios = (double*)PyArray_DATA(py_volume_ratios);
+  num_volumes = PyArray_DIMS(py_volume_ratios)[0];
+  temperatures = (double*)PyArray_DATA(py_temperatures);
+  num_temp = PyArray_DIMS(py_temperatures)[0];
+  eigvals = (double*)PyArray_DATA(py_eigenvalues);
+  gammas = (double*)PyArray_DATA(py_gammas);
+  num_bands = PyArray_DIMS(py_eigenvalues)[1];
+  num_phonons = PyArray_DIMS(py_eigenvalues)[0] * num_bands;
+  w = (int*)PyArray_DATA(py_weights);
+
+  sum_w = 0;
+  for (i = 0; i < PyArray_DIMS(py_eigenvalues)[0]; i++) {
+    sum_w += w[i];
+  }
+
+  freqs = (double*)malloc(sizeof(double) * num_phonons);
+
+  for (i = 0; i < num_volumes; i++) {
+#pragma omp parallel for private(e)
+    for (j = 0; j < num_phonons; j++) {
+      e = eigvals[j] * exp(-2 * gammas[j] * log(volume_ratios[i]));
+      if (e < 0) {
+        freqs[j] = -sqrt(-e) * unit_conversion;
+      } else {
+        freqs[j] = sqrt(e) * unit_conversion;
+      }
+    }
+
+    /* With x = f / kT and y = exp(-x), F = kT log(1 - y), */
+    /* S = k (x y / (1 - y) - log(1 - y)), Cv = k x^2 y / (1 - y)^2, */
+    /* which are equivalent to get_free_energy, get_entropy, and */
+    /* get_heat_capacity but need only two exponentials. */
+#pragma omp parallel for private(k, f, t, tp, x, y, one_minus_y, log_1my)
+    for (j = 0; j < num_temp; j++) {
+      t = temperatures[j];
+      tp = thermal_props + (i * num_temp + j) * 3;
+      tp[0] = 0;
+      tp[1] = 0;
+      tp[2] = 0;
+      for (k = 0; k < num_phonons; k++) {
+        f = freqs[k];
+        if (f > 0) {
+          tp[0] += f / 2 * w[k / num_bands];
+        }
+        if (t > 0 && f > cutoff_frequency) {
+          x = f / (KB * t);
+          y = exp(-x);
+          one_minus_y = -expm1(-x);
+          log_1my = log(one_minus_y);
+          tp[0] += KB * t * log_1my * w[k / num_bands];
+          tp[1] += KB * (x * y / one_minus_y - log_1my) * w[k / num_bands];
+          tp[2] += (KB * x * x * y / (one_minus_y * one_minus_y)
+                    * w[k / num_bands]);
+        }
+      }
+      tp[0] /= sum_w;
+      tp[1] /= sum_w;
+      tp[2] /= sum_w;
+    }
+  }
+
+  free(freqs);
+  freqs = NULL;
+
+  Py_RETURN_NONE;
+}
+
+/* Sums for phonon moments accumulated into sums[num_orders + 1][...]. */
+/* sums[0] is the weighted number of modes in the frequency window and */
+/* sums[1 + i] is that multiplied by f^orders[i]. Without eigenvectors */
+/* (None), the last dimension of sums is absent, and otherwise sums are */
+/* projected on num_band components of eigenvectors by |e|^2. */
+static PyObject * py_get_phonon_moments(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_sums;
+  PyArrayObject* py_frequencies;
+  PyArrayObject* py_eigenvectors;
+  PyArrayObject* py_weights;
+  PyArrayObject* py_orders;
+  double freq_min;
+  double freq_max;
+
+  double *sums;
+  double *freqs;
+  double *eigvecs;
+  int *w;
+  int *orders;
+  int num_qpoints;
+  int num_band;
+  int num_orders;
+
+  int i, j, k, l;
+  double f, c, abs2, sum;
+  double *coef;
+
+  if (!PyArg_ParseTuple(args, "OOOOOdd",
+                        &py_sums,
+                        &py_frequencies,
+                        &py_eigenvectors,
+                        &py_weights,
+                        &py_orders,
+                        &freq_min,
+                        &freq_max)) {
+    return NULL;
+  }
+
+  sums = (double*)PyArray_DATA(py_sums);
+  freqs = (double*)PyArray_DATA(py_frequencies);
+  num_qpoints = PyArray_DIMS(py_frequencies)[0];
+  num_band = PyArray_DIMS(py_frequencies)[1];
+  w = (int*)PyArray_DATA(py_weights);
+  orders = (int*)PyArray_DATA(py_orders);
+  num_orders = PyArray_DIMS(py_orders)[0];
+
+  /* coef[i][k][j] = w * f^orders[k - 1] (k > 0) or w (k = 0) of mode j */
+  /* at q-point i, and zero outside of the frequency window. */
+  coef = (double*)malloc(sizeof(double) *
+                         num_qpoints * (num_orders + 1) * num_band);
+
+#pragma omp parallel for private(j, k, f, c)
+  for (i = 0; i < num_qpoints; i++) {
+    for (j = 0; j < num_band; j++) {
+      f = freqs[i * num_band + j];
+      c = (double)((freq_min < f) & (f < freq_max)) * w[i];
+      f = c > 0 ? f : 1.0;
+      coef[i * (num_orders + 1) * num_band + j] = c;
+      for (k = 0; k < num_orders; k++) {
+        coef[(i * (num_orders + 1) + k + 1) * num_band + j] =
+          c * pow(f, orders[k]);
+      }
+    }
+  }
+
+  if ((PyObject*)py_eigenvectors == Py_None) {
+    for (k = 0; k < num_orders + 1; k++) {
+      sum = 0;
+      for (i = 0; i < num_qpoints; i++) {
+        for (j = 0; j < num_band; j++) {
+          sum += coef[(i * (num_orders + 1) + k) * num_band + j];
+        }
+      }
+      sums[k] += sum;
+    }
+  } else {
+    eigvecs = (double*)PyArray_DATA(py_eigenvectors);
+#pragma omp parallel for private(i, j, k, abs2)
+    for (l = 0; l < num_band; l++) {
+      for (i = 0; i < num_qpoints; i++) {
+        for (j = 0; j < num_band; j++) {
+          abs2 = (eigvecs[((i * num_band + l) * num_band + j) * 2] *
+                  eigvecs[((i * num_band + l) * num_band + j) * 2] +
+                  eigvecs[((i * num_band + l) * num_band + j) * 2 + 1] *
+                  eigvecs[((i * num_band + l) * num_band + j) * 2 + 1]);
+          for (k = 0; k < num_orders + 1; k++) {
+            sums[k * num_band + l] +=
+              coef[(i * (num_orders + 1) + k) * num_band + j] * abs2;
+          }
+        }
+      }
+    }
+  }
+
+  free(coef);
+  coef = NULL;
+
+  Py_RETURN_NONE;
+}
+
+/* Coherent one-phonon dynamic structure factor */
+static PyObject *
+py_get_dynamic_structure_factor(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_S;
+  PyArrayObject* py_Q_cart;
+  PyArrayObject* py_G;
+  PyArrayObject* py_positions;
+  PyArrayObject* py_masses;
+  PyArrayObject* py_scat_factors;
+  PyArrayObject* py_DW;
+  PyArrayObject* py_frequencies;
+  PyArrayObject* py_eigenvectors;
+  double temperature;
+  double cutoff_frequency;
+  double unit_conversion;
+
+  double *S;
+  double (*Q_cart)[3];
+  double (*G)[3];
+  double (*pos)[3];
+  double *masses;
+  double *scat_factors;
+  double *DW;
+  double *freqs;
+  double *eigvecs;
+  int num_Q;
+  int num_patom;
+  int num_band;
+
+  if (!PyArg_ParseTuple(args, "OOOOOOOOOddd",
+                        &py_S,
+                        &py_Q_cart,
+                        &py_G,
+                        &py_positions,
+                        &py_masses,
+                        &py_scat_factors,
+                        &py_DW,
+                        &py_frequencies,
+                        &py_eigenvectors,
+                        &temperature,
+                        &cutoff_frequency,
+                        &unit_conversion)) {
+    return NULL;
+  }
+
+  S = (double*)PyArray_DATA(py_S);
+  Q_cart = (double(*)[3])PyArray_DATA(py_Q_cart);
+  G = (double(*)[3])PyArray_DATA(py_G);
+  pos = (double(*)[3])PyArray_DATA(py_positions);
+  masses = (double*)PyArray_DATA(py_masses);
+  scat_factors = (double*)PyArray_DATA(py_scat_factors);
+  DW = (double*)PyArray_DATA(py_DW);
+  freqs = (double*)PyArray_DATA(py_frequencies);
+  eigvecs = (double*)PyArray_DATA(py_eigenvectors);
+  num_Q = PyArray_DIMS(py_frequencies)[0];
+  num_band = PyArray_DIMS(py_frequencies)[1];
+  num_patom = PyArray_DIMS(py_masses)[0];
+
+  get_dynamic_structure_factor(S,
+                               Q_cart,
+                               G,
+                               pos,
+                               masses,
+                               scat_factors,
+                               DW,
+                               freqs,
+                               eigvecs,
+                               num_Q,
+                               num_patom,
+                               num_band,
+                               temperature,
+                               cutoff_frequency,
+                               unit_conversion);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject * py_get_unfolding_weights(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_weights;
+  PyArrayObject* py_eigenvectors;
+  PyArrayObject* py_phases;
+  PyArrayObject* py_index_map;
+
+  double *weights;
+  double *eigvecs;
+  double *phases;
+  int *index_map;
+  int num_qpoints;
+  int num_trans;
+  int num_sites;
+  int num_rows;
+  int num_band;
+
+  if (!PyArg_ParseTuple(args, "OOOO",
+                        &py_weights,
+                        &py_eigenvectors,
+                        &py_phases,
+                        &py_index_map)) {
+    return NULL;
+  }
+
+  weights = (double*)PyArray_DATA(py_weights);
+  eigvecs = (double*)PyArray_DATA(py_eigenvectors);
+  phases = (double*)PyArray_DATA(py_phases);
+  index_map = (int*)PyArray_DATA(py_index_map);
+  num_qpoints = PyArray_DIMS(py_eigenvectors)[0];
+  num_rows = PyArray_DIMS(py_eigenvectors)[1];
+  num_band = PyArray_DIMS(py_eigenvectors)[2];
+  num_trans = PyArray_DIMS(py_index_map)[0];
+  num_sites = PyArray_DIMS(py_index_map)[1];
+
+  get_unfolding_weights(weights,
+                        eigvecs,
+                        phases,
+                        index_map,
+                        num_qpoints,
+                        num_trans,
+                        num_sites,
+                        num_rows,
+                        num_band);
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+py_get_degenerate_set_representations(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_reps;
+  PyArrayObject* py_eigvecs;
+  PyArrayObject* py_band_starts;
+  PyArrayObject* py_permutations;
+  PyArrayObject* py_phases;
+  PyArrayObject* py_rotations;
+
+  double *reps;
+  double *eigvecs;
+  int *band_starts;
+  int *permutations;
+  double *phases;
+  double *rotations;
+  int num_ops, num_sets, num_atom, num_band, num_doubles;
+  int i;
+
+  if (!PyArg_ParseTuple(args, "OOOOOO",
+                        &py_reps,
+                        &py_eigvecs,
+                        &py_band_starts,
+                        &py_permutations,
+                        &py_phases,
+                        &py_rotations)) {
+    return NULL;
+  }
+
+  reps = (double*)PyArray_DATA(py_reps);
+  eigvecs = (double*)PyArray_DATA(py_eigvecs);
+  band_starts = (int*)PyArray_DATA(py_band_starts);
+  permutations = (int*)PyArray_DATA(py_permutations);
+  phases = (double*)PyArray_DATA(py_phases);
+  rotations = (double*)PyArray_DATA(py_rotations);
+  num_ops = PyArray_DIMS(py_permutations)[0];
+  num_atom = PyArray_DIMS(py_permutations)[1];
+  num_band = PyArray_DIMS(py_eigvecs)[0]; /* eigvecs is square */
+  num_sets = PyArray_DIMS(py_band_starts)[0] - 1;
+  num_doubles = PyArray_DIMS(py_reps)[1];
+
+#pragma omp parallel for
+  for (i = 0; i < num_ops; i++) {
+    get_degenerate_set_representations(reps + (long)num_doubles * i,
+                                       eigvecs,
+                                       band_starts,
+                                       num_sets,
+                                       permutations + (long)num_atom * i,
+                                       phases + (long)num_atom * i * 2,
+                                       rotations + i * 9,
+                                       num_atom,
+                                       num_band);
+  }
+
+  Py_RETURN_NONE;
+}
+
+static PyObject * py_rotate_eigenvectors(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_rot_eigvecs;
+  PyArrayObject* py_eigvals_dD;
+  PyArrayObject* py_eigvals;
+  PyArrayObject* py_eigvecs;
+  PyArrayObject* py_dD;
+  double cutoff;
+
+  double *rot_eigvecs;
+  double *eigvals_dD;
+  double *eigvals;
+  double *eigvecs;
+  double *dD;
+  int num_qpoints;
+  int num_band;
+  int i;
+  long adrs_shift;
+
+  if (!PyArg_ParseTuple(args, "OOOOOd",
+                        &py_rot_eigvecs,
+                        &py_eigvals_dD,
+                        &py_eigvals,
+                        &py_eigvecs,
+                        &py_dD,
+                        &cutoff)) {
+    return NULL;
+  }
+
+  rot_eigvecs = (double*)PyArray_DATA(py_rot_eigvecs);
+  eigvals_dD = (double*)PyArray_DATA(py_eigvals_dD);
+  eigvals = (double*)PyArray_DATA(py_eigvals);
+  eigvecs = (double*)PyArray_DATA(py_eigvecs);
+  dD = (double*)PyArray_DATA(py_dD);
+  num_qpoints = PyArray_DIMS(py_eigvals)[0];
+  num_band = PyArray_DIMS(py_eigvals)[1];
+  adrs_shift = (long)num_band * num_band * 2;
+
+#pragma omp parallel for
+  for (i = 0; i < num_qpoints; i++) {
+    rotate_eigenvectors(rot_eigvecs + adrs_shift * i,
+                        eigvals_dD + (long)num_band * i,
+                        eigvals + (long)num_band * i,
+                        eigvecs + adrs_shift * i,
+                        dD + adrs_shift * i,
+                        num_band,
+                        cutoff);
+  }
+
+  Py_RETURN_NONE;
+}
+
+static PyObject * py_get_band_connections(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_connections;
+  PyArrayObject* py_overlaps;
+
+  int *connections;
+  double *overlaps;
+  int num_pairs;
+  int num_band;
+  int i;
+
+  if (!PyArg_ParseTuple(args, "OO",
+                        &py_connections,
+                        &py_overlaps)) {
+    return NULL;
+  }
+
+  connections = (int*)PyArray_DATA(py_connections);
+  overlaps = (double*)PyArray_DATA(py_overlaps);
+  num_pairs = PyArray_DIMS(py_overlaps)[0];
+  num_band = PyArray_DIMS(py_overlaps)[1];
+
+#pragma omp parallel for
+  for (i = 0; i < num_pairs; i++) {
+    get_band_connection(connections + (long)i * num_band,
+                        overlaps + (long)i * num_band * num_band,
+                        num_band);
+  }
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *
+py_get_random_displacements(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_u;
+  PyArrayObject* py_A_ii;
+  PyArrayObject* py_phase_ii;
+  PyArrayObject* py_A_ij;
+  PyArrayObject* py_phase_ij;
+  PyArrayObject* py_s2pp;
+  PyArrayObject* py_masses;
+  int num_cells;
+  unsigned long key0, key1;
+  long snapshot_offset;
+
+  double *u;
+  double *A_ii;
+  double *phase_ii;
+  double *A_ij;
+  double *phase_ij;
+  int *s2pp;
+  double *masses;
+  int num_snapshots;
+  int num_atom;
+  int num_ii;
+  int num_ij;
+  int num_dim;
+  int num_band;
+
+  if (!PyArg_ParseTuple(args, "OOOOOOOikkl",
+                        &py_u,
+                        &py_A_ii,
+                        &py_phase_ii,
+                        &py_A_ij,
+                        &py_phase_ij,
+                        &py_s2pp,
+                        &py_masses,
+                        &num_cells,
+                        &key0,
+                        &key1,
+                        &snapshot_offset)) {
+    return NULL;
+  }
+
+  u = (double*)PyArray_DATA(py_u);
+  A_ii = (double*)PyArray_DATA(py_A_ii);
+  phase_ii = (double*)PyArray_DATA(py_phase_ii);
+  A_ij = (double*)PyArray_DATA(py_A_ij);
+  phase_ij = (double*)PyArray_DATA(py_phase_ij);
+  s2pp = (int*)PyArray_DATA(py_s2pp);
+  masses = (double*)PyArray_DATA(py_masses);
+  num_snapshots = PyArray_DIMS(py_u)[0];
+  num_atom = PyArray_DIMS(py_u)[1];
+  num_ii = PyArray_DIMS(py_A_ii)[0];
+  num_ij = PyArray_DIMS(py_A_ij)[0];
+  num_dim = PyArray_DIMS(py_A_ii)[1];
+  num_band = PyArray_DIMS(py_A_ii)[2];
+
+  get_random_displacements(u,
+                           A_ii,
+                           phase_ii,
+                           A_ij,
+                           phase_ij,
+                           s2pp,
+                           masses,
+                           num_snapshots,
+                           num_atom,
+                           num_ii,
+                           num_ij,
+                           num_dim,
+                           num_band,
+                           num_cells,
+                           key0,
+                           key1,
+                           snapshot_offset);
+
+  Py_RETURN_NONE;
+}
+
+/* Least displacement directions of atoms. site_symmetry_masks[i, j] */
+/* is non-zero when rotations[j] belongs to the site-symmetry group of */
+/* i-th atom. At most 8 directions per atom are stored in */
+/* displacements[i] and their number in num_displacements[i]. */
+/* is_plusminus: 0 (False), 1 (True), 2 ('auto') */
+static PyObject * py_get_least_displacements(PyObject *self, PyObject *args)
+{
+  PyArrayObject* py_displacements;
+  PyArrayObject* py_num_displacements;
+  PyArrayObject* py_site_symmetry_masks;
+  PyArrayObject* py_rotations;
+  PyArrayObject* py_directions;
+  int is_plusminus;
+  int is_trigonal;
+
+  int (*disps)[8][3];
+  int *num_disps;
+  int *masks;
+  int (*rotations)[3][3];
+  int (*directions)[3];
+  int num_atom;
+  int num_rot;
+  int num_directions;
+
+  int i, j, num_site_sym;
+  int *site_sym;
+
+  if (!PyArg_ParseTuple(args, "OOOOOii",
+                        &py_displacements,
+                        &py_num_displacements,
+                        &py_site_symmetry_masks,
+                        &py_rotations,
+                        &py_directions,
+                        &is_plusminus,
+                        &is_trigonal)) {
+    return NULL;
+  }
+
+  disps = (int(*)[8][3])PyArray_DATA(py_displacements);
+  num_disps = (int*)PyArray_DATA(py_num_displacements);
+  masks = (int*)PyArray_DATA(py_site_symmetry_masks);
+  rotations = (int(*)[3][3])PyArray_DATA(py_rotations);
+  directions = (int(*)[3])PyArray_DATA(py_directions);
+  num_atom = PyArray_DIMS(py_site_symmetry_masks)[0];
+  num_rot = PyArray_DIMS(py_rotations)[0];
+  num_directions = PyArray_DIMS(py_directions)[0];
+
+#pragma omp parallel for private(j, num_site_sym, site_sym)
+  for (i = 0; i < num_atom; i++) {
+    site_sym = (int*)malloc(sizeof(int) * num_rot);
+    num_site_sym = 0;
+    for (j = 0; j < num_rot; j++) {
+      if (masks[i * num_rot + j]) {
+        site_sym[num_site_sym] = j;
+        num_site_sym++;
+      }
+    }
+    num_disps[i] = get_least_displacements(disps[i],
+                                           rotations,
+                                           site_sym,
+                                           num_site_sym,
+                                           directions,
+                                           num_directions,
+                                           is_plusminus,
+                                           is_trigonal);
+    free(site_sym);
+    site_sym = NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
 static PyObject * py_distribute_fc2(PyObject *self, PyObject *args)
 {
   PyArrayObject* py_force_constants;
@@ -1506,12 +2409,851 @@ static double get_heat_capacity(const double temperature, const double f)
   return KB * val1 * val2 * val2;
 }
 
+/* S(Q, nu) = |F(Q, nu)|^2 (n + 1) */
+/* F(Q, nu) = sum_j f_j(Q) exp(-W_j) (2pi Q.e_j) exp(-2pi i G.r_j) */
+/*            / sqrt(2 m_j freq) */
+/* Eigenvectors are given as complex numbers, shape=(num_Q, 3 * */
+/* num_patom, num_band). 'unit_conversion' converts frequency to eV. */
+static void get_dynamic_structure_factor(double *S,
+                                         PHPYCONST double (*Q_cart)[3],
+                                         PHPYCONST double (*G)[3],
+                                         PHPYCONST double (*pos)[3],
+                                         const double *masses,
+                                         const double *scat_factors,
+                                         const double *DW,
+                                         const double *freqs,
+                                         const double *eigvecs,
+                                         const int num_Q,
+                                         const int num_patom,
+                                         const int num_band,
+                                         const double temperature,
+                                         const double cutoff_frequency,
+                                         const double unit_conversion)
+{
+  int i, j, k, l;
+  long adrs;
+  double phase, f, n, QW_re, QW_im, F_re, F_im;
+  double *coef;
+
+  coef = (double*)malloc(sizeof(double) * num_Q * num_patom * 2);
+
+#pragma omp parallel for private(j, k, l, adrs, phase, f, n, QW_re, QW_im, F_re, F_im)
+  for (i = 0; i < num_Q; i++) {
+    for (j = 0; j < num_patom; j++) {
+      phase = 0;
+      for (l = 0; l < 3; l++) {
+        phase += G[i][l] * pos[j][l];
+      }
+      phase *= -2 * PI;
+      f = 2 * PI * scat_factors[i * num_patom + j] *
+        DW[i * num_patom + j] / sqrt(2 * masses[j]);
+      coef[(i * num_patom + j) * 2] = f * cos(phase);
+      coef[(i * num_patom + j) * 2 + 1] = f * sin(phase);
+    }
+
+    for (k = 0; k < num_band; k++) {
+      f = freqs[i * num_band + k];
+      if (f > cutoff_frequency) {
+        F_re = 0;
+        F_im = 0;
+        for (j = 0; j < num_patom; j++) {
+          QW_re = 0;
+          QW_im = 0;
+          for (l = 0; l < 3; l++) {
+            adrs = (((long)i * num_patom * 3 + j * 3 + l) * num_band + k) * 2;
+            QW_re += Q_cart[i][l] * eigvecs[adrs];
+            QW_im += Q_cart[i][l] * eigvecs[adrs + 1];
+          }
+          F_re += (coef[(i * num_patom + j) * 2] * QW_re -
+                   coef[(i * num_patom + j) * 2 + 1] * QW_im);
+          F_im += (coef[(i * num_patom + j) * 2] * QW_im +
+                   coef[(i * num_patom + j) * 2 + 1] * QW_re);
+        }
+        if (temperature > 0) {
+          n = 1.0 / (exp(f * unit_conversion / (KB * temperature)) - 1);
+        } else {
+          n = 0;
+        }
+        S[i * num_band + k] = (F_re * F_re + F_im * F_im) / f * (n + 1);
+      } else {
+        S[i * num_band + k] = 0;
+      }
+    }
+  }
+
+  free(coef);
+  coef = NULL;
+}
+
+/* w(q, b) = sum_{site, alpha} |sum_i phase(q, i) */
+/*           e(q, 3 * map(i, site) + alpha, b)|^2 / num_trans^2 */
+/* Complex numbers of eigvecs (num_qpoints, num_rows, num_band) and */
+/* phases (num_qpoints, num_trans) are given as pairs of doubles. */
+/* Negative atom index in index_map (vacancy) gives zero contribution. */
+static void get_unfolding_weights(double *weights,
+                                  const double *eigvecs,
+                                  const double *phases,
+                                  const int *index_map,
+                                  const int num_qpoints,
+                                  const int num_trans,
+                                  const int num_sites,
+                                  const int num_rows,
+                                  const int num_band)
+{
+  int i, j, k, l, m, atom;
+  double ph_re, ph_im;
+  double *e, *w;
+  const double *eig_row, *ph;
+
+#pragma omp parallel for private(j, k, l, m, atom, ph_re, ph_im, e, w, eig_row, ph)
+  for (i = 0; i < num_qpoints; i++) {
+    e = (double*)malloc(sizeof(double) * num_band * 2);
+    w = weights + (long)i * num_band;
+    ph = phases + (long)i * num_trans * 2;
+    for (m = 0; m < num_band; m++) {
+      w[m] = 0;
+    }
+    for (j = 0; j < num_sites; j++) {
+      for (k = 0; k < 3; k++) {
+        for (m = 0; m < num_band * 2; m++) {
+          e[m] = 0;
+        }
+        for (l = 0; l < num_trans; l++) {
+          atom = index_map[l * num_sites + j];
+          if (atom < 0) {
+            continue;
+          }
+          ph_re = ph[l * 2];
+          ph_im = ph[l * 2 + 1];
+          eig_row = eigvecs + ((long)i * num_rows + atom * 3 + k) * num_band * 2;
+          for (m = 0; m < num_band; m++) {
+            e[m * 2] += ph_re * eig_row[m * 2] - ph_im * eig_row[m * 2 + 1];
+            e[m * 2 + 1] += ph_re * eig_row[m * 2 + 1] + ph_im * eig_row[m * 2];
+          }
+        }
+        for (m = 0; m < num_band; m++) {
+          w[m] += e[m * 2] * e[m * 2] + e[m * 2 + 1] * e[m * 2 + 1];
+        }
+      }
+    }
+    for (m = 0; m < num_band; m++) {
+      w[m] /= (double)num_trans * num_trans;
+    }
+    free(e);
+    e = NULL;
+  }
+}
+
 /* static double get_energy(double temperature, double f){ */
 /*   /\* temperature is defined by T (K) *\/ */
 /*   /\* 'f' must be given in eV. *\/ */
 /*   return f / (exp(f / (KB * temperature)) - 1); */
 /* } */
 
+/* Matrices <e_i|G|e_j> of a symmetry operation for bands i and j in */
+/* each degenerate set, where ground representation G moves atom a to */
+/* permutation[a] with phase factor phases[a] and rotates displacement */
+/* by rotation in Cartesian coordinates. Degenerate set s consists of */
+/* bands band_starts[s] <= i < band_starts[s + 1]. The matrices are */
+/* packed one after another in reps. Eigenvectors are columns of */
+/* eigvecs of (num_atom * 3, num_band). */
+static void get_degenerate_set_representations(double *reps,
+                                               const double *eigvecs,
+                                               const int *band_starts,
+                                               const int num_sets,
+                                               const int *permutation,
+                                               const double *phases,
+                                               const double *rotation,
+                                               const int num_atom,
+                                               const int num_band)
+{
+  int i, j, k, l, s, a, size;
+  long adrs, adrs_vec, adrs_rep;
+  double *Ge;
+  double r[3][2], re, im;
+
+  Ge = (double*)malloc(sizeof(double) * num_atom * 3 * 2);
+
+  adrs_rep = 0;
+  for (s = 0; s < num_sets; s++) {
+    size = band_starts[s + 1] - band_starts[s];
+    for (j = band_starts[s]; j < band_starts[s + 1]; j++) {
+      for (a = 0; a < num_atom; a++) {
+        for (k = 0; k < 3; k++) {
+          r[k][0] = 0;
+          r[k][1] = 0;
+          for (l = 0; l < 3; l++) {
+            adrs_vec = ((long)(a * 3 + l) * num_band + j) * 2;
+            r[k][0] += rotation[k * 3 + l] * eigvecs[adrs_vec];
+            r[k][1] += rotation[k * 3 + l] * eigvecs[adrs_vec + 1];
+          }
+        }
+        for (k = 0; k < 3; k++) {
+          adrs = (permutation[a] * 3 + k) * 2;
+          Ge[adrs] = phases[a * 2] * r[k][0] - phases[a * 2 + 1] * r[k][1];
+          Ge[adrs + 1] = phases[a * 2] * r[k][1] + phases[a * 2 + 1] * r[k][0];
+        }
+      }
+      for (i = band_starts[s]; i < band_starts[s + 1]; i++) {
+        re = 0;
+        im = 0;
+        for (k = 0; k < num_atom * 3; k++) {
+          adrs_vec = ((long)k * num_band + i) * 2;
+          re += (eigvecs[adrs_vec] * Ge[k * 2] +
+                 eigvecs[adrs_vec + 1] * Ge[k * 2 + 1]);
+          im += (eigvecs[adrs_vec] * Ge[k * 2 + 1] -
+                 eigvecs[adrs_vec + 1] * Ge[k * 2]);
+        }
+        adrs = adrs_rep + (i - band_starts[s]) * size + j - band_starts[s];
+        adrs *= 2;
+        reps[adrs] = re;
+        reps[adrs + 1] = im;
+      }
+    }
+    adrs_rep += size * size;
+  }
+
+  free(Ge);
+  Ge = NULL;
+}
+
+/* Eigenvectors are rotated in each degenerate subspace so that the */
+/* perturbation dD is diagonal there, and the diagonal elements are */
+/* stored in eigvals_dD. Eigenvalues are assumed in ascending order, so */
+/* that a degenerate set is a run of eigenvalues whose neighboring */
+/* differences are smaller than cutoff. Complex matrices (num_band, */
+/* num_band) are given as pairs of doubles in the C order of numpy. */
+static void rotate_eigenvectors(double *rot_eigvecs,
+                                double *eigvals_dD,
+                                const double *eigvals,
+                                const double *eigvecs,
+                                const double *dD,
+                                const int num_band,
+                                const double cutoff)
+{
+  int i, j, k, l, m, start, size;
+  double *dD_V, *V_dD_V, *w, *W;
+  double re, im;
+
+  dD_V = (double*)malloc(sizeof(double) * num_band * num_band * 2);
+  V_dD_V = (double*)malloc(sizeof(double) * num_band * num_band * 2);
+  w = (double*)malloc(sizeof(double) * num_band);
+  W = (double*)malloc(sizeof(double) * num_band * num_band * 2);
+
+  start = 0;
+  while (start < num_band) {
+    size = 1;
+    while (start + size < num_band &&
+           eigvals[start + size] - eigvals[start + size - 1] < cutoff) {
+      size++;
+    }
+
+    /* dD_V[k, j] = sum_l dD[k, l] V[l, start + j] */
+    for (k = 0; k < num_band; k++) {
+      for (j = 0; j < size; j++) {
+        re = 0;
+        im = 0;
+        for (l = 0; l < num_band; l++) {
+          m = (l * num_band + start + j) * 2;
+          re += (dD[(k * num_band + l) * 2] * eigvecs[m] -
+                 dD[(k * num_band + l) * 2 + 1] * eigvecs[m + 1]);
+          im += (dD[(k * num_band + l) * 2] * eigvecs[m + 1] +
+                 dD[(k * num_band + l) * 2 + 1] * eigvecs[m]);
+        }
+        dD_V[(k * size + j) * 2] = re;
+        dD_V[(k * size + j) * 2 + 1] = im;
+      }
+    }
+    /* V_dD_V[i, j] = sum_k conj(V[k, start + i]) dD_V[k, j] */
+    for (i = 0; i < size; i++) {
+      for (j = 0; j < size; j++) {
+        re = 0;
+        im = 0;
+        for (k = 0; k < num_band; k++) {
+          m = (k * num_band + start + i) * 2;
+          re += (eigvecs[m] * dD_V[(k * size + j) * 2] +
+                 eigvecs[m + 1] * dD_V[(k * size + j) * 2 + 1]);
+          im += (eigvecs[m] * dD_V[(k * size + j) * 2 + 1] -
+                 eigvecs[m + 1] * dD_V[(k * size + j) * 2]);
+        }
+        V_dD_V[(i * size + j) * 2] = re;
+        V_dD_V[(i * size + j) * 2 + 1] = im;
+      }
+    }
+
+    get_hermitian_eigensystem(w, W, V_dD_V, size);
+
+    for (j = 0; j < size; j++) {
+      eigvals_dD[start + j] = w[j];
+    }
+    /* rot_eigvecs[k, start + j] = sum_i V[k, start + i] W[i, j] */
+    for (k = 0; k < num_band; k++) {
+      for (j = 0; j < size; j++) {
+        re = 0;
+        im = 0;
+        for (i = 0; i < size; i++) {
+          m = (k * num_band + start + i) * 2;
+          re += (eigvecs[m] * W[(i * size + j) * 2] -
+                 eigvecs[m + 1] * W[(i * size + j) * 2 + 1]);
+          im += (eigvecs[m] * W[(i * size + j) * 2 + 1] +
+                 eigvecs[m + 1] * W[(i * size + j) * 2]);
+        }
+        rot_eigvecs[(k * num_band + start + j) * 2] = re;
+        rot_eigvecs[(k * num_band + start + j) * 2 + 1] = im;
+      }
+    }
+
+    start += size;
+  }
+
+  free(dD_V);
+  dD_V = NULL;
+  free(V_dD_V);
+  V_dD_V = NULL;
+  free(w);
+  w = NULL;
+  free(W);
+  W = NULL;
+}
+
+/* Eigenvalues in ascending order and eigenvectors as columns of small */
+/* Hermitian matrix by cyclic Jacobi method. mat is destroyed. */
+/* Pivot a_pq = g exp(i phi) is made real by diag(1, exp(-i phi)) and */
+/* then eliminated by the real Jacobi rotation. */
+static void get_hermitian_eigensystem(double *eigvals,
+                                      double *eigvecs,
+                                      double *mat,
+                                      const int size)
+{
+  int i, j, k, p, q, sweep;
+  double off, scale, g, theta, t, c, s, ph_re, ph_im;
+  double u[4][2], x[2], y[2];
+
+  for (i = 0; i < size; i++) {
+    for (j = 0; j < size; j++) {
+      eigvecs[(i * size + j) * 2] = (i == j);
+      eigvecs[(i * size + j) * 2 + 1] = 0;
+    }
+  }
+
+  for (sweep = 0; sweep < 100; sweep++) {
+    off = 0;
+    scale = 0;
+    for (i = 0; i < size; i++) {
+      scale += mat[(i * size + i) * 2] * mat[(i * size + i) * 2];
+      for (j = i + 1; j < size; j++) {
+        off += (mat[(i * size + j) * 2] * mat[(i * size + j) * 2] +
+                mat[(i * size + j) * 2 + 1] * mat[(i * size + j) * 2 + 1]);
+      }
+    }
+    if (off <= DBL_EPSILON * DBL_EPSILON * (scale + off) || off == 0) {
+      break;
+    }
+
+    for (p = 0; p < size - 1; p++) {
+      for (q = p + 1; q < size; q++) {
+        g = sqrt(mat[(p * size + q) * 2] * mat[(p * size + q) * 2] +
+                 mat[(p * size + q) * 2 + 1] * mat[(p * size + q) * 2 + 1]);
+        if (g == 0) {
+          continue;
+        }
+        ph_re = mat[(p * size + q) * 2] / g;
+        ph_im = mat[(p * size + q) * 2 + 1] / g;
+        theta = (mat[(q * size + q) * 2] - mat[(p * size + p) * 2]) / (2 * g);
+        t = 1.0 / (fabs(theta) + sqrt(theta * theta + 1));
+        if (theta < 0) {
+          t = -t;
+        }
+        c = 1.0 / sqrt(t * t + 1);
+        s = t * c;
+        /* U = [[u_pp, u_pq], [u_qp, u_qq]] */
+        u[0][0] = c;
+        u[0][1] = 0;
+        u[1][0] = s;
+        u[1][1] = 0;
+        u[2][0] = -s * ph_re;
+        u[2][1] = s * ph_im;
+        u[3][0] = c * ph_re;
+        u[3][1] = -c * ph_im;
+
+        /* mat <- mat U, eigvecs <- eigvecs U (columns p and q) */
+        for (k = 0; k < size; k++) {
+          x[0] = mat[(k * size + p) * 2];
+          x[1] = mat[(k * size + p) * 2 + 1];
+          y[0] = mat[(k * size + q) * 2];
+          y[1] = mat[(k * size + q) * 2 + 1];
+          mat[(k * size + p) * 2] = (x[0] * u[0][0] - x[1] * u[0][1] +
+                                     y[0] * u[2][0] - y[1] * u[2][1]);
+          mat[(k * size + p) * 2 + 1] = (x[0] * u[0][1] + x[1] * u[0][0] +
+                                         y[0] * u[2][1] + y[1] * u[2][0]);
+          mat[(k * size + q) * 2] = (x[0] * u[1][0] - x[1] * u[1][1] +
+                                     y[0] * u[3][0] - y[1] * u[3][1]);
+          mat[(k * size + q) * 2 + 1] = (x[0] * u[1][1] + x[1] * u[1][0] +
+                                         y[0] * u[3][1] + y[1] * u[3][0]);
+          x[0] = eigvecs[(k * size + p) * 2];
+          x[1] = eigvecs[(k * size + p) * 2 + 1];
+          y[0] = eigvecs[(k * size + q) * 2];
+          y[1] = eigvecs[(k * size + q) * 2 + 1];
+          eigvecs[(k * size + p) * 2] = (x[0] * u[0][0] - x[1] * u[0][1] +
+                                         y[0] * u[2][0] - y[1] * u[2][1]);
+          eigvecs[(k * size + p) * 2 + 1] = (x[0] * u[0][1] + x[1] * u[0][0] +
+                                             y[0] * u[2][1] + y[1] * u[2][0]);
+          eigvecs[(k * size + q) * 2] = (x[0] * u[1][0] - x[1] * u[1][1] +
+                                         y[0] * u[3][0] - y[1] * u[3][1]);
+          eigvecs[(k * size + q) * 2 + 1] = (x[0] * u[1][1] + x[1] * u[1][0] +
+                                             y[0] * u[3][1] + y[1] * u[3][0]);
+        }
+        /* mat <- U^H mat (rows p and q) */
+        for (k = 0; k < size; k++) {
+          x[0] = mat[(p * size + k) * 2];
+          x[1] = mat[(p * size + k) * 2 + 1];
+          y[0] = mat[(q * size + k) * 2];
+          y[1] = mat[(q * size + k) * 2 + 1];
+          mat[(p * size + k) * 2] = (u[0][0] * x[0] + u[0][1] * x[1] +
+                                     u[2][0] * y[0] + u[2][1] * y[1]);
+          mat[(p * size + k) * 2 + 1] = (u[0][0] * x[1] - u[0][1] * x[0] +
+                                         u[2][0] * y[1] - u[2][1] * y[0]);
+          mat[(q * size + k) * 2] = (u[1][0] * x[0] + u[1][1] * x[1] +
+                                     u[3][0] * y[0] + u[3][1] * y[1]);
+          mat[(q * size + k) * 2 + 1] = (u[1][0] * x[1] - u[1][1] * x[0] +
+                                         u[3][0] * y[1] - u[3][1] * y[0]);
+        }
+        mat[(p * size + q) * 2] = 0;
+        mat[(p * size + q) * 2 + 1] = 0;
+        mat[(q * size + p) * 2] = 0;
+        mat[(q * size + p) * 2 + 1] = 0;
+        mat[(p * size + p) * 2 + 1] = 0;
+        mat[(q * size + q) * 2 + 1] = 0;
+      }
+    }
+  }
+
+  for (i = 0; i < size; i++) {
+    eigvals[i] = mat[(i * size + i) * 2];
+  }
+
+  /* Selection sort in ascending order */
+  for (i = 0; i < size - 1; i++) {
+    k = i;
+    for (j = i + 1; j < size; j++) {
+      if (eigvals[j] < eigvals[k]) {
+        k = j;
+      }
+    }
+    if (k != i) {
+      t = eigvals[i];
+      eigvals[i] = eigvals[k];
+      eigvals[k] = t;
+      for (j = 0; j < size; j++) {
+        for (p = 0; p < 2; p++) {
+          t = eigvecs[(j * size + i) * 2 + p];
+          eigvecs[(j * size + i) * 2 + p] = eigvecs[(j * size + k) * 2 + p];
+          eigvecs[(j * size + k) * 2 + p] = t;
+        }
+      }
+    }
+  }
+}
+
+/* Greedy maximum overlap assignment. For each band i of the previous */
+/* point in ascending order, the band j of the current point having */
+/* the largest overlaps[i, j] among those not yet assigned is taken. */
+/* Among equal overlaps, larger j is taken. */
+static void get_band_connection(int *connection,
+                                const double *overlaps,
+                                const int num_band)
+{
+  int i, j, max_j;
+  double max_val;
+  char *is_assigned;
+
+  is_assigned = (char*)malloc(sizeof(char) * num_band);
+  for (j = 0; j < num_band; j++) {
+    is_assigned[j] = 0;
+  }
+
+  for (i = 0; i < num_band; i++) {
+    max_j = -1;
+    max_val = -1;
+    for (j = num_band - 1; j > -1; j--) {
+      if (is_assigned[j]) {
+        continue;
+      }
+      if (overlaps[i * num_band + j] > max_val) {
+        max_val = overlaps[i * num_band + j];
+        max_j = j;
+      }
+    }
+    connection[i] = max_j;
+    is_assigned[max_j] = 1;
+  }
+
+  free(is_assigned);
+  is_assigned = NULL;
+}
+
+/* Directions are searched in the order of phonopy.harmonic.displacement. */
+/* (1) A direction d whose images R_i d and R_j d (i < j) by site */
+/* symmetry span three dimensions with d. (2) A pair of directions d */
+/* and d' with R_i d spanning three dimensions, where R_i d and R_i R_i */
+/* d are inserted when is_trigonal and R_i^3 = I. (3) The first three */
+/* directions. Returns number of displacements. */
+static int get_least_displacements(int (*disps)[3],
+                                   PHPYCONST int (*rotations)[3][3],
+                                   const int *site_sym,
+                                   const int num_site_sym,
+                                   PHPYCONST int (*directions)[3],
+                                   const int num_directions,
+                                   const int is_plusminus,
+                                   const int is_trigonal)
+{
+  int i, j, k, l, m, n, num_disps, num_minus, is_minus, is_found;
+  int is_trigonal_axis;
+  int (*rot_dirs)[3];
+  int found[4][3];
+  int rot_dir[3];
+  int r2[3][3], r3[3][3];
+
+  rot_dirs = (int(*)[3])malloc(sizeof(int[3]) * num_site_sym);
+  num_disps = 0;
+  is_found = 0;
+
+  /* One */
+  for (i = 0; i < num_directions; i++) {
+    for (j = 0; j < num_site_sym; j++) {
+      multiply_integer_matrix_vector(rot_dirs[j],
+                                     rotations[site_sym[j]],
+                                     directions[i]);
+    }
+    for (j = 0; j < num_site_sym; j++) {
+      for (k = j + 1; k < num_site_sym; k++) {
+        if (get_integer_determinant(directions[i], rot_dirs[j], rot_dirs[k])) {
+          for (l = 0; l < 3; l++) {
+            found[0][l] = directions[i][l];
+          }
+          num_disps = 1;
+          is_found = 1;
+          break;
+        }
+      }
+      if (is_found) {
+        break;
+      }
+    }
+    if (is_found) {
+      break;
+    }
+  }
+
+  /* Two */
+  if (!is_found) {
+    for (i = 0; i < num_directions; i++) {
+      for (j = 0; j < num_site_sym; j++) {
+        multiply_integer_matrix_vector(rot_dirs[j],
+                                       rotations[site_sym[j]],
+                                       directions[i]);
+        for (k = 0; k < num_directions; k++) {
+          if (get_integer_determinant(directions[i],
+                                      rot_dirs[j],
+                                      directions[k])) {
+            is_found = 1;
+            break;
+          }
+        }
+        if (is_found) {
+          break;
+        }
+      }
+      if (is_found) {
+        break;
+      }
+    }
+    if (is_found) {
+      for (l = 0; l < 3; l++) {
+        found[0][l] = directions[i][l];
+      }
+      num_disps = 1;
+      if (is_trigonal) {
+        for (l = 0; l < 3; l++) {
+          for (m = 0; m < 3; m++) {
+            r2[l][m] = 0;
+            for (n = 0; n < 3; n++) {
+              r2[l][m] += (rotations[site_sym[j]][l][n] *
+                           rotations[site_sym[j]][n][m]);
+            }
+          }
+        }
+        is_trigonal_axis = 1;
+        for (l = 0; l < 3; l++) {
+          for (m = 0; m < 3; m++) {
+            r3[l][m] = 0;
+            for (n = 0; n < 3; n++) {
+              r3[l][m] += r2[l][n] * rotations[site_sym[j]][n][m];
+            }
+            if (r3[l][m] != (l == m)) {
+              is_trigonal_axis = 0;
+            }
+          }
+        }
+        if (is_trigonal_axis) {
+          multiply_integer_matrix_vector(found[1],
+                                         rotations[site_sym[j]],
+                                         found[0]);
+          multiply_integer_matrix_vector(found[2],
+                                         rotations[site_sym[j]],
+                                         found[1]);
+          num_disps = 3;
+        }
+      }
+      for (l = 0; l < 3; l++) {
+        found[num_disps][l] = directions[k][l];
+      }
+      num_disps++;
+    }
+  }
+
+  /* Three */
+  if (!is_found) {
+    for (i = 0; i < 3; i++) {
+      for (l = 0; l < 3; l++) {
+        found[i][l] = directions[i][l];
+      }
+    }
+    num_disps = 3;
+  }
+
+  num_minus = 0;
+  for (i = 0; i < num_disps; i++) {
+    for (l = 0; l < 3; l++) {
+      disps[i + num_minus][l] = found[i][l];
+    }
+    is_minus = 0;
+    if (is_plusminus == 1) {
+      is_minus = 1;
+    } else if (is_plusminus == 2) {
+      is_minus = 1;
+      for (j = 0; j < num_site_sym; j++) {
+        multiply_integer_matrix_vector(rot_dir,
+                                       rotations[site_sym[j]],
+                                       found[i]);
+        if (rot_dir[0] + found[i][0] == 0 &&
+            rot_dir[1] + found[i][1] == 0 &&
+            rot_dir[2] + found[i][2] == 0) {
+          is_minus = 0;
+          break;
+        }
+      }
+    }
+    if (is_minus) {
+      num_minus++;
+      for (l = 0; l < 3; l++) {
+        disps[i + num_minus][l] = -found[i][l];
+      }
+    }
+  }
+
+  free(rot_dirs);
+  rot_dirs = NULL;
+
+  return num_disps + num_minus;
+}
+
+static int get_integer_determinant(const int a[3],
+                                   const int b[3],
+                                   const int c[3])
+{
+  return (a[0] * b[1] * c[2] - a[0] * b[2] * c[1]
+          + a[1] * b[2] * c[0] - a[1] * b[0] * c[2]
+          + a[2] * b[0] * c[1] - a[2] * b[1] * c[0]);
+}
+
+static void multiply_integer_matrix_vector(int v[3],
+                                           PHPYCONST int r[3][3],
+                                           const int w[3])
+{
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    v[i] = r[i][0] * w[0] + r[i][1] * w[1] + r[i][2] * w[2];
+  }
+}
+
+/* u[s, a, :] = (sum_ii phase_ii[a] (A_ii z)[s2pp[a]] */
+/*              + sqrt(2) sum_ij Re(phase_ij[a] (A_ij (z1 - i z2))[s2pp[a]])) */
+/*             / sqrt(m_a N) */
+/* where A = eigvecs * sigma and z are normal random numbers of the */
+/* Philox stream of (seed, snapshot, q-point). A_ij and phase_ij are */
+/* complex numbers given as pairs of doubles. Snapshots are independent */
+/* of number of threads and of how they are split into chunks. */
+static void get_random_displacements(double *u,
+                                     const double *A_ii,
+                                     const double *phase_ii,
+                                     const double *A_ij,
+                                     const double *phase_ij,
+                                     const int *s2pp,
+                                     const double *masses,
+                                     const int num_snapshots,
+                                     const int num_atom,
+                                     const int num_ii,
+                                     const int num_ij,
+                                     const int num_dim,
+                                     const int num_band,
+                                     const int num_cells,
+                                     const unsigned long key0,
+                                     const unsigned long key1,
+                                     const long snapshot_offset)
+{
+  int i, j, k, l;
+  long snapshot;
+  unsigned int key[2];
+  double v_re, v_im, w_re, w_im, ph_re, ph_im;
+  double *z, *v, *u_s;
+  const double *A;
+
+  key[0] = (unsigned int)(key0 & 0xffffffffUL);
+  key[1] = (unsigned int)(key1 & 0xffffffffUL);
+
+#pragma omp parallel for private(j, k, l, snapshot, v_re, v_im, w_re, w_im, ph_re, ph_im, z, v, u_s, A)
+  for (i = 0; i < num_snapshots; i++) {
+    snapshot = snapshot_offset + i;
+    z = (double*)malloc(sizeof(double) * num_band * 2);
+    v = (double*)malloc(sizeof(double) * num_dim * 4);
+    u_s = u + (long)i * num_atom * 3;
+    for (j = 0; j < num_atom * 3; j++) {
+      u_s[j] = 0;
+    }
+
+    for (j = 0; j < num_ii; j++) {
+      get_normal_random_numbers(z, num_band, key,
+                                (unsigned int)(snapshot & 0xffffffffL),
+                                (unsigned int)(snapshot >> 32),
+                                (unsigned int)j);
+      A = A_ii + (long)j * num_dim * num_band;
+      for (k = 0; k < num_dim; k++) {
+        v[k] = 0;
+        for (l = 0; l < num_band; l++) {
+          v[k] += A[k * num_band + l] * z[l];
+        }
+      }
+      for (k = 0; k < num_atom; k++) {
+        for (l = 0; l < 3; l++) {
+          u_s[k * 3 + l] += phase_ii[j * num_atom + k] * v[s2pp[k] * 3 + l];
+        }
+      }
+    }
+
+    for (j = 0; j < num_ij; j++) {
+      get_normal_random_numbers(z, num_band * 2, key,
+                                (unsigned int)(snapshot & 0xffffffffL),
+                                (unsigned int)(snapshot >> 32),
+                                (unsigned int)(num_ii + j));
+      A = A_ij + (long)j * num_dim * num_band * 2;
+      /* v = A z1, w = A z2 as complex numbers */
+      for (k = 0; k < num_dim; k++) {
+        v_re = 0;
+        v_im = 0;
+        w_re = 0;
+        w_im = 0;
+        for (l = 0; l < num_band; l++) {
+          v_re += A[(k * num_band + l) * 2] * z[l];
+          v_im += A[(k * num_band + l) * 2 + 1] * z[l];
+          w_re += A[(k * num_band + l) * 2] * z[num_band + l];
+          w_im += A[(k * num_band + l) * 2 + 1] * z[num_band + l];
+        }
+        v[k * 4] = v_re;
+        v[k * 4 + 1] = v_im;
+        v[k * 4 + 2] = w_re;
+        v[k * 4 + 3] = w_im;
+      }
+      for (k = 0; k < num_atom; k++) {
+        ph_re = phase_ij[(j * num_atom + k) * 2];
+        ph_im = phase_ij[(j * num_atom + k) * 2 + 1];
+        for (l = 0; l < 3; l++) {
+          v_re = v[(s2pp[k] * 3 + l) * 4];
+          v_im = v[(s2pp[k] * 3 + l) * 4 + 1];
+          w_re = v[(s2pp[k] * 3 + l) * 4 + 2];
+          w_im = v[(s2pp[k] * 3 + l) * 4 + 3];
+          u_s[k * 3 + l] += sqrt(2) * ((v_re * ph_re - v_im * ph_im) -
+                                       (w_re * ph_im + w_im * ph_re));
+        }
+      }
+    }
+
+    for (k = 0; k < num_atom; k++) {
+      for (l = 0; l < 3; l++) {
+        u_s[k * 3 + l] /= sqrt(masses[k] * num_cells);
+      }
+    }
+
+    free(z);
+    z = NULL;
+    free(v);
+    v = NULL;
+  }
+}
+
+/* Standard normal random numbers by Box-Muller transform of uniform */
+/* random numbers (x + 0.5) / 2^32 of Philox4x32-10. Counter of block */
+/* n is (n, counter_1, counter_2, counter_3). */
+static void get_normal_random_numbers(double *z,
+                                      const int num,
+                                      const unsigned int key[2],
+                                      const unsigned int counter_1,
+                                      const unsigned int counter_2,
+                                      const unsigned int counter_3)
+{
+  int i, j;
+  unsigned int ctr[4];
+  double u[4], r;
+
+  for (i = 0; i < num; i += 4) {
+    ctr[0] = (unsigned int)(i / 4);
+    ctr[1] = counter_1;
+    ctr[2] = counter_2;
+    ctr[3] = counter_3;
+    philox4x32(ctr, key);
+    for (j = 0; j < 4; j++) {
+      u[j] = (ctr[j] + 0.5) / 4294967296.0;
+    }
+    for (j = 0; j < 2; j++) {
+      r = sqrt(-2 * log(u[j * 2]));
+      if (i + j * 2 < num) {
+        z[i + j * 2] = r * cos(2 * PI * u[j * 2 + 1]);
+      }
+      if (i + j * 2 + 1 < num) {
+        z[i + j * 2 + 1] = r * sin(2 * PI * u[j * 2 + 1]);
+      }
+    }
+  }
+}
+
+/* Philox4x32-10 of Salmon et al., SC'11 (2011). */
+static void philox4x32(unsigned int ctr[4], const unsigned int key_in[2])
+{
+  int i;
+  unsigned int key[2], hi0, lo0, hi1, lo1;
+  unsigned long long prod0, prod1;
+
+  key[0] = key_in[0];
+  key[1] = key_in[1];
+  for (i = 0; i < 10; i++) {
+    if (i > 0) {
+      key[0] += 0x9E3779B9U;
+      key[1] += 0xBB67AE85U;
+    }
+    prod0 = (unsigned long long)0xD2511F53U * ctr[0];
+    prod1 = (unsigned long long)0xCD9E8D57U * ctr[2];
+    hi0 = (unsigned int)(prod0 >> 32);
+    lo0 = (unsigned int)prod0;
+    hi1 = (unsigned int)(prod1 >> 32);
+    lo1 = (unsigned int)prod1;
+    ctr[0] = hi1 ^ ctr[1] ^ key[0];
+    ctr[1] = lo1;
+    ctr[2] = hi0 ^ ctr[3] ^ key[1];
+    ctr[3] = lo0;
+  }
+}
+
 static int compute_permutation(int * rot_atom,
                                PHPYCONST double lat[3][3],
                                PHPYCONST double (*pos)[3],
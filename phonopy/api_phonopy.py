@@ -68,7 +68,13 @@ from phonopy.phonon.qpoints import QpointsPhonon
 from phonopy.phonon.irreps import IrReps
 from phonopy.phonon.group_velocity import GroupVelocity
 from phonopy.phonon.moment import PhononMoment
-from phonopy.spectrum.dynamic_structure_factor import DynamicStructureFactor
+from phonopy.spectrum.dynamic_structure_factor import (
+    DynamicStructureFactor, DynamicStructureFactorMap)
+from phonopy.profiling import (profiled, enable_profiling,
+                               disable_profiling, get_profiler)
+from phonopy.parallel import (get_num_threads, set_num_threads,
+                              set_parallel_level, set_nested_policy,
+                              set_cpu_affinity, get_parallel_options)
 
 # Uncomment below to watch DeprecationWarning,
 # warnings.simplefilter("always")
@@ -150,6 +156,7 @@ class Phonopy(object):
 
         # set_dynamic_structure_factor
         self._dynamic_structure_factor = None
+        self._dynamic_structure_factor_map = None
 
         # set_partial_DOS
         self._pdos = None
@@ -373,6 +380,10 @@ class Phonopy(object):
     def dynamic_structure_factor(self):
         return self._dynamic_structure_factor
 
+    @property
+    def dynamic_structure_factor_map(self):
+        return self._dynamic_structure_factor_map
+
     @property
     def thermal_properties(self):
         return self._thermal_properties
@@ -385,6 +396,10 @@ class Phonopy(object):
     def thermal_displacement_matrices(self):
         return self._thermal_displacement_matrices
 
+    @property
+    def modulation(self):
+        return self._modulation
+
     @property
     def irreps(self):
         return self._irreps
@@ -408,6 +423,103 @@ class Phonopy(object):
     def projected_dos(self):
         return self._pdos
 
+    @property
+    def num_threads(self):
+        """Number of OpenMP threads used by C kernels
+
+        This setting is process-wide and shared by all Phonopy instances.
+        See phonopy.parallel.
+
+        """
+        return get_num_threads()
+
+    @num_threads.setter
+    def num_threads(self, num_threads):
+        set_num_threads(num_threads)
+
+    @property
+    def parallel_options(self):
+        return get_parallel_options()
+
+    def set_parallel_options(self,
+                             num_threads=None,
+                             parallel_levels=None,
+                             nested_policy=None,
+                             cpu_affinity=None):
+        """Control threads of C kernels and worker pools
+
+        These settings are process-wide and shared by all Phonopy
+        instances. See phonopy.parallel.
+
+        Parameters
+        ----------
+        num_threads : int, optional
+            Number of OpenMP threads used by C kernels.
+        parallel_levels : dict, optional
+            Parallel granularity of C kernels, e.g.,
+            {'dynamical_matrices': 'atom_pairs'}.
+        nested_policy : str, optional
+            'none', 'split', or 'serial'. Sharing threads between workers
+            (num_workers) and OpenMP and BLAS threads inside of them.
+        cpu_affinity : list of int, optional
+            CPUs to which threads are pinned.
+
+        """
+
+        if num_threads is not None:
+            set_num_threads(num_threads)
+        if parallel_levels is not None:
+            for kernel, level in parallel_levels.items():
+                set_parallel_level(kernel, level)
+        if nested_policy is not None:
+            set_nested_policy(nested_policy)
+        if cpu_affinity is not None:
+            set_cpu_affinity(cpu_affinity)
+
+    @property
+    def profile(self):
+        """Wall time, call counts, bytes, and threads of named stages
+
+        None is returned unless profiling is enabled. See
+        phonopy.profiling.Profiler.get_stats.
+
+        """
+        profiler = get_profiler()
+        if profiler is None:
+            return None
+        return profiler.get_stats()
+
+    def enable_profiling(self, trace_memory=False):
+        """Start recording stages such as produce_force_constants,
+        dynamical_matrix, eigh, dipole_dipole, tetrahedron_dos, and
+        write_yaml
+
+        Recording is process-wide and shared by all Phonopy instances.
+
+        Parameters
+        ----------
+        trace_memory : bool, optional
+            Net bytes allocated in stages are measured by tracemalloc,
+            which slows down python code. Default is False.
+
+        """
+        enable_profiling(trace_memory=trace_memory)
+
+    def disable_profiling(self):
+        disable_profiling()
+
+    def show_profile(self):
+        profiler = get_profiler()
+        if profiler is not None:
+            profiler.show()
+
+    def write_chrome_trace(self, filename="phonopy_trace.json"):
+        """Write recorded stages in Chrome trace format (JSON)"""
+        profiler = get_profiler()
+        if profiler is None:
+            raise RuntimeError("Profiling is not enabled.")
+        profiler.write_chrome_trace(filename=filename)
+
     def set_unitcell(self, unitcell):
         warnings.warn("Phonopy.set_unitcell is deprecated.",
                       DeprecationWarning)
@@ -567,6 +679,7 @@ class Phonopy(object):
         if self._primitive.get_masses() is not None:
             self._set_dynamical_matrix()
 
+    @profiled('generate_displacements')
     def generate_displacements(self,
                                distance=0.01,
                                is_plusminus='auto',
@@ -585,6 +698,7 @@ class Phonopy(object):
             self._supercell)
         self.set_displacement_dataset(displacement_dataset)
 
+    @profiled('produce_force_constants')
     def produce_force_constants(self,
                                 forces=None,
                                 calculate_full_force_constants=True,
@@ -619,6 +733,7 @@ class Phonopy(object):
         if self._primitive.get_masses() is not None:
             self._set_dynamical_matrix()
 
+    @profiled('symmetrize_force_constants')
     def symmetrize_force_constants(self, level=1, show_drift=True):
         if self._force_constants.shape[0] == self._force_constants.shape[1]:
             symmetrize_force_constants(self._force_constants, level=level)
@@ -635,6 +750,7 @@ class Phonopy(object):
         if self._primitive.get_masses() is not None:
             self._set_dynamical_matrix()
 
+    @profiled('symmetrize_force_constants')
     def symmetrize_force_constants_by_space_group(self):
         set_tensor_symmetry_PJ(self._force_constants,
                                self._supercell.get_cell().T,
@@ -746,6 +862,7 @@ class Phonopy(object):
         return np.array(frequencies) * self._factor, eigenvectors
 
     # Band structure
+    @profiled('band_structure')
     def run_band_structure(self,
                            paths,
                            with_eigenvectors=False,
@@ -753,7 +870,10 @@ class Phonopy(object):
                            is_band_connection=False,
                            path_connections=None,
                            labels=None,
-                           is_legacy_plot=False):
+                           is_legacy_plot=False,
+                           adaptive_tolerance=None,
+                           adaptive_max_level=5,
+                           adaptive_min_overlap=0.9):
         """Run phonon band structure calculation.
 
         Parameters
@@ -782,6 +902,18 @@ class Phonopy(object):
             to (2 - np.array(path_connections)).sum().
         is_legacy_plot: bool, optional
             This makes the old style band structure plot. Default is False.
+        adaptive_tolerance : float, optional
+            When given, q-points of paths are taken as coarse sampling and
+            are refined where frequencies are not well represented by linear
+            interpolation within this tolerance in THz, or where band
+            connection is ambiguous. See BandStructure. Default is None.
+        adaptive_max_level : int, optional
+            Maximum number of bisections of each interval of the coarse
+            sampling. Default is 5.
+        adaptive_min_overlap : float, optional
+            With is_band_connection, intervals are also refined where
+            overlap of eigenvectors of a band with those at the next point
+            is smaller than this value. See BandStructure. Default is 0.9.
 
         """
 
@@ -805,7 +937,10 @@ class Phonopy(object):
             path_connections=path_connections,
             labels=labels,
             is_legacy_plot=is_legacy_plot,
-            factor=self._factor)
+            factor=self._factor,
+            adaptive_tolerance=adaptive_tolerance,
+            adaptive_max_level=adaptive_max_level,
+            adaptive_min_overlap=adaptive_min_overlap)
 
     def set_band_structure(self,
                            bands,
@@ -966,6 +1101,7 @@ class Phonopy(object):
                                   filename="band.hdf5"):
         self._band_structure.write_hdf5(comment=comment, filename=filename)
 
+    @profiled('write_yaml')
     def write_yaml_band_structure(self,
                                   comment=None,
                                   filename="band.yaml"):
@@ -1081,6 +1217,7 @@ class Phonopy(object):
                 factor=self._factor,
                 use_lapack_solver=self._use_lapack_solver)
 
+    @profiled('mesh')
     def run_mesh(self,
                  mesh=100.0,
                  shift=None,
@@ -1244,6 +1381,7 @@ class Phonopy(object):
     def write_hdf5_mesh(self):
         self._mesh.write_hdf5()
 
+    @profiled('write_yaml')
     def write_yaml_mesh(self):
         self._mesh.write_yaml()
 
@@ -1346,6 +1484,7 @@ class Phonopy(object):
         return plt
 
     # Sampling at q-points
+    @profiled('qpoints')
     def run_qpoints(self,
                     q_points,
                     with_eigenvectors=False,
@@ -1429,10 +1568,12 @@ class Phonopy(object):
     def write_hdf5_qpoints_phonon(self):
         self._qpoints.write_hdf5()
 
+    @profiled('write_yaml')
     def write_yaml_qpoints_phonon(self):
         self._qpoints.write_yaml()
 
     # DOS
+    @profiled('total_dos')
     def run_total_dos(self,
                       sigma=None,
                       freq_min=None,
@@ -1575,6 +1716,7 @@ class Phonopy(object):
         self._total_dos.write(filename=filename)
 
     # PDOS
+    @profiled('projected_dos')
     def run_projected_dos(self,
                           sigma=None,
                           freq_min=None,
@@ -1769,6 +1911,7 @@ class Phonopy(object):
         self._pdos.write(filename=filename)
 
     # Thermal property
+    @profiled('thermal_properties')
     def run_thermal_properties(self,
                                t_min=0,
                                t_max=1000,
@@ -1889,6 +2032,7 @@ class Phonopy(object):
 
         return plt
 
+    @profiled('write_yaml')
     def write_yaml_thermal_properties(self,
                                       filename='thermal_properties.yaml'):
         self._thermal_properties.write_yaml(filename=filename)
@@ -2009,6 +2153,7 @@ class Phonopy(object):
 
         return plt
 
+    @profiled('write_yaml')
     def write_yaml_thermal_displacements(self):
         self._thermal_displacements.write_yaml()
 
@@ -2107,6 +2252,7 @@ class Phonopy(object):
         return (tdm['temperatures'],
                 tdm['thermal_displacement_matrices'])
 
+    @profiled('write_yaml')
     def write_yaml_thermal_displacement_matrices(self):
         self._thermal_displacement_matrices.write_yaml()
 
@@ -2260,6 +2406,7 @@ class Phonopy(object):
         """Create MPOSCAR's"""
         self._modulation.write()
 
+    @profiled('write_yaml')
     def write_yaml_modulations(self):
         self._modulation.write_yaml()
 
@@ -2299,6 +2446,7 @@ class Phonopy(object):
     def show_irreps(self, show_irreps=False):
         self._irreps.show(show_irreps=show_irreps)
 
+    @profiled('write_yaml')
     def write_yaml_irreps(self, show_irreps=False):
         self._irreps.write_yaml(show_irreps=show_irreps)
 
@@ -2342,11 +2490,14 @@ class Phonopy(object):
             msg = ("run_mesh has to be done before run_moment.")
             raise RuntimeError(msg)
         else:
-            if is_projection:
-                if self._mesh.eigenvectors is None:
-                    msg = ("run_mesh has to be done with "
-                           "with_eigenvectors=True.")
-                    return RuntimeError(msg)
+            if is_projection and not self._mesh.with_eigenvectors:
+                msg = ("run_mesh has to be done with "
+                       "with_eigenvectors=True.")
+                raise RuntimeError(msg)
+            if isinstance(self._mesh, IterMesh):
+                self._moment = PhononMoment(iter_mesh=self._mesh,
+                                            is_projection=is_projection)
+            elif is_projection:
                 self._moment = PhononMoment(
                     self._mesh.frequencies,
                     weights=self._mesh.weights,
@@ -2422,19 +2573,7 @@ class Phonopy(object):
             phonons are included in the calculation.
 
         """
-        if self._mesh is None:
-            msg = ("run_mesh has to be done before initializing dynamic"
-                   "structure factor.")
-            raise RuntimeError(msg)
-
-        if not self._mesh.with_eigenvectors:
-            msg = "run_mesh has to be called with with_eigenvectors=True."
-            raise RuntimeError(msg)
-
-        if np.prod(self._mesh.mesh_numbers) != len(self._mesh.ir_grid_points):
-            msg = "run_mesh has to be done with is_mesh_symmetry=False."
-            raise RuntimeError(msg)
-
+        self._check_mesh_for_dynamic_structure_factor()
         self._dynamic_structure_factor = DynamicStructureFactor(
             self._mesh,
             Qpoints,
@@ -2496,27 +2635,120 @@ class Phonopy(object):
         return (self._dynamic_structure_factor.qpoints,
                 self._dynamic_structure_factor.dynamic_structure_factors)
 
+    def run_dynamic_structure_factor_map(self,
+                                         Qpoints,
+                                         T,
+                                         frequency_points,
+                                         sigma=None,
+                                         atomic_form_factor_func=None,
+                                         scattering_lengths=None,
+                                         freq_min=None,
+                                         freq_max=None,
+                                         chunk_size=100,
+                                         filename=None):
+        """Run S(Q, omega) map calculation on a grid of Q-points
+
+        *******************************************************************
+         This is still an experimental feature. API can be changed without
+         notification.
+        *******************************************************************
+
+        Parameters
+        ----------
+        Qpoints: array_like
+            Q-points in any Brillouin zone given as a slice or a volume in
+            reciprocal space.
+            dtype='double'
+            shape=grid_shape + (3,)
+        frequency_points: array_like
+            Frequency points in THz.
+            dtype='double'
+            shape=(frequency_points,)
+        sigma: float, function object, or None
+            Standard deviation of Gaussian resolution function, or function
+            that returns it for given phonon frequencies. With None,
+            histogram is used.
+        chunk_size: int
+            Number of Q-points treated at once.
+        filename: str or None
+            When given, S(Q, omega) is written to this HDF5 file chunk by
+            chunk instead of being kept in memory.
+
+        See the detail of other parameters at
+        Phonopy.init_dynamic_structure_factor().
+
+        """
+
+        self._check_mesh_for_dynamic_structure_factor()
+        self._dynamic_structure_factor_map = DynamicStructureFactorMap(
+            self._mesh,
+            Qpoints,
+            T,
+            frequency_points,
+            sigma=sigma,
+            atomic_form_factor_func=atomic_form_factor_func,
+            scattering_lengths=scattering_lengths,
+            freq_min=freq_min,
+            freq_max=freq_max,
+            chunk_size=chunk_size,
+            filename=filename)
+        self._dynamic_structure_factor_map.run()
+
     def run_random_displacements(self,
                                  T,
                                  number_of_snapshots=1,
                                  seed=None,
-                                 cutoff_frequency=None):
+                                 cutoff_frequency=None,
+                                 chunk_size=None,
+                                 filename=None):
+        """Generate random displacements by canonical ensemble
+
+        Parameters
+        ----------
+        T : float
+            Temperature in Kelvin.
+        number_of_snapshots : int, optional
+            Number of snapshots. Default is 1.
+        seed : int, optional
+            Random seed. Snapshots are reproducible for the same seed.
+        cutoff_frequency : float, optional
+            See RandomDisplacements.
+        chunk_size : int, optional
+            Number of snapshots generated at once.
+        filename : str, optional
+            When given, snapshots are written into this hdf5 file chunk by
+            chunk and are not stored in this instance.
+
+        """
+
         self._random_displacements = RandomDisplacements(
             self._dynamical_matrix,
             cutoff_frequency=cutoff_frequency,
             factor=self._factor)
-        self._random_displacements.run(
-            T,
-            number_of_snapshots=number_of_snapshots,
-            seed=seed)
+        if filename is None:
+            self._random_displacements.run(
+                T,
+                number_of_snapshots=number_of_snapshots,
+                seed=seed,
+                chunk_size=chunk_size)
+        else:
+            if chunk_size is None:
+                chunk_size = 100
+            self._random_displacements.write_hdf5(
+                filename,
+                T,
+                number_of_snapshots,
+                seed=seed,
+                chunk_size=chunk_size)
 
     def get_random_displacements(self):
-        if self._random_displacements is not None:
+        if self._random_displacements is None:
             msg = ("run_random_displacements has to be done.")
             raise RuntimeError(msg)
 
         return self._random_displacements.u
 
+    @profiled('save')
     def save(self,
              filename="phonopy_params.yaml",
              settings=None):
@@ -2547,6 +2779,20 @@ class Phonopy(object):
     #################
     # Local methods #
     #################
+    def _check_mesh_for_dynamic_structure_factor(self):
+        if self._mesh is None:
+            msg = ("run_mesh has to be done before initializing dynamic"
+                   "structure factor.")
+            raise RuntimeError(msg)
+
+        if not self._mesh.with_eigenvectors:
+            msg = "run_mesh has to be called with with_eigenvectors=True."
+            raise RuntimeError(msg)
+
+        if np.prod(self._mesh.mesh_numbers) != len(self._mesh.ir_grid_points):
+            msg = "run_mesh has to be done with is_mesh_symmetry=False."
+            raise RuntimeError(msg)
+
     def _run_force_constants_from_forces(self,
                                          distributed_atom_list=None,
                                          use_alm=False,
@@ -2571,6 +2817,7 @@ class Phonopy(object):
                     atom_list=distributed_atom_list,
                     decimals=decimals)
 
+    @profiled('dynamical_matrix_setup')
     def _set_dynamical_matrix(self):
         self._dynamical_matrix = None
 
@@ -2634,11 +2881,13 @@ class Phonopy(object):
             symmetry=self._primitive_symmetry,
             frequency_factor_to_THz=self._factor)
 
+    @profiled('symmetry')
     def _search_symmetry(self):
         self._symmetry = Symmetry(self._supercell,
                                   self._symprec,
                                   self._is_symmetry)
 
+    @profiled('symmetry')
     def _search_primitive_symmetry(self):
         self._primitive_symmetry = Symmetry(self._primitive,
                                             self._symprec,
@@ -2649,11 +2898,13 @@ class Phonopy(object):
             print("Warning: Point group symmetries of supercell and primitive"
                   "cell are different.")
 
+    @profiled('supercell')
     def _build_supercell(self):
         self._supercell = get_supercell(self._unitcell,
                                         self._supercell_matrix,
                                         self._symprec)
 
+    @profiled('supercell')
     def _build_supercells_with_displacements(self):
         supercells = []
         for disp in self._displacement_dataset['first_atoms']:
@@ -2669,6 +2920,7 @@ class Phonopy(object):
 
         self._supercells_with_displacements = supercells
 
+    @profiled('primitive')
     def _build_primitive_cell(self):
         """
         primitive_matrix:
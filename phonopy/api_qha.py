@@ -32,8 +32,15 @@
 # ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 # POSSIBILITY OF SUCH DAMAGE.
 
+import numpy as np
 from phonopy.qha import BulkModulus, QHA
-from phonopy.units import EvTokJmol, EVAngstromToGPa
+from phonopy.units import EvTokJmol, EVAngstromToGPa, VaspToTHz
+from phonopy.structure.cells import get_supercell, get_primitive
+from phonopy.structure.grid_points import GridPoints
+from phonopy.structure.symmetry import Symmetry
+from phonopy.harmonic.dynamical_matrix import DynamicalMatrix
+from phonopy.phonon.thermal_properties import (ThermalProperties,
+                                               FrequenciesOnMesh)
 
 class PhonopyQHA(object):
     """PhonopyQHA API
@@ -50,6 +57,7 @@ class PhonopyQHA(object):
                  eos='vinet',
                  t_max=None,
                  energy_plot_factor=None,
+                 stacked_fit=False,
                  verbose=False):
         """
 
@@ -95,6 +103,9 @@ class PhonopyQHA(object):
             of the third element from the end is used.
         energy_plot_factor: float
             This value is multiplied to energy like values only in plotting.
+        stacked_fit: bool
+            Fit EOS at all temperatures at once by stacked normal equations.
+            See QHA.run. Default is False.
         verbose: boolean
             Show log or not.
 
@@ -113,7 +124,7 @@ class PhonopyQHA(object):
                             eos=eos,
                             t_max=t_max,
                             energy_plot_factor=energy_plot_factor)
-            self._qha.run(verbose=verbose)
+            self._qha.run(verbose=verbose, stacked=stacked_fit)
 
     def get_bulk_modulus(self):
         """Returns bulk modulus computed without phonon free energy"""
@@ -311,3 +322,304 @@ class PhonopyQHA(object):
 
     def write_gruneisen_temperature(self, filename='gruneisen-temperature.dat'):
         self._qha.write_gruneisen_temperature(filename=filename)
+
+
+def run_qha_at_volumes(unitcells,
+                       supercell_matrix,
+                       force_constants,
+                       electronic_energies,
+                       mesh,
+                       primitive_matrix=None,
+                       temperatures=None,
+                       t_min=0,
+                       t_max=1000,
+                       t_step=10,
+                       eos='vinet',
+                       qha_t_max=None,
+                       cutoff_frequency=None,
+                       factor=VaspToTHz,
+                       symprec=1e-5,
+                       num_workers=None,
+                       stacked_fit=False,
+                       verbose=False):
+    """Run phonon calculations at volumes and QHA in one process
+
+    Thermal properties at volumes are computed by
+    get_thermal_properties_at_volumes and passed to PhonopyQHA without
+    writing and reading thermal_properties.yaml files.
+
+    Parameters
+    ----------
+    electronic_energies : array_like
+        Electronic energies (U) or electronic free energies (U) in eV.
+        See PhonopyQHA.
+        shape=(volumes,) or (temperatuers, volumes)
+    eos : str, optional
+        Equation of state used for fitting F vs V. Default is 'vinet'.
+    qha_t_max : float, optional
+        Maximum temperature of QHA. See t_max of PhonopyQHA.
+    stacked_fit : bool, optional
+        See PhonopyQHA. Default is False.
+    verbose : bool, optional
+        Show log or not. Default is False.
+    Other parameters are passed to get_thermal_properties_at_volumes.
+
+    Returns
+    -------
+    PhonopyQHA
+
+    """
+
+    (volumes,
+     temps,
+     free_energy,
+     cv,
+     entropy) = get_thermal_properties_at_volumes(
+         unitcells,
+         supercell_matrix,
+         force_constants,
+         mesh,
+         primitive_matrix=primitive_matrix,
+         temperatures=temperatures,
+         t_min=t_min,
+         t_max=t_max,
+         t_step=t_step,
+         cutoff_frequency=cutoff_frequency,
+         factor=factor,
+         symprec=symprec,
+         num_workers=num_workers)
+
+    return PhonopyQHA(volumes=volumes,
+                      electronic_energies=electronic_energies,
+                      temperatures=temps,
+                      free_energy=free_energy,
+                      cv=cv,
+                      entropy=entropy,
+                      eos=eos,
+                      t_max=qha_t_max,
+                      stacked_fit=stacked_fit,
+                      verbose=verbose)
+
+
+def get_thermal_properties_at_volumes(unitcells,
+                                      supercell_matrix,
+                                      force_constants,
+                                      mesh,
+                                      primitive_matrix=None,
+                                      temperatures=None,
+                                      t_min=0,
+                                      t_max=1000,
+                                      t_step=10,
+                                      shift=None,
+                                      is_gamma_center=False,
+                                      cutoff_frequency=None,
+                                      factor=VaspToTHz,
+                                      symprec=1e-5,
+                                      num_workers=None):
+    """Compute thermal properties at volumes for QHA
+
+    Unit cells at volumes have to share atomic species and fractional
+    atomic positions, i.e., only the lattice differs. Therefore the
+    supercell and primitive cell, the point group, and the ir-grid points
+    are built once from the first unit cell and reused when the lattice is
+    isotropically scaled from the first one. Otherwise the cells are
+    rebuilt, and the ir-grid points are also rebuilt when the point group
+    differs from that of the first unit cell. Then frequencies and thermal
+    properties at volumes are computed with threads. Non-analytical term
+    correction is not supported.
+
+    Parameters
+    ----------
+    unitcells : list of PhonopyAtoms
+        Unit cells at volumes.
+    supercell_matrix : array_like
+        Supercell matrix relative to unit cell.
+        shape=(3, 3) or (3,)
+    force_constants : list of ndarray
+        Supercell force constants at volumes. Full and compact shapes of
+        arrays are supported.
+    mesh : array_like
+        Sampling mesh numbers.
+        shape=(3,)
+    primitive_matrix : array_like, optional
+        Primitive matrix relative to unit cell. Default is None.
+        shape=(3, 3)
+    temperatures : array_like, optional
+        Temperatures in K. When this is set, t_min, t_max, and t_step are
+        ignored.
+    t_min, t_max, t_step : float, optional
+        Minimum and maximum temperatures and the interval in this
+        temperature range. Default values are 0, 1000, and 10.
+    shift, is_gamma_center : optional
+        See Mesh.
+    cutoff_frequency : float, optional
+        See ThermalProperties.
+    factor : float, optional
+        Frequency unit conversion factor. Default is VaspToTHz.
+    symprec : float, optional
+        Symmetry tolerance. Default is 1e-5.
+    num_workers : int, optional
+        Number of threads to treat volumes in parallel. Diagonalization
+        of dynamical matrices releases GIL. Default is 1.
+
+    Returns
+    -------
+    volumes : ndarray
+        Unit cell volumes in Angstrom^3.
+        shape=(volumes,), dtype='double'
+    temperatures : ndarray
+        shape=(temperatures,), dtype='double'
+    free_energy : ndarray
+        Helmholtz free energy in kJ/mol.
+        shape=(temperatures, volumes), dtype='double'
+    cv : ndarray
+        Heat capacity at constant volume in J/K/mol.
+        shape=(temperatures, volumes), dtype='double'
+    entropy : ndarray
+        Entropy at constant volume in J/K/mol.
+        shape=(temperatures, volumes), dtype='double'
+
+    """
+
+    if len(unitcells) != len(force_constants):
+        raise RuntimeError("Numbers of unit cells and force constants "
+                           "sets are different.")
+
+    smat = np.array(supercell_matrix, dtype='intc')
+    if smat.shape == (3, ):
+        smat = np.diag(smat)
+    trans_mat = np.linalg.inv(smat)
+    if primitive_matrix is not None:
+        trans_mat = np.dot(trans_mat, primitive_matrix)
+
+    supercell = get_supercell(unitcells[0], smat, symprec=symprec)
+    primitive = get_primitive(supercell, trans_mat, symprec=symprec)
+    cells = [_get_cells_at_volume(cell, unitcells[0], smat, trans_mat,
+                                  (supercell, primitive), symprec)
+             for cell in unitcells]
+    grid_points = _get_grid_points_at_volumes(cells, mesh, shift,
+                                              is_gamma_center, symprec)
+    volumes = np.array([cell.get_volume() for cell in unitcells],
+                       dtype='double')
+
+    if temperatures is None:
+        temps = np.arange(t_min, t_max + t_step / 2.0, t_step,
+                          dtype='double')
+    else:
+        temps = np.extract(np.logical_not(np.array(temperatures) < 0),
+                           np.array(temperatures, dtype='double'))
+    props = np.zeros((3, len(temps), len(unitcells)), dtype='double')
+
+    def run_at_volume(i):
+        dm = DynamicalMatrix(cells[i][0],
+                             cells[i][1],
+                             force_constants[i],
+                             symprec=symprec)
+        gp = grid_points[i]
+        frequencies = _get_frequencies(dm, gp.qpoints, factor)
+        tp = ThermalProperties(FrequenciesOnMesh(frequencies, gp.weights),
+                               cutoff_frequency=cutoff_frequency)
+        tp.set_temperatures(temps)
+        tp.run()
+        _, fe, entropy, cv = tp.thermal_properties
+        props[0, :, i] = fe
+        props[1, :, i] = cv
+        props[2, :, i] = entropy
+
+    if num_workers is None or num_workers < 2:
+        for i in range(len(unitcells)):
+            run_at_volume(i)
+    else:
+        from phonopy.parallel import thread_pool
+        with thread_pool(num_workers) as executor:
+            list(executor.map(run_at_volume, range(len(unitcells))))
+
+    return volumes, temps, props[0], props[1], props[2]
+
+
+def _get_cells_at_volume(unitcell, ref_unitcell, supercell_matrix,
+                         trans_mat, ref_cells, symprec):
+    """Return supercell and primitive cell at volume
+
+    The reference cells are returned when the lattice is isotropically
+    scaled, for which the shortest vectors in fractional coordinates are
+    unchanged.
+
+    """
+
+    if (unitcell.get_number_of_atoms() !=
+        ref_unitcell.get_number_of_atoms() or
+        (unitcell.get_atomic_numbers() !=
+         ref_unitcell.get_atomic_numbers()).any()):
+        raise RuntimeError("Atoms in unit cells at volumes are different.")
+    diff = (unitcell.get_scaled_positions() -
+            ref_unitcell.get_scaled_positions())
+    if (np.abs(diff - np.rint(diff)) > symprec).any():
+        raise RuntimeError("Fractional atomic positions in unit cells at "
+                           "volumes are different.")
+
+    lattice = unitcell.get_cell()
+    ref_lattice = ref_unitcell.get_cell()
+    ratio = np.cbrt(np.linalg.det(lattice) / np.linalg.det(ref_lattice))
+    if np.allclose(lattice, ref_lattice * ratio, atol=symprec):
+        return ref_cells
+    else:
+        supercell = get_supercell(unitcell, supercell_matrix, symprec=symprec)
+        primitive = get_primitive(supercell, trans_mat, symprec=symprec)
+        return supercell, primitive
+
+
+def _get_grid_points_at_volumes(cells, mesh, shift, is_gamma_center,
+                                symprec):
+    """Return GridPoints at volumes
+
+    Point groups are computed only for rebuilt primitive cells. GridPoints
+    is shared by volumes whose point groups are the same as that of the
+    first primitive cell.
+
+    """
+
+    ref_primitive = cells[0][1]
+    ref_rotations = Symmetry(
+        ref_primitive, symprec=symprec).get_pointgroup_operations()
+    ref_gp = GridPoints(np.array(mesh, dtype='intc'),
+                        np.linalg.inv(ref_primitive.get_cell()),
+                        q_mesh_shift=shift,
+                        is_gamma_center=is_gamma_center,
+                        rotations=ref_rotations)
+    grid_points = []
+    for supercell, primitive in cells:
+        if primitive is ref_primitive:
+            grid_points.append(ref_gp)
+            continue
+        rotations = Symmetry(
+            primitive, symprec=symprec).get_pointgroup_operations()
+        if _is_same_pointgroup(rotations, ref_rotations):
+            grid_points.append(ref_gp)
+        else:
+            grid_points.append(
+                GridPoints(np.array(mesh, dtype='intc'),
+                           np.linalg.inv(primitive.get_cell()),
+                           q_mesh_shift=shift,
+                           is_gamma_center=is_gamma_center,
+                           rotations=rotations))
+    return grid_points
+
+
+def _is_same_pointgroup(rotations, ref_rotations):
+    if len(rotations) != len(ref_rotations):
+        return False
+    ref_set = set(tuple(r.ravel()) for r in ref_rotations)
+    return all(tuple(r.ravel()) in ref_set for r in rotations)
+
+
+def _get_frequencies(dynamical_matrix, qpoints, factor, chunk_size=256):
+    num_band = dynamical_matrix.primitive.get_number_of_atoms() * 3
+    frequencies = np.zeros((len(qpoints), num_band), dtype='double')
+    for i in range(0, len(qpoints), chunk_size):
+        dms = dynamical_matrix.get_dynamical_matrices(
+            qpoints[i:(i + chunk_size)])
+        eigvals = np.linalg.eigvalsh(dms).real
+        frequencies[i:(i + chunk_size)] = (
+            np.sqrt(np.abs(eigvals)) * np.sign(eigvals) * factor)
+    return frequencies
@@ -327,7 +327,7 @@ def get_parser():
               "wave vector q) instead of little group"))
     parser.add_argument(
         "--loglevel", dest="loglevel", type=int,
-        help="Log level")
+        help="Log level. Timings of stages are shown at level 3 or more")
     parser.add_argument(
         "--mass", nargs='+', dest="masses",
         help="Same as MASS tag")
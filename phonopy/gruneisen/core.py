@@ -33,8 +33,9 @@
 # POSSIBILITY OF SUCH DAMAGE.
 
 import numpy as np
-from phonopy.phonon.band_structure import estimate_band_connection
-from phonopy.phonon.degeneracy import rotate_eigenvectors
+from phonopy.harmonic.dynamical_matrix import DynamicalMatrix
+from phonopy.phonon.band_structure import get_band_connections
+from phonopy.phonon.degeneracy import rotate_eigenvectors_at_qpoints
 
 
 class GruneisenBase(object):
@@ -82,41 +83,26 @@ class GruneisenBase(object):
         return self._eigenvectors
 
     def _set_gruneisen(self):
+        qpoints = np.array(self._qpoints, dtype='double').reshape(-1, 3)
         if self._is_band_connection:
-            self._q_direction = self._qpoints[0] - self._qpoints[-1]
-            band_order = range(self._dynmat.get_dimension())
-            prev_eigvecs = None
-
-        edDe = []  # <e|dD|e>
-        eigvals = []
-        eigvecs = []
-        for i, q in enumerate(self._qpoints):
-            if self._is_band_connection and self._dynmat.is_nac():
-                self._dynmat.set_dynamical_matrix(
-                    q, q_direction=self._q_direction)
-            else:
-                self._dynmat.set_dynamical_matrix(q)
+            self._q_direction = qpoints[0] - qpoints[-1]
 
-            dm = self._dynmat.get_dynamical_matrix()
-            evals, evecs = np.linalg.eigh(dm)
-            evals_at_q = evals.real
-            dD = self._get_dD(q, self._dynmat_minus, self._dynmat_plus)
-            evecs_at_q, edDe_at_q = rotate_eigenvectors(evals_at_q, evecs, dD)
-
-            if self._is_band_connection:
-                if prev_eigvecs is not None:
-                    band_order = estimate_band_connection(
-                        prev_eigvecs,
-                        evecs_at_q,
-                        band_order)
-                eigvals.append(evals_at_q[band_order])
-                eigvecs.append(evecs_at_q[:, band_order])
-                edDe.append(edDe_at_q[band_order])
-                prev_eigvecs = evecs_at_q
-            else:
-                eigvals.append(evals_at_q)
-                eigvecs.append(evecs_at_q)
-                edDe.append(edDe_at_q)
+        if (self._dynmat.is_nac() or self._dynmat_plus.is_nac() or
+            self._dynmat_minus.is_nac()):
+            dms, dDs = self._get_dynamical_matrices_by_loop(qpoints)
+        else:
+            dms = self._dynmat.get_dynamical_matrices(qpoints)
+            dDs = self._get_dDs(qpoints)
+
+        eigvals, eigvecs = np.linalg.eigh(dms)
+        eigvals = eigvals.real
+        eigvecs, edDe = rotate_eigenvectors_at_qpoints(eigvals, eigvecs, dDs)
+        if self._is_band_connection:
+            band_orders = get_band_connections(eigvecs)
+            q_indices = np.arange(len(qpoints))[:, None]
+            eigvals = eigvals[q_indices, band_orders]
+            edDe = edDe[q_indices, band_orders]
+            eigvecs = eigvecs[q_indices, :, band_orders].transpose(0, 2, 1)
 
         edDe = np.array(edDe, dtype='double', order='C')
         self._eigenvalues = np.array(eigvals, dtype='double', order='C')
@@ -125,6 +111,66 @@ class GruneisenBase(object):
                                       dtype=("c%d" % (itemsize * 2)), order='C')
         self._gruneisen = -edDe / self._delta_strain / self._eigenvalues / 2
 
+    def _get_dDs(self, qpoints):
+        """Return D_plus(q) - D_minus(q) at q-points
+
+        When the dynamical matrices at plus and minus volumes share
+        masses and smallest vectors in reduced coordinates, which is the
+        case of uniform strain, their difference is the Fourier transform
+        of the difference of the force constants. Then only one batch of
+        dynamical matrices is computed.
+
+        """
+
+        d_plus = self._dynmat_plus
+        d_minus = self._dynmat_minus
+        if self._share_geometry(d_plus, d_minus):
+            delta_fc = (d_plus.get_force_constants() -
+                        d_minus.get_force_constants())
+            dynmat = DynamicalMatrix(d_minus.get_supercell(),
+                                     d_minus.get_primitive(),
+                                     delta_fc)
+            return dynmat.get_dynamical_matrices(qpoints)
+        else:
+            return (d_plus.get_dynamical_matrices(qpoints) -
+                    d_minus.get_dynamical_matrices(qpoints))
+
+    def _share_geometry(self, d_a, d_b, tolerance=1e-6):
+        if (d_a.get_decimals() is not None or
+            d_b.get_decimals() is not None):
+            return False
+        fc_a = d_a.get_force_constants()
+        fc_b = d_b.get_force_constants()
+        if fc_a.shape != fc_b.shape:
+            return False
+        prim_a = d_a.get_primitive()
+        prim_b = d_b.get_primitive()
+        if (len(prim_a.get_masses()) != len(prim_b.get_masses()) or
+            (np.abs(prim_a.get_masses() - prim_b.get_masses())
+             > tolerance).any()):
+            return False
+        svecs_a, multi_a = d_a.get_shortest_vectors()
+        svecs_b, multi_b = d_b.get_shortest_vectors()
+        if multi_a.shape != multi_b.shape or (multi_a != multi_b).any():
+            return False
+        if (np.abs(svecs_a - svecs_b) > tolerance).any():
+            return False
+        return True
+
+    def _get_dynamical_matrices_by_loop(self, qpoints):
+        dms = []
+        dDs = []
+        for q in qpoints:
+            if self._is_band_connection and self._dynmat.is_nac():
+                self._dynmat.set_dynamical_matrix(
+                    q, q_direction=self._q_direction)
+            else:
+                self._dynmat.set_dynamical_matrix(q)
+            dms.append(self._dynmat.get_dynamical_matrix())
+            dDs.append(self._get_dD(q, self._dynmat_minus, self._dynmat_plus))
+        return (np.array(dms, dtype='complex128', order='C'),
+                np.array(dDs, dtype='complex128', order='C'))
+
     def _get_dD(self, q, d_a, d_b):
         if (self._is_band_connection and d_a.is_nac() and d_b.is_nac()):
             d_a.set_dynamical_matrix(q, q_direction=self._q_direction)
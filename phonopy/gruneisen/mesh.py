@@ -82,6 +82,12 @@ class GruneisenMesh(GruneisenBase):
     def get_mesh_numbers(self):
         return self._mesh
 
+    def get_primitive(self):
+        return self._dynmat.get_primitive()
+
+    def get_unit_conversion_factor(self):
+        return self._factor
+
     def get_qpoints(self):
         return self._qpoints
 
@@ -179,22 +185,82 @@ def get_thermodynamic_Gruneisen_parameter(gammas,
                                           frequencies,
                                           multiplicities,
                                           t):
-    if t > 0:
-        conditions = (frequencies > 0)
-        freq_temp = np.where(conditions, x, 1)
-        cv_temp = mode_cv(t, frequencies * THzToEv)
-        cv = np.where(conditions, x, 0)
-        return (np.dot(multiplicities, cv * gammas).sum() /
-                np.dot(multiplicities, cv).sum())
-    else:
-        return 0.
+    """Heat capacity weighted average of mode Gruneisen parameters
+
+    Parameters
+    ----------
+    gammas : ndarray
+        Mode Gruneisen parameters.
+        shape=(qpoints, bands), dtype='double'
+    frequencies : ndarray
+        Phonon frequencies in THz. Modes of non-positive frequencies are
+        excluded.
+        shape=(qpoints, bands), dtype='double'
+    multiplicities : ndarray
+        Weights of q-points.
+        shape=(qpoints,)
+    t : float or array_like
+        Temperatures in K.
+
+    Returns
+    -------
+    float or ndarray
+        Zero at non-positive temperatures. shape=t.shape
+
+    """
+
+    cv_gamma, cv = _get_weighted_mode_cv_sums(
+        gammas, frequencies, multiplicities, t, frequencies > 0)
+    vals = np.where(cv > 0, cv_gamma / np.where(cv > 0, cv, 1), 0)
+    return vals[()]
+
 
 def get_thermal_expansion_coefficient(gammas,
                                       frequencies,
                                       multiplicities,
                                       t):
-    if t > 0:
-        return np.dot(multiplicities,
-                      mode_cv(t, frequencies * THzToEv) * gammas).sum()
-    else:
-        return 0.
+    """Sum of heat capacity times mode Gruneisen parameter over modes
+
+    Parameters are the same as those of
+    get_thermodynamic_Gruneisen_parameter, except that all modes are
+    included.
+
+    """
+
+    cv_gamma, _ = _get_weighted_mode_cv_sums(
+        gammas, frequencies, multiplicities, t)
+    return cv_gamma[()]
+
+
+def _get_weighted_mode_cv_sums(gammas,
+                               frequencies,
+                               multiplicities,
+                               t,
+                               condition=None,
+                               chunk_size=64):
+    """Return sums of w * cv * gamma and w * cv over modes at temperatures
+
+    Temperatures are treated by chunks to bound the size of temporary
+    arrays. Sums are zero at non-positive temperatures.
+
+    """
+
+    temps = np.array(t, dtype='double')
+    freqs = (np.array(frequencies, dtype='double') * THzToEv).ravel()
+    weights = np.repeat(np.array(multiplicities, dtype='double'),
+                        np.array(frequencies).shape[-1])
+    if condition is not None:
+        freqs = np.extract(np.ravel(condition), freqs)
+        weights = np.extract(np.ravel(condition), weights)
+        gammas = np.extract(np.ravel(condition), gammas)
+    w_gammas = weights * np.ravel(gammas)
+
+    cv_gamma = np.zeros(temps.size, dtype='double')
+    cv = np.zeros(temps.size, dtype='double')
+    positive_temps = np.where(temps.ravel() > 0)[0]
+    for i in range(0, len(positive_temps), chunk_size):
+        indices = positive_temps[i:(i + chunk_size)]
+        mode_cvs = mode_cv(temps.ravel()[indices, None], freqs)
+        cv_gamma[indices] = np.dot(mode_cvs, w_gammas)
+        cv[indices] = np.dot(mode_cvs, weights)
+    return cv_gamma.reshape(temps.shape), cv.reshape(temps.shape)
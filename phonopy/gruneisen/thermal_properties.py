@@ -33,9 +33,33 @@
 # POSSIBILITY OF SUCH DAMAGE.
 
 import numpy as np
-from phonopy.phonon.thermal_properties import ThermalProperties
+from phonopy.units import THzToEv, EvTokJmol
+from phonopy.phonon.thermal_properties import (ThermalProperties,
+                                               FrequenciesOnMesh)
+
 
 class GruneisenThermalProperties(object):
+    """Thermal properties at volumes by mode Gruneisen parameters
+
+    Frequencies at volume V are extrapolated from those at V0 by the
+    analytical solution of constant mode Gruneisen parameters,
+
+        omega(V)^2 = omega(V0)^2 (V / V0)^(-2 gamma).
+
+    Free energies, entropies, and heat capacities at all volumes and
+    temperatures are computed at once in C.
+
+    Attributes
+    ----------
+    temperatures : ndarray
+        shape=(temperatures,), dtype='double'
+    thermal_properties : list of ndarray
+        [temperatures, free_energy, entropy, cv]. Free energy in kJ/mol,
+        and entropy and heat capacity in J/K/mol.
+        shape=(temperatures, volumes), dtype='double'
+
+    """
+
     def __init__(self,
                  gruneisen_mesh,
                  volumes,
@@ -43,35 +67,84 @@ class GruneisenThermalProperties(object):
                  t_max=2004,
                  t_min=0,
                  cutoff_frequency=None):
-        phonon = gruneisen_mesh.get_phonon()
-        self._cutoff_frequency = cutoff_frequency
-        self._factor = phonon.get_unit_conversion_factor(),
-        self._V0 = phonon.get_primitive().get_volume()
+        if cutoff_frequency is None or cutoff_frequency < 0:
+            self._cutoff_frequency = 0.0
+        else:
+            self._cutoff_frequency = cutoff_frequency
+        self._factor = gruneisen_mesh.get_unit_conversion_factor()
+        self._V0 = gruneisen_mesh.get_primitive().get_volume()
         self._gamma = gruneisen_mesh.get_gruneisen()
         self._gamma_prime = gruneisen_mesh.get_gamma_prime()
         self._weights = gruneisen_mesh.get_weights()
         self._eigenvalues = gruneisen_mesh.get_eigenvalues()
         self._frequencies = gruneisen_mesh.get_frequencies()
-        self._thermal_properties = []
-        for V in volumes:
-            tp = self._get_thermal_properties_at_V(V)
-            tp.set_temperature_range(t_min=t_min, t_max=t_max, t_step=t_step)
-            tp.run()
-            self._thermal_properties.append(tp)
+        self._volumes = np.array(volumes, dtype='double')
+        self._temperatures = np.arange(t_min, t_max + t_step / 2.0, t_step,
+                                       dtype='double')
 
-    def get_thermal_properties(self):
-        """Return a set of phonopy.phonon::ThermalProperties object"""
+        try:
+            import phonopy._phonopy as phonoc
+            props = self._run_c_thermal_properties()
+        except ImportError:
+            props = self._run_py_thermal_properties()
+        self._thermal_properties = [
+            self._temperatures,
+            np.array(props[:, :, 0].T, dtype='double', order='C'),
+            np.array(props[:, :, 1].T, dtype='double', order='C'),
+            np.array(props[:, :, 2].T, dtype='double', order='C')]
+
+    @property
+    def temperatures(self):
+        return self._temperatures
+
+    @property
+    def thermal_properties(self):
         return self._thermal_properties
 
+    def get_thermal_properties(self):
+        """Return [temperatures, free_energy, entropy, cv]"""
+        return self.thermal_properties
+
     def write_yaml(self, filename='thermal_properties'):
-        for i, tp in enumerate(self._thermal_properties):
-            tp.write_yaml(filename="%s-%02d.yaml" % (filename, i))
+        for i, V in enumerate(self._volumes):
+            tp = self._get_thermal_properties_at_V(V)
+            tp.write_yaml(filename="%s-%02d.yaml" % (filename, i), volume=V)
+
+    def _run_c_thermal_properties(self):
+        import phonopy._phonopy as phonoc
+
+        props = np.zeros((len(self._volumes), len(self._temperatures), 3),
+                         dtype='double', order='C')
+        phonoc.gruneisen_thermal_properties(
+            props,
+            np.array(self._volumes / self._V0, dtype='double', order='C'),
+            self._temperatures,
+            np.array(self._eigenvalues, dtype='double', order='C'),
+            np.array(self._gamma, dtype='double', order='C'),
+            np.array(self._weights, dtype='intc'),
+            self._factor * THzToEv,
+            self._cutoff_frequency)
+        props[:, :, 0] *= EvTokJmol
+        props[:, :, 1:] *= EvTokJmol * 1000
+        return props
+
+    def _run_py_thermal_properties(self):
+        props = np.zeros((len(self._volumes), len(self._temperatures), 3),
+                         dtype='double', order='C')
+        for i, V in enumerate(self._volumes):
+            tp = self._get_thermal_properties_at_V(V)
+            _, fe, entropy, cv = tp.thermal_properties
+            props[i, :, 0] = fe
+            props[i, :, 1] = entropy
+            props[i, :, 2] = cv
+        return props
 
     def _get_thermal_properties_at_V(self, V):
         frequencies = self._get_frequencies_at_V(V)
-        tp = ThermalProperties(frequencies,
-                               weights=self._weights,
+        tp = ThermalProperties(FrequenciesOnMesh(frequencies, self._weights),
                                cutoff_frequency=self._cutoff_frequency)
+        tp.set_temperatures(self._temperatures)
+        tp.run()
         return tp
 
     def _get_frequencies_at_V(self, V):
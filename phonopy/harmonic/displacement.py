@@ -91,12 +91,24 @@ def get_least_displacements(symmetry,
                              with respect to the axes.
 
     """
-    displacements = []
     if is_diagonal:
         directions = directions_diag
     else:
         directions = directions_axis
 
+    if log_level < 3:
+        try:
+            import phonopy._phonopy as phonoc
+            return _get_least_displacements_c(phonoc,
+                                              symmetry,
+                                              directions,
+                                              is_plusminus,
+                                              is_trigonal)
+        except ImportError:
+            pass
+
+    displacements = []
+
     if log_level > 2:
         print("Site point symmetry:")
 
@@ -127,6 +139,54 @@ def get_least_displacements(symmetry,
     return displacements
 
 
+def get_displacement_datasets(supercells,
+                              distance=0.01,
+                              is_plusminus='auto',
+                              is_diagonal=True,
+                              is_trigonal=False,
+                              symprec=1e-5):
+    """Return displacement datasets of many supercells
+
+    Symmetry of each supercell is searched once and displacements are
+    generated as done by Phonopy.generate_displacements.
+
+    Parameters
+    ----------
+    supercells : list of PhonopyAtoms
+        Supercells.
+    distance : float, optional
+        Displacement distance. Default is 0.01.
+    is_plusminus : 'auto', True, or False, optional
+        Plus-minus displacements. Default is 'auto'.
+    is_diagonal : bool, optional
+        Diagonal directions are allowed. Default is True.
+    is_trigonal : bool, optional
+        Trigonal axes are used. Default is False.
+    symprec : float, optional
+        Symmetry tolerance. Default is 1e-5.
+
+    Returns
+    -------
+    list of dict
+        Displacement datasets in the type-1 format.
+
+    """
+
+    from phonopy.structure.symmetry import Symmetry
+
+    datasets = []
+    for supercell in supercells:
+        symmetry = Symmetry(supercell, symprec=symprec)
+        directions = get_least_displacements(symmetry,
+                                             is_plusminus=is_plusminus,
+                                             is_diagonal=is_diagonal,
+                                             is_trigonal=is_trigonal)
+        datasets.append(directions_to_displacement_dataset(directions,
+                                                           distance,
+                                                           supercell))
+    return datasets
+
+
 def get_displacement(site_symmetry,
                      directions=directions_diag,
                      is_trigonal=False,
@@ -199,6 +259,39 @@ def get_displacement_two(site_symmetry,
     return None, None
 
 
+def _get_least_displacements_c(phonoc,
+                               symmetry,
+                               directions,
+                               is_plusminus,
+                               is_trigonal):
+    independent_atoms = symmetry.get_independent_atoms()
+    masks = np.array(symmetry.get_site_symmetry_masks(),
+                     dtype='intc', order='C')
+    rotations = np.array(symmetry.get_symmetry_operations()['rotations'],
+                         dtype='intc', order='C')
+    if is_plusminus == 'auto':
+        plusminus = 2
+    elif is_plusminus is True:
+        plusminus = 1
+    else:
+        plusminus = 0
+    disps = np.zeros((len(independent_atoms), 8, 3), dtype='intc')
+    num_disps = np.zeros(len(independent_atoms), dtype='intc')
+    phonoc.least_displacements(disps,
+                               num_disps,
+                               masks,
+                               rotations,
+                               np.array(directions, dtype='intc', order='C'),
+                               plusminus,
+                               int(is_trigonal))
+
+    displacements = []
+    for atom_num, d, n in zip(independent_atoms, disps, num_disps):
+        for disp in d[:n]:
+            displacements.append([int(atom_num)] + disp.tolist())
+    return displacements
+
+
 def is_minus_displacement(direction, site_symmetry):
     is_minus = True
     for r in site_symmetry:
@@ -34,6 +34,8 @@
 
 import sys
 from phonopy.harmonic.dynmat_to_fc import DynmatToForceConstants
+from phonopy.parallel import get_parallel_level_index
+from phonopy.profiling import stage
 import numpy as np
 
 
@@ -182,7 +184,77 @@ class DynamicalMatrix(object):
         return self.dynamical_matrix
 
     def set_dynamical_matrix(self, q):
-        self._set_dynamical_matrix(q)
+        with stage('dynamical_matrix'):
+            self._set_dynamical_matrix(q)
+
+    def get_dynamical_matrices(self, qpoints):
+        """Return dynamical matrices at q-points
+
+        Without NAC, dynamical matrices are computed in C in parallel over
+        q-points. The dynamical matrix stored by set_dynamical_matrix is
+        left unchanged.
+
+        Parameters
+        ----------
+        qpoints : array_like
+            q-points in reduced coordinates.
+            shape=(qpoints, 3), dtype='double'
+
+        Returns
+        -------
+        dynamical_matrices : ndarray
+            shape=(qpoints, primitive atoms * 3, primitive atoms * 3)
+            dtype='complex128'
+
+        """
+
+        try:
+            import phonopy._phonopy as phonoc
+            with stage('dynamical_matrix'):
+                dms = self._get_c_dynamical_matrices(qpoints)
+        except ImportError:
+            dms = self._get_dynamical_matrices_by_loop(qpoints)
+
+        if self._decimals is None:
+            return dms
+        else:
+            return dms.round(decimals=self._decimals)
+
+    def _get_dynamical_matrices_by_loop(self, qpoints):
+        dm_orig = self._dynamical_matrix
+        dms = []
+        for q in qpoints:
+            self.set_dynamical_matrix(q)
+            dms.append(self._dynamical_matrix)
+        self._dynamical_matrix = dm_orig
+        return np.array(dms, dtype=self._dtype_complex, order='C').reshape(
+            (len(dms), ) + (len(self._p2s_map) * 3, ) * 2)
+
+    def _get_c_dynamical_matrices(self, qpoints):
+        import phonopy._phonopy as phonoc
+
+        fc = self._force_constants
+        qpoints = np.array(qpoints, dtype='double', order='C').reshape(-1, 3)
+        size_prim = len(self._p2s_map)
+        dms = np.zeros((len(qpoints), size_prim * 3, size_prim * 3),
+                       dtype=self._dtype_complex)
+        if fc.shape[0] == fc.shape[1]:  # full FC
+            s2p_map = self._s2p_map
+            p2s_map = self._p2s_map
+        else:
+            s2p_map = self._s2pp_map
+            p2s_map = np.arange(len(self._p2s_map), dtype='intc')
+        phonoc.dynamical_matrices(
+            dms.view(dtype='double'),
+            fc,
+            qpoints,
+            self._smallest_vectors,
+            self._multiplicity,
+            self._pcell.get_masses(),
+            s2p_map,
+            p2s_map,
+            get_parallel_level_index('dynamical_matrices'))
+        return dms
 
     def _set_dynamical_matrix(self, q):
         try:
@@ -210,6 +282,7 @@ class DynamicalMatrix(object):
         multiplicity = self._multiplicity
         size_prim = len(mass)
         itemsize = self._force_constants.itemsize
+        with_openmp = 1 - get_parallel_level_index('dynamical_matrix')
         dm = np.zeros((size_prim * 3, size_prim * 3),
                       dtype=("c%d" % (itemsize * 2)))
 
@@ -221,7 +294,8 @@ class DynamicalMatrix(object):
                                     multiplicity,
                                     mass,
                                     self._s2p_map,
-                                    self._p2s_map)
+                                    self._p2s_map,
+                                    with_openmp)
         else:
             phonoc.dynamical_matrix(
                 dm.view(dtype='double'),
@@ -231,7 +305,8 @@ class DynamicalMatrix(object):
                 multiplicity,
                 mass,
                 self._s2pp_map,
-                np.arange(len(self._p2s_map), dtype='intc'))
+                np.arange(len(self._p2s_map), dtype='intc'),
+                with_openmp)
 
         # Data of dm array are stored in memory by the C order of
         # (size_prim * 3, size_prim * 3, 2), where the last 2 means
@@ -379,23 +454,38 @@ class DynamicalMatrixNAC(DynamicalMatrix):
         self._set_Gonze_force_constants()
         self._Gonze_count = 0
 
-    def set_dynamical_matrix(self, q_red, q_direction=None):
-        rec_lat = np.linalg.inv(self._pcell.get_cell())  # column vectors
-        if q_direction is None:
-            q_norm = np.linalg.norm(np.dot(q_red, rec_lat.T))
-        else:
-            q_norm = np.linalg.norm(np.dot(q_direction, rec_lat.T))
+    def get_dynamical_matrices(self, qpoints):
+        """Return dynamical matrices with NAC at q-points
 
-        if q_norm < self._symprec:
-            self._set_dynamical_matrix(q_red)
-            return False
+        NAC depends on q-point, so dynamical matrices are computed one by
+        one. See DynamicalMatrix.get_dynamical_matrices.
+
+        """
 
-        if self._method == 'wang':
-            self._set_Wang_dynamical_matrix(q_red, q_direction)
+        dms = self._get_dynamical_matrices_by_loop(qpoints)
+        if self._decimals is None:
+            return dms
         else:
-            if self._Gonze_force_constants is None:
-                self.make_Gonze_nac_dataset(self._log_level)
-            self._set_Gonze_dynamical_matrix(q_red, q_direction)
+            return dms.round(decimals=self._decimals)
+
+    def set_dynamical_matrix(self, q_red, q_direction=None):
+        with stage('dynamical_matrix'):
+            rec_lat = np.linalg.inv(self._pcell.get_cell())  # column vectors
+            if q_direction is None:
+                q_norm = np.linalg.norm(np.dot(q_red, rec_lat.T))
+            else:
+                q_norm = np.linalg.norm(np.dot(q_direction, rec_lat.T))
+
+            if q_norm < self._symprec:
+                self._set_dynamical_matrix(q_red)
+                return False
+
+            if self._method == 'wang':
+                self._set_Wang_dynamical_matrix(q_red, q_direction)
+            else:
+                if self._Gonze_force_constants is None:
+                    self.make_Gonze_nac_dataset(self._log_level)
+                self._set_Gonze_dynamical_matrix(q_red, q_direction)
 
     def _set_Wang_dynamical_matrix(self, q_red, q_direction):
         # Wang method (J. Phys.: Condens. Matter 22 (2010) 202201)
@@ -429,6 +519,7 @@ class DynamicalMatrixNAC(DynamicalMatrix):
         multiplicity = self._multiplicity
         size_prim = len(mass)
         itemsize = fc.itemsize
+        with_openmp = 1 - get_parallel_level_index('dynamical_matrix')
         dm = np.zeros((size_prim * 3, size_prim * 3),
                       dtype=("c%d" % (itemsize * 2)))
 
@@ -443,7 +534,8 @@ class DynamicalMatrixNAC(DynamicalMatrix):
                                         self._p2s_map,
                                         np.array(q, dtype='double'),
                                         self._born,
-                                        factor)
+                                        factor,
+                                        with_openmp)
         else:
             phonoc.nac_dynamical_matrix(dm.view(dtype='double'),
                                         fc,
@@ -456,7 +548,8 @@ class DynamicalMatrixNAC(DynamicalMatrix):
                                                   dtype='intc'),
                                         np.array(q, dtype='double'),
                                         self._born,
-                                        factor)
+                                        factor,
+                                        with_openmp)
 
         self._dynamical_matrix = dm
 
@@ -516,7 +609,8 @@ class DynamicalMatrixNAC(DynamicalMatrix):
 
         try:
             import phonopy._phonopy as phonoc
-            C = self._get_c_dipole_dipole(q_cart, q_dir_cart)
+            with stage('dipole_dipole'):
+                C = self._get_c_dipole_dipole(q_cart, q_dir_cart)
         except ImportError:
             print("Python version of dipole-dipole calculation is not well "
                   "implemented.")
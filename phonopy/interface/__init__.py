@@ -110,6 +110,55 @@ def write_supercells_with_displacements(interface_mode,
         write_supercells_with_displacements(supercell, cells_with_disps)
 
 
+def write_crystal_structure(filename,
+                            cell,
+                            interface_mode=None,
+                            optional_structure_info=None):
+    """Write a crystal structure in the format of a calculator interface
+
+    optional_structure_info is the second return value of
+    read_crystal_structure, which is required for qe, elk, siesta, and
+    crystal. For crystal, the conventional atomic numbers have to be
+    given for all atoms of cell.
+
+    """
+
+    if interface_mode is None or interface_mode == 'vasp':
+        from phonopy.interface.vasp import write_vasp
+        write_vasp(filename, cell, direct=True)
+    elif interface_mode == 'abinit':
+        from phonopy.interface.abinit import write_abinit
+        write_abinit(filename, cell)
+    elif interface_mode == 'qe':
+        from phonopy.interface.qe import write_pwscf
+        write_pwscf(filename, cell, optional_structure_info[1])
+    elif interface_mode == 'elk':
+        from phonopy.interface.elk import write_elk
+        write_elk(filename, cell, optional_structure_info[1])
+    elif interface_mode == 'siesta':
+        from phonopy.interface.siesta import write_siesta
+        write_siesta(filename, cell, optional_structure_info[1])
+    elif interface_mode == 'cp2k':
+        from phonopy.interface.cp2k import write_cp2k
+        write_cp2k(filename, cell)
+    elif interface_mode == 'crystal':
+        from phonopy.interface.crystal import write_crystal
+        if len(optional_structure_info[1]) != cell.get_number_of_atoms():
+            raise RuntimeError("Numbers of conventional atomic numbers and "
+                               "atoms are different.")
+        write_crystal(filename, cell, optional_structure_info[1],
+                      template_file="TEMPLATE")
+    elif interface_mode == 'dftbp':
+        from phonopy.interface.dftbp import write_dftbp
+        write_dftbp(filename, cell)
+    elif interface_mode == 'turbomole':
+        from phonopy.interface.turbomole import write_turbomole
+        write_turbomole(filename, cell)
+    else:
+        raise RuntimeError("Writing a crystal structure of %s is not "
+                           "supported." % interface_mode)
+
+
 def read_crystal_structure(filename=None,
                            interface_mode=None,
                            chemical_symbols=None,
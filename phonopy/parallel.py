@@ -0,0 +1,278 @@
+# Copyright (C) 2026 Atsushi Togo
+# All rights reserved.
+#
+# This file is part of phonopy.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# * Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in
+#   the documentation and/or other materials provided with the
+#   distribution.
+#
+# * Neither the name of the phonopy project nor the names of its
+#   contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+# ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+import os
+import threading
+from contextlib import contextmanager
+
+# Choices of parallel granularity of C kernels. The first one is default.
+# dynamical_matrices: over q-points or over atom pairs at each q-point.
+# dynamical_matrix: over atom pairs or serial (single q-point).
+parallel_levels = {'dynamical_matrices': ('qpoints', 'atom_pairs'),
+                   'dynamical_matrix': ('atom_pairs', 'serial')}
+
+# Sharing threads between worker pools (num_workers) and the OpenMP and
+# BLAS threads used inside of each worker.
+# none: Nothing is controlled.
+# split: Threads are divided equally among workers.
+# serial: Each worker runs kernels and BLAS by one thread.
+nested_policies = ('none', 'split', 'serial')
+
+proc_bind_names = {-1: None, 0: 'false', 1: 'true', 2: 'master', 3: 'close',
+                   4: 'spread'}
+
+_parallel_levels = dict((k, v[0]) for k, v in parallel_levels.items())
+_nested_policy = 'none'
+_cpus = None
+
+
+def get_num_threads():
+    """Return number of OpenMP threads used by C kernels
+
+    This is the number for the calling thread. One is returned when
+    phonopy is built without OpenMP.
+
+    """
+
+    try:
+        import phonopy._phonopy as phonoc
+        return phonoc.omp_max_threads()
+    except ImportError:
+        return 1
+
+
+def set_num_threads(num_threads):
+    """Set number of OpenMP threads used by C kernels
+
+    The setting applies to the calling thread, i.e., threads in worker
+    pools of phonopy follow the nested policy, not this number. Nothing
+    is done when phonopy is built without OpenMP.
+
+    """
+
+    if int(num_threads) < 1:
+        raise ValueError("Number of threads has to be positive.")
+
+    try:
+        import phonopy._phonopy as phonoc
+        phonoc.set_omp_num_threads(int(num_threads))
+    except ImportError:
+        pass
+
+
+def get_parallel_level(kernel):
+    """Return parallel granularity of C kernel
+
+    Parameters
+    ----------
+    kernel : str
+        One of keys of phonopy.parallel.parallel_levels.
+
+    """
+
+    _check_kernel(kernel)
+    return _parallel_levels[kernel]
+
+
+def set_parallel_level(kernel, level):
+    """Set parallel granularity of C kernel
+
+    Parameters
+    ----------
+    kernel : str
+        One of keys of phonopy.parallel.parallel_levels.
+    level : str
+        One of phonopy.parallel.parallel_levels[kernel].
+
+    """
+
+    _check_kernel(kernel)
+    if level not in parallel_levels[kernel]:
+        raise ValueError("Parallel level of %s has to be one of %s."
+                         % (kernel, ", ".join(parallel_levels[kernel])))
+    _parallel_levels[kernel] = level
+
+
+def get_parallel_level_index(kernel):
+    """Return parallel granularity of C kernel as integer passed to C"""
+
+    return parallel_levels[kernel].index(get_parallel_level(kernel))
+
+
+def get_nested_policy():
+    return _nested_policy
+
+
+def set_nested_policy(policy):
+    """Set how threads are shared among workers of worker pools
+
+    Parameters
+    ----------
+    policy : str
+        'none', 'split', or 'serial'. With 'split', each of N workers uses
+        get_num_threads() // N OpenMP threads. BLAS threads are limited
+        similarly when threadpoolctl is installed.
+
+    """
+
+    global _nested_policy
+    if policy not in nested_policies:
+        raise ValueError("Nested policy has to be one of %s."
+                         % ", ".join(nested_policies))
+    _nested_policy = policy
+
+
+def get_cpu_affinity():
+    """Return CPUs of calling thread, or None if it is not supported"""
+
+    if _cpus is not None:
+        return list(_cpus)
+    elif hasattr(os, 'sched_getaffinity'):
+        return sorted(os.sched_getaffinity(0))
+    else:
+        return None
+
+
+def set_cpu_affinity(cpus):
+    """Pin calling thread and threads created afterwards to CPUs
+
+    OpenMP threads inherit CPUs when they are created, i.e., this should
+    be called before the first call of a C kernel. For finer binding of
+    OpenMP threads, OMP_PROC_BIND and OMP_PLACES have to be set before
+    starting python. Unless the nested policy is 'none', workers of
+    worker pools are pinned to disjoint subsets of CPUs.
+
+    Parameters
+    ----------
+    cpus : list of int or None
+        CPU indices. None unsets pinning of workers.
+
+    """
+
+    global _cpus
+    if cpus is None:
+        _cpus = None
+        return
+    if not hasattr(os, 'sched_setaffinity'):
+        raise RuntimeError("CPU affinity is not supported on this system.")
+    os.sched_setaffinity(0, cpus)
+    _cpus = sorted(cpus)
+
+
+def get_proc_bind():
+    """Return OMP_PROC_BIND policy of OpenMP runtime"""
+
+    try:
+        import phonopy._phonopy as phonoc
+        return proc_bind_names.get(phonoc.omp_proc_bind())
+    except ImportError:
+        return None
+
+
+def get_parallel_options():
+    """Return current settings as a dict"""
+
+    return {'num_threads': get_num_threads(),
+            'parallel_levels': dict(_parallel_levels),
+            'nested_policy': _nested_policy,
+            'cpu_affinity': get_cpu_affinity(),
+            'proc_bind': get_proc_bind()}
+
+
+def get_worker_num_threads(num_workers):
+    """Return number of threads of each worker by nested policy
+
+    None is returned with the nested policy 'none'.
+
+    """
+
+    if _nested_policy == 'split':
+        return max(1, get_num_threads() // num_workers)
+    elif _nested_policy == 'serial':
+        return 1
+    else:
+        return None
+
+
+@contextmanager
+def thread_pool(num_workers):
+    """ThreadPoolExecutor whose workers follow the nested policy
+
+    Each worker sets its number of OpenMP threads and is pinned to a
+    subset of CPUs when set_cpu_affinity is used. BLAS threads are
+    limited during the pool when threadpoolctl is installed.
+
+    """
+
+    from concurrent.futures import ThreadPoolExecutor
+
+    num_threads = get_worker_num_threads(num_workers)
+    if num_threads is None:
+        with ThreadPoolExecutor(max_workers=num_workers) as executor:
+            yield executor
+        return
+
+    lock = threading.Lock()
+    counter = [0]
+    cpus = _cpus
+
+    def initializer():
+        with lock:
+            i = counter[0]
+            counter[0] += 1
+        set_num_threads(num_threads)
+        if cpus is not None:
+            n = max(1, len(cpus) // num_workers)
+            start = (i * n) % len(cpus)
+            os.sched_setaffinity(0, cpus[start:start + n])
+
+    try:
+        from threadpoolctl import threadpool_limits
+        blas_limits = threadpool_limits(limits=num_threads, user_api='blas')
+    except ImportError:
+        blas_limits = None
+
+    try:
+        with ThreadPoolExecutor(max_workers=num_workers,
+                                initializer=initializer) as executor:
+            yield executor
+    finally:
+        if blas_limits is not None:
+            blas_limits.restore_original_limits()
+
+
+def _check_kernel(kernel):
+    if kernel not in parallel_levels:
+        raise ValueError("Kernel has to be one of %s."
+                         % ", ".join(parallel_levels))
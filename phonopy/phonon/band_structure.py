@@ -35,27 +35,76 @@
 import warnings
 import numpy as np
 from phonopy.units import VaspToTHz
+from phonopy.profiling import stage
 
 
 def estimate_band_connection(prev_eigvecs, eigvecs, prev_band_order):
     metric = np.abs(np.dot(prev_eigvecs.conjugate().T, eigvecs))
-    connection_order = []
-    for overlaps in metric:
-        maxval = 0
-        for i in reversed(range(len(metric))):
-            val = overlaps[i]
-            if i in connection_order:
-                continue
-            if val > maxval:
-                maxval = val
-                maxindex = i
-        connection_order.append(maxindex)
-
+    connection_order = _get_connection_orders(metric[None, :, :])[0]
     band_order = [connection_order[x] for x in prev_band_order]
 
     return band_order
 
 
+def get_band_connections(eigvecs, chunk_size=16):
+    """Return band orders along a sequence of q-points
+
+    Each band of the previous q-point is connected to the band of the
+    current q-point having the largest overlap of eigenvectors among
+    those not yet connected.
+
+    Parameters
+    ----------
+    eigvecs : ndarray
+        Eigenvectors at q-points on a path. See np.linalg.eigh.
+        shape=(qpoints, bands, bands), dtype='complex128'
+    chunk_size : int, optional
+        Number of neighboring pairs of q-points whose overlaps are held at
+        once. Default is 16.
+
+    Returns
+    -------
+    band_orders : ndarray
+        Band indices of eigenvalues and eigenvectors at each q-point
+        ordered by the connection from the first q-point.
+        shape=(qpoints, bands), dtype='intc'
+
+    """
+
+    num_qpoints, _, num_band = eigvecs.shape
+    connections = np.zeros((max(num_qpoints - 1, 0), num_band), dtype='intc')
+    for i in range(0, num_qpoints - 1, chunk_size):
+        j = min(i + chunk_size, num_qpoints - 1)
+        overlaps = np.abs(np.matmul(
+            eigvecs[i:j].conj().transpose(0, 2, 1), eigvecs[(i + 1):(j + 1)]))
+        connections[i:j] = _get_connection_orders(overlaps)
+
+    band_orders = np.zeros((num_qpoints, num_band), dtype='intc')
+    if num_qpoints > 0:
+        band_orders[0] = np.arange(num_band)
+    for i, connection in enumerate(connections):
+        band_orders[i + 1] = connection[band_orders[i]]
+    return band_orders
+
+
+def _get_connection_orders(overlaps):
+    overlaps = np.array(overlaps, dtype='double', order='C')
+    connections = np.zeros(overlaps.shape[:2], dtype='intc')
+    try:
+        import phonopy._phonopy as phonoc
+        phonoc.band_connections(connections, overlaps)
+    except ImportError:
+        num_band = overlaps.shape[1]
+        for metric, connection in zip(overlaps, connections):
+            is_assigned = np.zeros(num_band, dtype=bool)
+            for i, row in enumerate(metric):
+                # Larger index is taken among equal overlaps.
+                vals = np.where(is_assigned, -1, row)[::-1]
+                connection[i] = num_band - 1 - np.argmax(vals)
+                is_assigned[connection[i]] = True
+    return connections
+
+
 def get_band_qpoints_and_path_connections(band_paths, npoints=51,
                                           rec_lattice=None):
     path_connections = []
@@ -274,7 +323,10 @@ class BandStructure(object):
                  path_connections=None,
                  labels=None,
                  is_legacy_plot=False,
-                 factor=VaspToTHz):
+                 factor=VaspToTHz,
+                 adaptive_tolerance=None,
+                 adaptive_max_level=5,
+                 adaptive_min_overlap=0.9):
         """
 
         Parameters
@@ -304,6 +356,21 @@ class BandStructure(object):
             to (2 - np.array(path_connections)).sum().
         is_legacy_plot: bool, optional
             This makes the old style band structure plot. Default is False.
+        adaptive_tolerance : float, optional
+            When given, q-points of each path are taken as the initial coarse
+            sampling, and an interval between neighboring q-points is
+            bisected recursively while the error of linear interpolation of
+            frequencies in THz estimated from curvature, or from change of
+            group velocities when group_velocity is given, exceeds this
+            value. With is_band_connection, an interval is also bisected when
+            overlap of eigenvectors of a non-degenerate band with those of
+            the next point is smaller than adaptive_min_overlap. Refined
+            q-points are returned by qpoints. Default is None.
+        adaptive_max_level : int, optional
+            Maximum number of bisections of each initial interval. Default
+            is 5.
+        adaptive_min_overlap : float, optional
+            See adaptive_tolerance. Default is 0.9.
 
         """
 
@@ -316,6 +383,9 @@ class BandStructure(object):
         if is_band_connection:
             self._with_eigenvectors = True
         self._group_velocity = group_velocity
+        self._adaptive_tolerance = adaptive_tolerance
+        self._adaptive_max_level = adaptive_max_level
+        self._adaptive_min_overlap = adaptive_min_overlap
 
         self._paths = [np.array(path) for path in paths]
         self._is_legacy_plot = is_legacy_plot
@@ -483,18 +553,37 @@ class BandStructure(object):
         ax.axhline(y=0, linestyle=':', linewidth=0.5, color='b')
 
     def write_hdf5(self, comment=None, filename="band.hdf5"):
+        """Write band structure in hdf5 format
+
+        Numbers of q-points of paths are stored in 'segment_nqpoint'. When
+        they are all the same, datasets have the axis of paths first. When
+        they are different, e.g., after adaptive refinement, datasets of
+        paths are concatenated along the axis of q-points.
+
+        """
+
         import h5py
+        segment_nqpoint = np.array([len(path) for path in self._paths],
+                                   dtype='intc')
+        if (segment_nqpoint == segment_nqpoint[0]).all():
+            _join = np.array
+        else:
+            _join = np.concatenate
         with h5py.File(filename, 'w') as w:
-            w.create_dataset('path', data=self._paths)
-            w.create_dataset('distance', data=self._distances)
-            w.create_dataset('frequency', data=self._frequencies)
+            w.create_dataset('segment_nqpoint', data=segment_nqpoint)
+            w.create_dataset('path', data=_join(self._paths))
+            w.create_dataset('distance', data=_join(self._distances))
+            w.create_dataset('frequency', data=_join(self._frequencies))
             if self._eigenvectors is not None:
-                w.create_dataset('eigenvector', data=self._eigenvectors)
+                w.create_dataset('eigenvector',
+                                 data=_join(self._eigenvectors))
             if self._group_velocities is not None:
-                w.create_dataset('group_velocity', data=self._group_velocities)
+                w.create_dataset('group_velocity',
+                                 data=_join(self._group_velocities))
             if comment:
                 for key in comment:
-                    if key not in ('path',
+                    if key not in ('segment_nqpoint',
+                                   'path',
                                    'distance',
                                    'frequency',
                                    'eigenvector',
@@ -628,13 +717,19 @@ class BandStructure(object):
         group_velocities = []
         distances = []
 
-        for path in self._paths:
+        for i, path in enumerate(self._paths):
+            if self._adaptive_tolerance is None:
+                solution = self._solve_phonons(path, path[0] - path[-1])
+            else:
+                path, solution = self._solve_phonons_adaptively(path)
+                self._paths[i] = path
+
             self._set_initial_point(path[0])
 
             (distances_on_path,
              eigvals_on_path,
              eigvecs_on_path,
-             gv_on_path) = self._solve_dm_on_path(path)
+             gv_on_path) = self._solve_dm_on_path(path, *solution)
 
             eigvals.append(np.array(eigvals_on_path))
             if self._with_eigenvectors:
@@ -653,58 +748,167 @@ class BandStructure(object):
 
         self._set_frequencies()
 
-    def _solve_dm_on_path(self, path):
-        is_nac = self._dynamical_matrix.is_nac()
+    def _solve_dm_on_path(self, path, eigvals_on_path, eigvecs_on_path,
+                          gv_on_path):
+        """Set distances and connect bands of phonons solved on a path"""
+
         distances_on_path = []
-        eigvals_on_path = []
-        eigvecs_on_path = []
-        gv_on_path = []
+        for q in path:
+            self._shift_point(q)
+            distances_on_path.append(self._distance)
 
+        if self._is_band_connection:
+            band_orders = get_band_connections(eigvecs_on_path)
+            q_indices = np.arange(len(path))[:, None]
+            eigvals_on_path = eigvals_on_path[q_indices, band_orders]
+            eigvecs_on_path = eigvecs_on_path[
+                q_indices, :, band_orders].transpose(0, 2, 1)
+            if gv_on_path is not None:
+                gv_on_path = gv_on_path[q_indices, band_orders]
+
+        if not self._with_eigenvectors:
+            eigvecs_on_path = None
+
+        return distances_on_path, eigvals_on_path, eigvecs_on_path, gv_on_path
+
+    def _solve_phonons(self, qpoints, q_direction):
+        """Solve phonons at all q-points at once
+
+        q_direction is used for NAC at Gamma point.
+
+        """
+
+        dms = self._get_dynamical_matrices(qpoints, q_direction)
+        with stage('eigh'):
+            if self._with_eigenvectors or self._group_velocity is not None:
+                eigvals, eigvecs = np.linalg.eigh(dms)
+            else:
+                eigvals = np.linalg.eigvalsh(dms)
+                eigvecs = None
+        eigvals = eigvals.real
+
+        gv = None
         if self._group_velocity is not None:
-            self._group_velocity.set_q_points(path)
+            if self._dynamical_matrix.is_nac():
+                # Dynamical matrices at Gamma differ by q-direction.
+                self._group_velocity.set_q_points(qpoints)
+            else:
+                self._group_velocity.set_q_points(
+                    qpoints, eigenvalues=eigvals, eigenvectors=eigvecs)
             gv = self._group_velocity.get_group_velocity()
 
-        for i, q in enumerate(path):
-            self._shift_point(q)
-            distances_on_path.append(self._distance)
+        return eigvals, eigvecs, gv
 
-            if is_nac:
-                q_direction = None
-                if (np.abs(q) < 0.0001).all():  # For Gamma point
-                    q_direction = path[0] - path[-1]
+    def _get_dynamical_matrices(self, qpoints, q_direction):
+        if not self._dynamical_matrix.is_nac():
+            return self._dynamical_matrix.get_dynamical_matrices(qpoints)
+
+        dms = []
+        for q in qpoints:
+            if (np.abs(q) < 0.0001).all():  # For Gamma point
                 self._dynamical_matrix.set_dynamical_matrix(
                     q, q_direction=q_direction)
             else:
                 self._dynamical_matrix.set_dynamical_matrix(q)
-            dm = self._dynamical_matrix.get_dynamical_matrix()
+            dms.append(self._dynamical_matrix.get_dynamical_matrix())
+        return np.array(dms)
 
-            if self._with_eigenvectors:
-                eigvals, eigvecs = np.linalg.eigh(dm)
-                eigvals = eigvals.real
-            else:
-                eigvals = np.linalg.eigvalsh(dm).real
+    def _solve_phonons_adaptively(self, path):
+        """Bisect intervals of path recursively
 
-            if self._is_band_connection:
-                if i == 0:
-                    band_order = range(len(eigvals))
-                else:
-                    band_order = estimate_band_connection(prev_eigvecs,
-                                                          eigvecs,
-                                                          band_order)
-                eigvals_on_path.append(eigvals[band_order])
-                eigvecs_on_path.append((eigvecs.T)[band_order].T)
-
-                if self._group_velocity is not None:
-                    gv_on_path.append(gv[i][band_order])
-                prev_eigvecs = eigvecs
-            else:
-                eigvals_on_path.append(eigvals)
-                if self._with_eigenvectors:
-                    eigvecs_on_path.append(eigvecs)
-                if self._group_velocity is not None:
-                    gv_on_path.append(gv[i])
+        Phonons are solved only at new q-points at each level.
 
-        return distances_on_path, eigvals_on_path, eigvecs_on_path, gv_on_path
+        Returns
+        -------
+        qpoints : ndarray
+            Refined q-points on the path.
+        solution : tuple
+            Eigenvalues, eigenvectors (or None), and group velocities (or
+            None) at the q-points.
+
+        """
+
+        q_direction = path[0] - path[-1]
+        qpoints = np.array(path, dtype='double')
+        solution = list(self._solve_phonons(qpoints, q_direction))
+        levels = np.zeros(len(qpoints) - 1, dtype=int)
+
+        while True:
+            refine = np.logical_and(
+                self._get_intervals_to_refine(qpoints, *solution),
+                levels < self._adaptive_max_level)
+            if not refine.any():
+                break
+            (indices, ) = np.nonzero(refine)
+            new_qpoints = (qpoints[indices] + qpoints[indices + 1]) / 2
+            new_solution = self._solve_phonons(new_qpoints, q_direction)
+            qpoints = np.insert(qpoints, indices + 1, new_qpoints, axis=0)
+            for i, vals in enumerate(new_solution):
+                if vals is not None:
+                    solution[i] = np.insert(solution[i], indices + 1, vals,
+                                            axis=0)
+            levels[indices] += 1
+            levels = np.insert(levels, indices + 1, levels[indices])
+
+        return qpoints, solution
+
+    def _get_intervals_to_refine(self, qpoints, eigvals, eigvecs, gv):
+        """Return flags of intervals between neighboring q-points to bisect
+
+        Error of linear interpolation of frequencies in an interval of
+        length h is estimated by |f''| h^2 / 8 with the second divided
+        differences at both ends, and by |v_b - v_a| h / 8 with group
+        velocities v along the path. In THz Angstrom, v is the derivative
+        of frequency by the distance used for band structure plot.
+
+        """
+
+        freqs = np.sqrt(abs(eigvals)) * np.sign(eigvals) * self._factor
+        rec_lat = np.linalg.inv(self._cell.get_cell())
+        dq = np.dot(np.diff(qpoints, axis=0), rec_lat.T)
+        h = np.sqrt((dq ** 2).sum(axis=1))
+        refine = np.zeros(len(h), dtype=bool)
+        is_finite = h > 1e-8
+        h_safe = np.where(is_finite, h, 1)
+
+        if len(qpoints) > 2:
+            slopes = np.diff(freqs, axis=0) / h_safe[:, None]
+            curvatures = np.zeros(len(qpoints), dtype='double')
+            curvatures[1:-1] = np.abs(
+                2 * np.diff(slopes, axis=0) /
+                (h_safe[:-1] + h_safe[1:])[:, None]).max(axis=1)
+            errors = np.maximum(curvatures[:-1], curvatures[1:]) * h ** 2 / 8
+            refine |= errors > self._adaptive_tolerance
+
+        if gv is not None:
+            directions = dq / h_safe[:, None]
+            dv = (np.einsum('ibj,ij->ib', gv[1:], directions) -
+                  np.einsum('ibj,ij->ib', gv[:-1], directions))
+            errors = np.abs(dv).max(axis=1) * h / 8
+            refine |= errors > self._adaptive_tolerance
+
+        if self._is_band_connection:
+            overlaps = np.abs(np.matmul(eigvecs[:-1].conj().transpose(0, 2, 1),
+                                        eigvecs[1:])) ** 2
+            for i, overlap in enumerate(overlaps):
+                if refine[i]:
+                    continue
+                refine[i] = self._is_poorly_connected(overlap,
+                                                      freqs[i],
+                                                      freqs[i + 1])
+
+        return np.logical_and(refine, is_finite)
+
+    def _is_poorly_connected(self, overlap, freqs_a, freqs_b):
+        """Weights of non-degenerate bands at a on degenerate sets at b"""
+
+        from phonopy.phonon.degeneracy import degenerate_sets
+
+        deg_sets_a = degenerate_sets(freqs_a)
+        non_deg = [deg[0] for deg in deg_sets_a if len(deg) == 1]
+        weights = np.array([overlap[non_deg][:, deg].sum(axis=1)
+                            for deg in degenerate_sets(freqs_b)])
+        return (weights.max(axis=0) < self._adaptive_min_overlap ** 2).any()
 
     def _set_frequencies(self):
         frequencies = []
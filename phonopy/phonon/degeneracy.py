@@ -76,29 +76,82 @@ def get_eigenvectors(q,
     return eigvals, rot_eigvecs
 
 
-def rotate_eigenvectors(eigvals, eigvecs, dD):
+def rotate_eigenvectors(eigvals, eigvecs, dD, cutoff=1e-4):
     rot_eigvecs = np.zeros_like(eigvecs)
     eigvals_dD = np.zeros_like(eigvals)
-    for deg in degenerate_sets(eigvals):
+    for deg in degenerate_sets(eigvals, cutoff=cutoff):
         dD_part = np.dot(eigvecs[:, deg].T.conj(), np.dot(dD, eigvecs[:, deg]))
         eigvals_dD[deg], eigvecs_dD = np.linalg.eigh(dD_part)
         rot_eigvecs[:, deg] = np.dot(eigvecs[:, deg], eigvecs_dD)
     return rot_eigvecs, eigvals_dD
 
 
+def rotate_eigenvectors_at_qpoints(eigvals, eigvecs, dDs, cutoff=1e-4):
+    """Diagonalize perturbations in degenerate subspaces at q-points
+
+    This is rotate_eigenvectors applied to a set of q-points. In C,
+    q-points are processed in parallel.
+
+    Parameters
+    ----------
+    eigvals : array_like
+        Eigenvalues in ascending order at q-points.
+        shape=(qpoints, bands), dtype='double'
+    eigvecs : array_like
+        Eigenvectors as columns at q-points.
+        shape=(qpoints, bands, bands), dtype='complex128'
+    dDs : array_like
+        Perturbations of dynamical matrices at q-points.
+        shape=(qpoints, bands, bands), dtype='complex128'
+    cutoff : float, optional
+        Eigenvalues whose neighbors differ less than this value are
+        treated as degenerate. Default is 1e-4.
+
+    Returns
+    -------
+    rot_eigvecs : ndarray
+        Rotated eigenvectors.
+        shape=(qpoints, bands, bands), dtype='complex128'
+    eigvals_dD : ndarray
+        Eigenvalues of perturbations in degenerate subspaces, i.e.,
+        first-order shifts of eigenvalues.
+        shape=(qpoints, bands), dtype='double'
+
+    """
+
+    dtype_complex = "c%d" % (np.dtype('double').itemsize * 2)
+    eigvals = np.array(eigvals, dtype='double', order='C')
+    eigvecs = np.array(eigvecs, dtype=dtype_complex, order='C')
+    dDs = np.array(dDs, dtype=dtype_complex, order='C')
+    rot_eigvecs = np.zeros_like(eigvecs)
+    eigvals_dD = np.zeros_like(eigvals)
+
+    try:
+        import phonopy._phonopy as phonoc
+        phonoc.rotate_eigenvectors(rot_eigvecs.view(dtype='double'),
+                                   eigvals_dD,
+                                   eigvals,
+                                   eigvecs.view(dtype='double'),
+                                   dDs.view(dtype='double'),
+                                   cutoff)
+    except ImportError:
+        for i, (vals, vecs, dD) in enumerate(zip(eigvals, eigvecs, dDs)):
+            rot_eigvecs[i], eigvals_dD[i] = rotate_eigenvectors(
+                vals, vecs, dD, cutoff=cutoff)
+
+    return rot_eigvecs, eigvals_dD
+
+
 def _get_dD(q, ddm, perturbation):
     ddm.run(q)
     ddm_vals = ddm.get_derivative_of_dynamical_matrix()
-    dD = np.zeros(ddm_vals.shape[1:], dtype=ddm_vals.dtype, order='C')
+    p = np.array(perturbation, dtype='double')
     if len(ddm_vals) == 3:
-        for i in range(3):
-            dD += perturbation[i] * ddm_vals[i]
-        return dD / np.linalg.norm(perturbation)
+        dD = np.tensordot(p, ddm_vals, axes=(0, 0))
+        return dD / np.linalg.norm(p)
     else:
-        dD += perturbation[0] * perturbation[0] * ddm_vals[0]
-        dD += perturbation[1] * perturbation[1] * ddm_vals[1]
-        dD += perturbation[2] * perturbation[2] * ddm_vals[2]
-        dD += 2 * perturbation[0] * perturbation[1] * ddm_vals[5]
-        dD += 2 * perturbation[0] * perturbation[2] * ddm_vals[4]
-        dD += 2 * perturbation[1] * perturbation[2] * ddm_vals[3]
-        return dD / np.linalg.norm(perturbation) ** 2
+        # Order of second derivatives: xx, yy, zz, yz, xz, xy
+        weights = [p[0] * p[0], p[1] * p[1], p[2] * p[2],
+                   2 * p[1] * p[2], 2 * p[0] * p[2], 2 * p[0] * p[1]]
+        dD = np.tensordot(weights, ddm_vals, axes=(0, 0))
+        return dD / np.linalg.norm(p) ** 2
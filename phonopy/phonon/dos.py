@@ -36,6 +36,7 @@ import sys
 import numpy as np
 from phonopy.phonon.tetrahedron_mesh import TetrahedronMesh
 from phonopy.structure.tetrahedron_method import TetrahedronMethod
+from phonopy.profiling import stage
 
 
 def get_pdos_indices(symmetry):
@@ -198,14 +199,15 @@ def run_tetrahedron_method_dos(mesh,
     arr_shape = frequencies.shape + (len(frequency_points), _coef.shape[1])
     dos = np.zeros(arr_shape, dtype='double')
 
-    phonoc.tetrahedron_method_dos(dos,
-                                  mesh,
-                                  frequency_points,
-                                  frequencies,
-                                  _coef,
-                                  grid_address,
-                                  grid_mapping_table,
-                                  relative_grid_address)
+    with stage('tetrahedron_dos'):
+        phonoc.tetrahedron_method_dos(dos,
+                                      mesh,
+                                      frequency_points,
+                                      frequencies,
+                                      _coef,
+                                      grid_address,
+                                      grid_mapping_table,
+                                      relative_grid_address)
     if coef is None:
         return dos[:, :, :, 0].sum(axis=0).sum(axis=0) / np.prod(mesh)
     else:
@@ -38,7 +38,7 @@ import numpy as np
 from phonopy.units import VaspToTHz
 from phonopy.harmonic.derivative_dynmat import DerivativeOfDynamicalMatrix
 from phonopy.harmonic.force_constants import similarity_transformation
-from phonopy.phonon.degeneracy import degenerate_sets
+from phonopy.phonon.degeneracy import rotate_eigenvectors_at_qpoints
 
 
 def get_group_velocity(q,  # q-point
@@ -114,6 +114,7 @@ class GroupVelocity(object):
         self._symmetry = symmetry
         self._factor = frequency_factor_to_THz
         self._cutoff_frequency = cutoff_frequency
+        self._chunk_size = 16
 
         self._directions = np.array([[1, 2, 3],
                                      [1, 0, 0],
@@ -125,7 +126,19 @@ class GroupVelocity(object):
         self._group_velocity = None
         self._perturbation = None
 
-    def set_q_points(self, q_points, perturbation=None):
+    def set_q_points(self,
+                     q_points,
+                     perturbation=None,
+                     eigenvalues=None,
+                     eigenvectors=None):
+        """Compute group velocities at q-points
+
+        Eigenvalues and eigenvectors of dynamical matrices at q_points can
+        be given when they are already computed. Otherwise they are
+        computed here.
+
+        """
+
         self._q_points = q_points
         self._perturbation = perturbation
         if perturbation is None:
@@ -134,7 +147,8 @@ class GroupVelocity(object):
             self._directions[0] = np.dot(
                 self._reciprocal_lattice, perturbation)
         self._directions[0] /= np.linalg.norm(self._directions[0])
-        self._set_group_velocity()
+        self._set_group_velocity(eigenvalues=eigenvalues,
+                                 eigenvectors=eigenvectors)
 
     def set_q_length(self, q_length):
         self._q_length = q_length
@@ -145,35 +159,51 @@ class GroupVelocity(object):
     def get_group_velocity(self):
         return self._group_velocity
 
-    def _set_group_velocity(self):
-        gv = [self._set_group_velocity_at_q(q) for q in self._q_points]
-        self._group_velocity = np.array(gv)
+    def _set_group_velocity(self, eigenvalues=None, eigenvectors=None):
+        q_points = np.array(self._q_points, dtype='double').reshape(-1, 3)
+        num_band = self._dynmat.get_dimension()
+        gv = np.zeros((len(q_points), num_band, 3), dtype='double')
+        for i in range(0, len(q_points), self._chunk_size):
+            j = min(i + self._chunk_size, len(q_points))
+            if eigenvalues is None or eigenvectors is None:
+                dms = self._dynmat.get_dynamical_matrices(q_points[i:j])
+                eigvals, eigvecs = np.linalg.eigh(dms)
+            else:
+                eigvals = eigenvalues[i:j]
+                eigvecs = eigenvectors[i:j]
+            gv[i:j] = self._get_group_velocities(q_points[i:j],
+                                                 eigvals,
+                                                 eigvecs)
+        self._group_velocity = gv
+
+    def _get_group_velocities(self, q_points, eigvals, eigvecs):
+        """Return group velocities at q-points
 
-    def _set_group_velocity_at_q(self, q):
-        self._dynmat.set_dynamical_matrix(q)
-        dm = self._dynmat.get_dynamical_matrix()
-        eigvals, eigvecs = np.linalg.eigh(dm)
-        eigvals = eigvals.real
+        Eigenvectors are rotated in degenerate subspaces so that dD/dq
+        along the first direction is diagonal there. Then group velocities
+        are the diagonal elements of dD/dq along the other directions.
+
+        """
+
+        eigvals = np.array(eigvals).real
         freqs = np.sqrt(abs(eigvals)) * np.sign(eigvals) * self._factor
-        gv = np.zeros((len(freqs), 3), dtype='double')
-        deg_sets = degenerate_sets(freqs)
-
-        ddms = self._get_dD(np.array(q))
-        pos = 0
-        for deg in deg_sets:
-            gv[pos:pos+len(deg)] = self._perturb_D(ddms, eigvecs[:, deg])
-            pos += len(deg)
-
-        for i, f in enumerate(freqs):
-            if f > self._cutoff_frequency:
-                gv[i, :] *= self._factor ** 2 / f / 2
-            else:
-                gv[i, :] = 0
+        ddms = np.array([self._get_dD(np.array(q)) for q in q_points])
+        rot_eigvecs, _ = rotate_eigenvectors_at_qpoints(freqs,
+                                                        eigvecs,
+                                                        ddms[:, 0])
+        # <e|dD|e> along Cartesian axes, shape=(q-points, bands, 3)
+        gv = (rot_eigvecs.conj()[:, None, :, :] *
+              np.matmul(ddms[:, 1:], rot_eigvecs[:, None, :, :])).sum(axis=2)
+        gv = np.array(gv.real.transpose(0, 2, 1), dtype='double', order='C')
+
+        condition = freqs > self._cutoff_frequency
+        gv[condition] *= (self._factor ** 2 / freqs[condition] / 2)[:, None]
+        gv[~condition] = 0
 
         if self._perturbation is None:
-            return self._symmetrize_group_velocity(gv, q)
-        else:
-            return gv
+            for i, q in enumerate(q_points):
+                gv[i] = self._symmetrize_group_velocity(gv[i], q)
+        return gv
 
     def _symmetrize_group_velocity(self, gv, q):
         rotations = []
@@ -207,23 +237,4 @@ class GroupVelocity(object):
     def _get_dD_analytical(self, q):
         self._ddm.run(q)
         ddm = self._ddm.get_derivative_of_dynamical_matrix()
-        dtype = "c%d" % (np.dtype('double').itemsize * 2)
-        ddm_dirs = np.zeros((len(self._directions),) + ddm.shape[1:],
-                            dtype=dtype)
-        for i, dq in enumerate(self._directions):
-            for j in range(3):
-                ddm_dirs[i] += dq[j] * ddm[j]
-        return ddm_dirs
-
-    def _perturb_D(self, ddms, eigsets):
-        eigvals, eigvecs = np.linalg.eigh(
-            np.dot(eigsets.T.conj(), np.dot(ddms[0], eigsets)))
-
-        gv = []
-        rot_eigsets = np.dot(eigsets, eigvecs)
-        for ddm in ddms[1:]:
-            gv.append(
-                np.diag(np.dot(rot_eigsets.T.conj(),
-                               np.dot(ddm, rot_eigsets))).real)
-
-        return np.transpose(gv)
+        return np.tensordot(self._directions, ddm, axes=(1, 0))
@@ -35,9 +35,9 @@
 import numpy as np
 from phonopy.structure.symmetry import Symmetry, get_pointgroup
 from phonopy.harmonic.force_constants import similarity_transformation
+from phonopy.structure.cells import compute_all_sg_permutations
 from phonopy.phonon.degeneracy import degenerate_sets as get_degenerate_sets
 from phonopy.units import VaspToTHz
-from phonopy.harmonic.derivative_dynmat import DerivativeOfDynamicalMatrix
 
 # from Wikipedia http://en.wikipedia.org/wiki/List_of_character_tables_for_chemically_important_3D_point_groups
 character_table = {
@@ -1377,13 +1377,41 @@ class IrReps(object):
         self._symprec = symprec
         self._primitive = dynamical_matrix.get_primitive()
         self._dynamical_matrix = dynamical_matrix
-        self._ddm = DerivativeOfDynamicalMatrix(dynamical_matrix)
         self._character_table = None
 
     def run(self):
-        self._set_eigenvectors(self._dynamical_matrix)
-        self._symmetry_dataset = Symmetry(self._primitive,
-                                          symprec=self._symprec).get_dataset()
+        symmetry_dataset = Symmetry(self._primitive,
+                                    symprec=self._symprec).get_dataset()
+        return self._run(symmetry_dataset)
+
+    def _run(self,
+             symmetry_dataset,
+             eigenvalues=None,
+             eigenvectors=None,
+             little_group=None):
+        """Run with symmetry dataset and optionally precomputed quantities
+
+        Parameters
+        ----------
+        symmetry_dataset : dict
+            Symmetry dataset of primitive cell.
+        eigenvalues, eigenvectors : ndarray, optional
+            Eigenvalues and eigenvectors of dynamical matrix at q. When
+            None, they are computed.
+        little_group : tuple, optional
+            Quantities that depend only on little group, which are
+            returned by _get_little_group of an instance at q-point having
+            the same little group. When None, they are computed.
+
+        """
+
+        if eigenvalues is None or eigenvectors is None:
+            self._set_eigenvectors(self._dynamical_matrix)
+        else:
+            self._eigvecs = eigenvectors
+            self._freqs = (np.sqrt(abs(eigenvalues)) * np.sign(eigenvalues) *
+                           self._factor)
+        self._symmetry_dataset = symmetry_dataset
 
         if not self._is_primitive_cell():
             print('')
@@ -1392,16 +1420,52 @@ class IrReps(object):
                   "by PRIMITIVE_AXIS tag.")
             return False
 
-        (self._rotations_at_q,
-         self._translations_at_q) = self._get_rotations_at_q()
+        self._set_little_group(little_group)
+        self._set_irreps()
+        return True
 
+    def _set_little_group(self, little_group=None):
+        if little_group is None:
+            (self._rotations_at_q,
+             self._translations_at_q) = self._get_rotations_at_q()
+            (self._pointgroup_symbol,
+             self._transformation_matrix,
+             self._conventional_rotations) = self._get_conventional_rotations()
+            self._set_ground_permutations()
+            self._set_rotation_symbols()
+        else:
+            (self._rotations_at_q,
+             self._translations_at_q,
+             self._pointgroup_symbol,
+             self._transformation_matrix,
+             self._conventional_rotations,
+             self._ground_permutations,
+             self._ground_rotations,
+             self._rotation_symbols,
+             self._character_table) = little_group
         self._g = len(self._rotations_at_q)
+        self._set_ground_phases()
+
+    def _get_little_group(self):
+        return (self._rotations_at_q,
+                self._translations_at_q,
+                self._pointgroup_symbol,
+                self._transformation_matrix,
+                self._conventional_rotations,
+                self._ground_permutations,
+                self._ground_rotations,
+                self._rotation_symbols,
+                self._character_table)
+
+    def _set_rotation_symbols(self):
+        if (self._pointgroup_symbol in character_table.keys() and
+            character_table[self._pointgroup_symbol] is not None):
+            self._rotation_symbols = self._get_rotation_symbols()
+        else:
+            self._rotation_symbols = None
 
-        (self._pointgroup_symbol,
-         self._transformation_matrix,
-         self._conventional_rotations) = self._get_conventional_rotations()
-
-        self._ground_matrices = self._get_ground_matrix()
+    def _set_irreps(self):
+        self._ground_matrices = None
         self._degenerate_sets = self._get_degenerate_sets()
         self._irreps = self._get_irreps()
         self._characters, self._irrep_dims = self._get_characters()
@@ -1410,7 +1474,6 @@ class IrReps(object):
 
         if (self._pointgroup_symbol in character_table.keys() and
             character_table[self._pointgroup_symbol] is not None):
-            self._rotation_symbols = self._get_rotation_symbols()
             if (abs(self._q) < self._symprec).all() and self._rotation_symbols:
                 self._ir_labels = self._get_ir_labels()
             elif (abs(self._q) < self._symprec).all():
@@ -1419,18 +1482,10 @@ class IrReps(object):
             else:
                 if self._log_level > 0:
                     print("Database for non-Gamma point is not prepared.")
-        else:
-            self._rotation_symbols = None
-
-        return True
 
     def _get_degenerate_sets(self):
-        deg_sets = get_degenerate_sets(self._freqs,
-                                       cutoff=self._degeneracy_tolerance)
-        self._ddm.run(self._q)
-        ddm_q = np.sum([self._ddm.get_derivative_of_dynamical_matrix()[i] *
-                        self._q[i] for i in range(3)], axis=0)
-        return deg_sets
+        return get_degenerate_sets(self._freqs,
+                                   cutoff=self._degeneracy_tolerance)
 
     def get_band_indices(self):
         return self._degenerate_sets
@@ -1445,6 +1500,8 @@ class IrReps(object):
         return self._irreps
 
     def get_ground_matrices(self):
+        if self._ground_matrices is None:
+            self._ground_matrices = self._get_ground_matrices()
         return self._ground_matrices
 
     def get_rotation_symbols(self):
@@ -1511,18 +1568,65 @@ class IrReps(object):
 
         return np.array(trans_rots)
 
-    def _get_ground_matrix(self):
-        matrices = []
+    def _set_ground_permutations(self):
+        """Set atom permutations and Cartesian rotations of little group
 
-        for (r, t) in zip(self._rotations_at_q,
-                          self._translations_at_q):
+        Ground representation matrix of a symmetry operation is
+        kron(P, R), where R is the rotation matrix in Cartesian coordinates
+        and P has only the non-zero elements P[perm[i], i] = phases[i].
+        Only perm, phases, and R are stored for the operations. Phases are
+        set by _set_ground_phases since they depend on q.
 
-            lat = self._primitive.get_cell().T
-            r_cart = similarity_transformation(lat, r)
+        """
 
-            perm_mat = self._get_modified_permutation_matrix(r, t)
-            matrices.append(np.kron(perm_mat, r_cart))
+        lat = self._primitive.get_cell().T
+        pos = self._primitive.get_scaled_positions()
+        self._ground_permutations = compute_all_sg_permutations(
+            pos,
+            self._rotations_at_q,
+            self._translations_at_q,
+            lat,
+            self._symprec)
+        self._ground_rotations = np.array(
+            [similarity_transformation(lat, r) for r in self._rotations_at_q],
+            dtype='double', order='C')
+
+    def _set_ground_phases(self):
+        """Set phase factors of ground representation
+
+        For the phase factor, see Dynamics of perfect crystals by
+        G. Venkataraman et al., pp132 Eq. (3.22). It is assumed that
+        dynamical matrix is built without considering internal atomic
+        positions, so the phase factors of eigenvectors are shifted in
+        _get_irreps().
+
+        """
 
+        pos = self._primitive.get_scaled_positions()
+        phases = []
+        for r, t, perm in zip(self._rotations_at_q,
+                              self._translations_at_q,
+                              self._ground_permutations):
+            diff = pos[perm] - (np.dot(pos, r.T) + t)
+            phase_factor = np.dot(diff, np.dot(np.linalg.inv(r).T, self._q))
+            # This phase factor comes from non-pure-translation of
+            # each symmetry opration.
+            if self._is_little_cogroup:
+                phase_factor += np.dot(t, self._q)
+            phases.append(np.exp(2j * np.pi * phase_factor))
+        self._ground_phases = np.array(
+            phases, dtype=("c%d" % (np.dtype('double').itemsize * 2)),
+            order='C')
+
+    def _get_ground_matrices(self):
+        num_atom = self._primitive.get_number_of_atoms()
+        matrices = []
+        for perm, phases, r_cart in zip(self._ground_permutations,
+                                        self._ground_phases,
+                                        self._ground_rotations):
+            perm_mat = np.zeros((num_atom, num_atom), dtype=complex)
+            perm_mat[perm, np.arange(num_atom)] = phases
+            matrices.append(np.kron(perm_mat, r_cart))
         return np.array(matrices)
 
     def _get_characters(self):
@@ -1533,76 +1637,80 @@ class IrReps(object):
             irrep_dims.append(len(irrep_Rs[0]))
         return np.array(characters), np.array(irrep_dims)
 
-    def _get_modified_permutation_matrix(self, r, t):
-        num_atom = self._primitive.get_number_of_atoms()
-        pos = self._primitive.get_scaled_positions()
-        matrix = np.zeros((num_atom, num_atom), dtype=complex)
-        for i, p1 in enumerate(pos):
-            p_rot = np.dot(r, p1) + t
-            for j, p2 in enumerate(pos):
-                diff = p_rot - p2
-                if (abs(diff - np.rint(diff)) < self._symprec).all():
-                    # For this phase factor, see
-                    # Dynamics of perfect crystals by G. Venkataraman et al.,
-                    # pp132 Eq. (3.22).
-                    # It is assumed that dynamical matrix is built without
-                    # considering internal atomic positions, so
-                    # the phase factors of eigenvectors are shifted in
-                    # _get_irreps().
-                    phase_factor = np.dot(
-                        self._q, np.dot(np.linalg.inv(r), p2 - p_rot))
-
-                    # This phase factor comes from non-pure-translation of
-                    # each symmetry opration.
-                    if self._is_little_cogroup:
-                        phase_factor += np.dot(t, self._q)
-
-                    matrix[j, i] = np.exp(2j * np.pi * phase_factor)
-
-        return matrix
-
     def _get_irreps(self):
-        eigvecs = []
-        phases = np.kron(
-            [np.exp(2j * np.pi * np.dot(self._q, pos))
-             for pos in self._primitive.get_scaled_positions()], [1, 1, 1])
-        for vec in self._eigvecs.T:
-            eigvecs.append(vec * phases)
+        phases = np.repeat(np.exp(2j * np.pi * np.dot(
+            self._primitive.get_scaled_positions(), self._q)), 3)
+        eigvecs = np.array(self._eigvecs * phases[:, None],
+                           dtype=("c%d" % (np.dtype('double').itemsize * 2)),
+                           order='C')
+        band_starts = np.array([deg[0] for deg in self._degenerate_sets] +
+                               [len(self._freqs)], dtype='intc')
+        sizes = np.diff(band_starts)
+        reps = self._get_degenerate_set_representations(eigvecs, band_starts)
 
         irrep = []
-        for band_indices in self._degenerate_sets:
-            irrep_Rs = []
-            for mat in self._ground_matrices:
-                l = len(band_indices)
-
-                if l == 1:
-                    vec = eigvecs[band_indices[0]]
-                    irrep_Rs.append([[np.vdot(vec, np.dot(mat, vec))]])
-                    continue
-
-                irrep_R = np.zeros((l, l), dtype=complex)
-                for i, b_i in enumerate(band_indices):
-                    vec_i = eigvecs[b_i]
-                    for j, b_j in enumerate(band_indices):
-                        vec_j = eigvecs[b_j]
-                        irrep_R[i, j] = np.vdot(vec_i, np.dot(mat, vec_j))
-                irrep_Rs.append(irrep_R)
-
-            irrep.append(irrep_Rs)
-
+        offsets = np.cumsum(sizes ** 2) - sizes ** 2
+        for size, offset in zip(sizes, offsets):
+            irrep.append(
+                list(reps[:, offset:(offset + size ** 2)].reshape(-1,
+                                                                  size,
+                                                                  size)))
         return irrep
 
+    def _get_degenerate_set_representations(self, eigvecs, band_starts):
+        """Return <e_i|G|e_j> for bands i and j in each degenerate set
+
+        Eigenvectors of a degenerate set are consecutive columns of eigvecs
+        starting from band_starts. Matrices of degenerate sets are packed
+        in the second axis of the returned array whose first axis is for
+        symmetry operations.
+
+        """
+
+        sizes = np.diff(band_starts)
+        reps = np.zeros((len(self._ground_permutations), (sizes ** 2).sum()),
+                        dtype=("c%d" % (np.dtype('double').itemsize * 2)),
+                        order='C')
+        try:
+            import phonopy._phonopy as phonoc
+            phonoc.degenerate_set_representations(
+                reps.view(dtype='double'),
+                eigvecs.view(dtype='double'),
+                band_starts,
+                self._ground_permutations,
+                self._ground_phases.view(dtype='double'),
+                self._ground_rotations)
+        except ImportError:
+            num_atom = len(self._ground_permutations[0])
+            vecs = eigvecs.reshape(num_atom, 3, -1)
+            for rep, perm, phases, r_cart in zip(reps,
+                                                 self._ground_permutations,
+                                                 self._ground_phases,
+                                                 self._ground_rotations):
+                Ge = np.zeros_like(vecs)
+                Ge[perm] = phases[:, None, None] * np.matmul(r_cart, vecs)
+                Ge = Ge.reshape(eigvecs.shape)
+                offset = 0
+                for start, size in zip(band_starts, sizes):
+                    bands = slice(start, start + size)
+                    rep[offset:(offset + size ** 2)] = np.dot(
+                        eigvecs[:, bands].T.conj(), Ge[:, bands]).ravel()
+                    offset += size ** 2
+        return reps
+
     def _get_character_projection_operators(self, idx_irrep):
         dim = self._irrep_dims[idx_irrep]
         chars = self._characters[idx_irrep]
         return np.sum([mat * char.conj()
-                       for mat, char in zip(self._ground_matrices, chars)],
+                       for mat, char in zip(self.get_ground_matrices(),
+                                            chars)],
                       axis=0) * dim / self._g
 
     def _get_projection_operators(self, idx_irrep, i, j):
         dim = self._irrep_dims[idx_irrep]
         return np.sum([mat * r[i, j].conj() for mat, r
-                       in zip(self._ground_matrices, self._irreps[idx_irrep])],
+                       in zip(self.get_ground_matrices(),
+                              self._irreps[idx_irrep])],
                       axis=0) * dim / self._g
 
     def _get_rotation_symbols(self):
@@ -1832,6 +1940,202 @@ class IrReps(object):
 
         pass
 
+
+class IrRepsAtQpoints(object):
+    """Irreducible representations of phonon modes at q-points
+
+    Symmetry dataset of primitive cell is computed once and dynamical
+    matrices are diagonalized at once. q-points are grouped by their
+    little groups, and symmetry operations, atom permutations, rotation
+    symbols and character tables are shared within each group. Results
+    at each q-point are stored in an IrReps instance.
+
+    Attributes
+    ----------
+    qpoints : ndarray
+        q-points in reduced coordinates.
+        shape=(qpoints, 3), dtype='double'
+    irreps : list of IrReps
+        IrReps instances at q-points.
+    little_group_ids : ndarray
+        Index of distinct little group of each q-point.
+        shape=(qpoints, ), dtype='intc'
+    little_group_masks : ndarray
+        Whether each space group operation of the symmetry dataset belongs
+        to little group of each q-point.
+        shape=(qpoints, operations), dtype='bool'
+    characters : ndarray
+        Characters of the degenerate set that each band belongs to. Those
+        of operations outside little group are zero.
+        shape=(qpoints, bands, operations), dtype='complex128'
+    degenerate_sets : ndarray
+        Index of the first band of the degenerate set that each band
+        belongs to.
+        shape=(qpoints, bands), dtype='intc'
+    ir_labels : ndarray
+        Irrep label of each band. None when it is not identified.
+        shape=(qpoints, bands), dtype=object
+
+    """
+
+    def __init__(self,
+                 dynamical_matrix,
+                 qpoints,
+                 is_little_cogroup=False,
+                 nac_q_direction=None,
+                 factor=VaspToTHz,
+                 symprec=1e-5,
+                 degeneracy_tolerance=1e-5,
+                 log_level=0):
+        self._dynamical_matrix = dynamical_matrix
+        self._qpoints = np.array(qpoints, dtype='double').reshape(-1, 3)
+        self._is_little_cogroup = is_little_cogroup
+        self._nac_q_direction = nac_q_direction
+        self._factor = factor
+        self._symprec = symprec
+        self._degeneracy_tolerance = degeneracy_tolerance
+        self._log_level = log_level
+
+        self._irreps = None
+        self._little_group_ids = None
+        self._little_group_masks = None
+        self._characters = None
+        self._degenerate_sets = None
+        self._ir_labels = None
+
+    @property
+    def qpoints(self):
+        return self._qpoints
+
+    @property
+    def irreps(self):
+        return self._irreps
+
+    @property
+    def little_group_ids(self):
+        return self._little_group_ids
+
+    @property
+    def little_group_masks(self):
+        return self._little_group_masks
+
+    @property
+    def characters(self):
+        return self._characters
+
+    @property
+    def degenerate_sets(self):
+        return self._degenerate_sets
+
+    @property
+    def ir_labels(self):
+        return self._ir_labels
+
+    def run(self, num_workers=None):
+        """Identify irreps at all q-points
+
+        Parameters
+        ----------
+        num_workers : int, optional
+            Number of threads to treat q-points in parallel. Those of the
+            same little group are treated after the first of them. Default
+            is 1.
+
+        Returns
+        -------
+        bool
+            False when the cell is not a primitive cell.
+
+        """
+
+        symmetry_dataset = Symmetry(
+            self._dynamical_matrix.get_primitive(),
+            symprec=self._symprec).get_dataset()
+        dms = self._dynamical_matrix.get_dynamical_matrices(self._qpoints)
+        if self._nac_q_direction is not None:
+            for i, q in enumerate(self._qpoints):
+                if (np.abs(q) < 1e-5).all():
+                    self._dynamical_matrix.set_dynamical_matrix(
+                        q, q_direction=self._nac_q_direction)
+                    dms[i] = self._dynamical_matrix.get_dynamical_matrix()
+        eigvals, eigvecs = np.linalg.eigh(dms)
+        self._set_little_group_ids(symmetry_dataset['rotations'])
+
+        num_qpoints = len(self._qpoints)
+        self._irreps = [IrReps(self._dynamical_matrix,
+                               q,
+                               is_little_cogroup=self._is_little_cogroup,
+                               nac_q_direction=self._nac_q_direction,
+                               factor=self._factor,
+                               symprec=self._symprec,
+                               degeneracy_tolerance=self._degeneracy_tolerance,
+                               log_level=self._log_level)
+                        for q in self._qpoints]
+        little_groups = {}
+
+        def run_at_q(i):
+            return self._irreps[i]._run(
+                symmetry_dataset,
+                eigenvalues=eigvals[i].real,
+                eigenvectors=eigvecs[i],
+                little_group=little_groups.get(self._little_group_ids[i]))
+
+        _, first_indices = np.unique(self._little_group_ids,
+                                     return_index=True)
+        for i in first_indices:
+            if not run_at_q(i):
+                return False
+            little_groups[self._little_group_ids[i]] = (
+                self._irreps[i]._get_little_group())
+
+        others = np.setdiff1d(np.arange(num_qpoints), first_indices)
+        if num_workers is None or num_workers < 2:
+            for i in others:
+                run_at_q(i)
+        else:
+            from phonopy.parallel import thread_pool
+            with thread_pool(num_workers) as executor:
+                list(executor.map(run_at_q, others))
+
+        self._set_compact_arrays()
+        return True
+
+    def _set_little_group_ids(self, rotations):
+        """Group q-points by operations keeping q invariant
+
+        The same criterion as IrReps._get_rotations_at_q is used.
+
+        """
+
+        diff = (np.einsum('qj,sjk->qsk', self._qpoints, rotations) -
+                self._qpoints[:, None, :])
+        self._little_group_masks = (
+            np.abs(diff - np.rint(diff)) < self._symprec).all(axis=2)
+        _, ids = np.unique(self._little_group_masks,
+                           axis=0,
+                           return_inverse=True)
+        self._little_group_ids = np.array(ids, dtype='intc')
+
+    def _set_compact_arrays(self):
+        num_qpoints, num_ops = self._little_group_masks.shape
+        num_band = self._dynamical_matrix.get_dimension()
+        self._characters = np.zeros(
+            (num_qpoints, num_band, num_ops),
+            dtype=("c%d" % (np.dtype('double').itemsize * 2)), order='C')
+        self._degenerate_sets = np.zeros((num_qpoints, num_band),
+                                         dtype='intc', order='C')
+        self._ir_labels = np.empty((num_qpoints, num_band), dtype=object)
+        for i, irreps in enumerate(self._irreps):
+            ops = np.nonzero(self._little_group_masks[i])[0]
+            labels = irreps._ir_labels
+            for j, deg_set in enumerate(irreps.get_band_indices()):
+                for band in deg_set:
+                    self._characters[i, band, ops] = irreps.get_characters()[j]
+                    self._degenerate_sets[i, band] = deg_set[0]
+                    if labels is not None:
+                        self._ir_labels[i, band] = labels[j]
+
+
 def _get_rotation_symbol(rotation, mapping_table):
     for k in mapping_table:
         v = mapping_table[k]
@@ -34,6 +34,7 @@
 
 import numpy as np
 from phonopy.units import VaspToTHz
+from phonopy.profiling import stage
 from phonopy.structure.grid_points import GridPoints
 from phonopy.structure.symmetry import get_lattice_vector_equivalence
 
@@ -397,11 +398,12 @@ class Mesh(MeshBase):
             for i, q in enumerate(self._qpoints):
                 self._dynamical_matrix.set_dynamical_matrix(q)
                 dm = self._dynamical_matrix.get_dynamical_matrix()
-                if self._with_eigenvectors:
-                    eigvals, self._eigenvectors[i] = np.linalg.eigh(dm)
-                    eigenvalues = eigvals.real
-                else:
-                    eigenvalues = np.linalg.eigvalsh(dm).real
+                with stage('eigh'):
+                    if self._with_eigenvectors:
+                        eigvals, self._eigenvectors[i] = np.linalg.eigh(dm)
+                        eigenvalues = eigvals.real
+                    else:
+                        eigenvalues = np.linalg.eigvalsh(dm).real
                 self._frequencies[i] = np.array(np.sqrt(abs(eigenvalues)) *
                                                 np.sign(eigenvalues),
                                                 dtype='double',
@@ -459,11 +461,13 @@ class IterMesh(MeshBase):
             q = self._qpoints[self._q_count]
             self._dynamical_matrix.set_dynamical_matrix(q)
             dm = self._dynamical_matrix.get_dynamical_matrix()
-            if self._with_eigenvectors:
-                eigvals, eigenvectors = np.linalg.eigh(dm)
-                eigenvalues = eigvals.real
-            else:
-                eigenvalues = np.linalg.eigvalsh(dm).real
+            with stage('eigh'):
+                if self._with_eigenvectors:
+                    eigvals, eigenvectors = np.linalg.eigh(dm)
+                    eigenvalues = eigvals.real
+                else:
+                    eigenvalues = np.linalg.eigvalsh(dm).real
+                    eigenvectors = None
             frequencies = np.array(np.sqrt(abs(eigenvalues)) *
                                    np.sign(eigenvalues),
                                    dtype='double',
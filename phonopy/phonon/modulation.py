@@ -68,28 +68,121 @@ class Modulation(object):
         self._u = []
         self._eigvecs = []
         self._eigvals = []
+        self._mode_patterns = None
         self._supercell = None
 
         dim = self._get_dimension_3x3()
         self._supercell = get_supercell(self._primitive, dim)
 
     def run(self):
+        """Compute modulations of phonon modes
+
+        Phonon modes are grouped by q-point, so that eigenvectors at each
+        q-point are computed only once. Mode patterns, i.e., modulations
+        of unit amplitude and zero argument, are stored for
+        get_modulations.
+
+        """
+
+        eigensystems = {}
+        eigvecs = []
+        qpoints = []
         for ph_mode in self._phonon_modes:
             q, band_index, amplitude, argument = ph_mode
-            eigvals, eigvecs = get_eigenvectors(
-                q,
-                self._dm,
-                self._ddm,
-                perturbation=self._delta_q,
-                derivative_order=self._derivative_order,
-                nac_q_direction=self._nac_q_direction)
-            u = self._get_displacements(eigvecs[:, band_index],
-                                        q,
-                                        amplitude,
-                                        argument)
-            self._u.append(u)
-            self._eigvecs.append(eigvecs[:, band_index])
-            self._eigvals.append(eigvals[band_index])
+            key = tuple(np.array(q, dtype='double'))
+            if key not in eigensystems:
+                eigensystems[key] = get_eigenvectors(
+                    q,
+                    self._dm,
+                    self._ddm,
+                    perturbation=self._delta_q,
+                    derivative_order=self._derivative_order,
+                    nac_q_direction=self._nac_q_direction)
+            eigvals_q, eigvecs_q = eigensystems[key]
+            eigvecs.append(eigvecs_q[:, band_index])
+            self._eigvals.append(eigvals_q[band_index])
+            qpoints.append(q)
+        self._eigvecs = eigvecs
+
+        if self._phonon_modes:
+            self._mode_patterns = self._get_mode_patterns(eigvecs, qpoints)
+            amplitudes = [mode[2] for mode in self._phonon_modes]
+            arguments = [mode[3] for mode in self._phonon_modes]
+            self._u = list(self._mode_patterns *
+                           self._get_coefficients(amplitudes,
+                                                  arguments)[:, None, None])
+
+    def get_modulations(self, amplitudes, arguments):
+        """Return linear combinations of mode patterns
+
+        Parameters
+        ----------
+        amplitudes : array_like
+            Amplitudes of phonon modes given at initialization.
+            shape=(structures, phonon_modes), dtype='double'
+        arguments : array_like
+            Phase factors of phonon modes in degrees.
+            shape=(structures, phonon_modes), dtype='double'
+
+        Returns
+        -------
+        ndarray
+            Atomic modulations of supercell in Cartesian coordinates.
+            shape=(structures, supercell atoms, 3), dtype='complex128'
+
+        """
+
+        coefs = self._get_coefficients(amplitudes, arguments)
+        return np.tensordot(coefs, self._mode_patterns, axes=(1, 0))
+
+    def iter_modulated_supercells(self, amplitudes, arguments, chunk_size=100):
+        """Generate modulated supercells of linear combinations of modes
+
+        Modulations are computed by chunks of structures. See
+        get_modulations for the parameters.
+
+        """
+
+        for i in range(0, len(amplitudes), chunk_size):
+            for u in self.get_modulations(amplitudes[i:(i + chunk_size)],
+                                          arguments[i:(i + chunk_size)]):
+                yield self._get_cell_with_modulation(u)
+
+    def write_modulated_supercells(self,
+                                   amplitudes,
+                                   arguments,
+                                   filename="MPOSCAR",
+                                   interface_mode=None,
+                                   optional_structure_info=None,
+                                   chunk_size=100):
+        """Write modulated supercells of linear combinations of modes
+
+        Supercells are written one by one to filename-001, filename-002,
+        ... in the format of the calculator interface. See
+        get_modulations for amplitudes and arguments, and
+        write_crystal_structure for interface_mode and
+        optional_structure_info. For crystal, conventional atomic numbers
+        of unit cell atoms in optional_structure_info are expanded to
+        those of supercell atoms.
+
+        """
+
+        from phonopy.interface import write_crystal_structure
+
+        if interface_mode == 'crystal':
+            conv_numbers = np.array(optional_structure_info[1])
+            optional_structure_info = (
+                optional_structure_info[0],
+                conv_numbers[self._get_supercell_to_unitcell_indices()])
+
+        width = max(3, len(str(len(amplitudes))))
+        for i, cell in enumerate(self.iter_modulated_supercells(
+                amplitudes, arguments, chunk_size=chunk_size)):
+            write_crystal_structure(
+                "{0}-{1:0{2}}".format(filename, i + 1, width),
+                cell,
+                interface_mode=interface_mode,
+                optional_structure_info=optional_structure_info)
 
     def get_modulated_supercells(self):
         modulations = []
@@ -122,13 +215,28 @@ class Modulation(object):
         positions = self._supercell.get_positions()
         positions += modulation.real
         scaled_positions = np.dot(positions, np.linalg.inv(lattice))
-        for p in scaled_positions:
-            p -= np.floor(p)
+        scaled_positions -= np.floor(scaled_positions)
         cell = self._supercell.copy()
         cell.set_scaled_positions(scaled_positions)
 
         return cell
 
+    def _get_supercell_to_unitcell_indices(self):
+        """Return indices of unit cell atoms of supercell atoms
+
+        Supercell atoms are mapped to primitive cell atoms, and then to
+        unit cell atoms through the supercell of the dynamical matrix.
+
+        """
+
+        scell = self._dm.supercell
+        p2uc_map = [scell.u2u_map[scell.s2u_map[i]]
+                    for i in self._primitive.get_primitive_to_supercell_map()]
+        s2u_map = self._supercell.get_supercell_to_unitcell_map()
+        u2u_map = self._supercell.get_unitcell_to_unitcell_map()
+        return np.array([p2uc_map[u2u_map[i]] for i in s2u_map],
+                        dtype='intc')
+
     def _get_dimension_3x3(self):
         if len(self._dimension) == 3:
             dim = np.diag(self._dimension)
@@ -144,34 +252,40 @@ class Modulation(object):
 
         return dim
 
-    def _get_displacements(self, eigvec, q, amplitude, argument):
+    def _get_mode_patterns(self, eigvecs, qpoints):
+        """Return modulations of unit amplitudes and zero arguments
+
+        The phase of each mode pattern is chosen so that the element of
+        the largest absolute value is real and positive.
+
+        Returns
+        -------
+        ndarray
+            shape=(phonon_modes, supercell atoms, 3), dtype='complex128'
+
+        """
+
         m = self._supercell.get_masses()
         s2u_map = self._supercell.get_supercell_to_unitcell_map()
         u2u_map = self._supercell.get_unitcell_to_unitcell_map()
-        s2uu_map = [u2u_map[x] for x in s2u_map]
+        s2uu_map = np.array([u2u_map[x] for x in s2u_map], dtype='intc')
         spos = self._supercell.get_scaled_positions()
         dim = self._supercell.get_supercell_matrix()
-        coefs = (np.exp(2j * np.pi * np.dot(np.dot(spos, dim.T), q))
+        spos_dim = np.dot(spos, dim.T)
+        # shape=(phonon_modes, supercell atoms)
+        coefs = (np.exp([2j * np.pi * np.dot(spos_dim, q) for q in qpoints])
                  / np.sqrt(m))
-        u = []
-        for i, coef in enumerate(coefs):
-            eig_index = s2uu_map[i] * 3
-            u.append(eigvec[eig_index:eig_index + 3] * coef)
-
-        u = np.array(u) / np.sqrt(len(m))
-        phase_factor = self._get_phase_factor(u, argument)
-        u *= phase_factor * amplitude
-
-        return u
+        eigvecs = np.array(eigvecs).reshape(len(eigvecs), -1, 3)
+        patterns = eigvecs[:, s2uu_map, :] * coefs[:, :, None]
+        patterns /= np.sqrt(len(m))
 
-    def _get_phase_factor(self, modulation, argument):
-        u = np.ravel(modulation)
-        index_max_elem = np.argmax(abs(u))
-        max_elem = u[index_max_elem]
-        phase_for_zero = max_elem / abs(max_elem)
-        phase_factor = np.exp(1j * np.pi * argument / 180) / phase_for_zero
+        u = patterns.reshape(len(patterns), -1)
+        max_elems = u[np.arange(len(u)), np.argmax(abs(u), axis=1)]
+        return patterns / (max_elems / abs(max_elems))[:, None, None]
 
-        return phase_factor
+    def _get_coefficients(self, amplitudes, arguments):
+        return (np.array(amplitudes, dtype='double') *
+                np.exp(1j * np.pi * np.array(arguments, dtype='double') / 180))
 
     def _eigvals_to_frequencies(self, eigvals):
         e = np.array(eigvals).real
@@ -36,13 +36,71 @@ import numpy as np
 
 
 class PhononMoment(object):
+    """Phonon moments
+
+    Moment of order n is the average of f^n over phonon modes of
+    frequencies f in the frequency range. With eigenvectors, modes are
+    weighted by |e|^2 and moments are projected on atoms.
+
+    Sums over modes for any orders are accumulated at once in C. When
+    iter_mesh is given, phonons are taken from it chunk by chunk, so that
+    eigenvectors on the whole mesh are not stored.
+
+    Attributes
+    ----------
+    moment : float or ndarray
+        Moment of the order given to run. shape=(atoms,) with projection.
+        When a sequence of orders is given to run, the first dimension is
+        added for the orders.
+
+    """
+
     def __init__(self,
-                 frequencies,
-                 weights,
-                 eigenvectors=None):
-        self._frequencies = frequencies
-        self._eigenvectors = eigenvectors
-        self._weights = weights
+                 frequencies=None,
+                 weights=None,
+                 eigenvectors=None,
+                 iter_mesh=None,
+                 is_projection=None,
+                 chunk_size=64):
+        """
+
+        Parameters
+        ----------
+        frequencies : ndarray, optional
+            Phonon frequencies. shape=(qpoints, bands), dtype='double'
+        weights : ndarray, optional
+            Weights of q-points. shape=(qpoints,), dtype='intc'
+        eigenvectors : ndarray, optional
+            Phonon eigenvectors. Moments are projected on atoms when this
+            is given. shape=(qpoints, bands, bands), dtype='complex128'
+        iter_mesh : Mesh or IterMesh, optional
+            Iterable yielding frequencies and eigenvectors at q-points. When
+            this is given, frequencies, weights, and eigenvectors are
+            ignored.
+        is_projection : bool, optional
+            Whether moments are projected or not when iter_mesh is given.
+            Default is iter_mesh.with_eigenvectors.
+        chunk_size : int, optional
+            Number of q-points accumulated at once from iter_mesh.
+            Default is 64.
+
+        """
+
+        self._iter_mesh = iter_mesh
+        self._chunk_size = chunk_size
+        if iter_mesh is None:
+            self._frequencies = frequencies
+            self._eigenvectors = eigenvectors
+            self._weights = weights
+            self._is_projection = eigenvectors is not None
+        else:
+            self._frequencies = None
+            self._eigenvectors = None
+            self._weights = iter_mesh.weights
+            if is_projection is None:
+                self._is_projection = iter_mesh.with_eigenvectors
+            else:
+                self._is_projection = is_projection
         self._fmin = None
         self._fmax = None
         self.set_frequency_range()
@@ -65,35 +123,97 @@ class PhononMoment(object):
             self._fmin = freq_min - tolerance
 
         if freq_max is None:
-            self._fmax = np.max(self._frequencies) + tolerance
+            self._fmax = np.inf
         else:
             self._fmax = freq_max + tolerance
 
     def run(self, order=1):
-        if self._eigenvectors is None:
-            self._get_moment(order)
+        """Compute moments
+
+        Parameters
+        ----------
+        order : int or sequence of int, optional
+            Order(s) of moments. Default is 1.
+
+        """
+
+        orders = np.array(np.ravel(order), dtype='intc')
+        sums = self._get_sums(orders)
+        if self._is_projection:
+            moments = (sums[1:] / sums[0]).reshape(len(orders), -1, 3)
+            moments = moments.sum(axis=2) / 3
+        else:
+            moments = sums[1:] / sums[0]
+
+        if np.ndim(order) == 0:
+            self._moment = moments[0]
+        else:
+            self._moment = moments
+
+    def _get_sums(self, orders):
+        sums = None
+        for freqs, weights, eigvecs in self._get_phonons():
+            if sums is None:
+                shape = (len(orders) + 1, )
+                if self._is_projection:
+                    shape += (freqs.shape[1], )
+                sums = np.zeros(shape, dtype='double')
+            try:
+                import phonopy._phonopy as phonoc
+                self._run_c_sums(sums, orders, freqs, weights, eigvecs)
+            except ImportError:
+                self._run_py_sums(sums, orders, freqs, weights, eigvecs)
+        return sums
+
+    def _get_phonons(self):
+        """Yield frequencies, weights, and eigenvectors by chunks"""
+        if self._iter_mesh is None:
+            yield self._frequencies, self._weights, self._eigenvectors
+        else:
+            freqs = []
+            eigvecs = []
+            for i, (f, e) in enumerate(self._iter_mesh):
+                freqs.append(f)
+                eigvecs.append(e)
+                if len(freqs) == self._chunk_size:
+                    yield self._get_chunk(freqs, eigvecs, i)
+                    freqs = []
+                    eigvecs = []
+            if freqs:
+                yield self._get_chunk(freqs, eigvecs, i)
+
+    def _get_chunk(self, freqs, eigvecs, i_last):
+        weights = self._weights[(i_last + 1 - len(freqs)):(i_last + 1)]
+        if self._is_projection:
+            return np.array(freqs), weights, np.array(eigvecs)
+        else:
+            return np.array(freqs), weights, None
+
+    def _run_c_sums(self, sums, orders, freqs, weights, eigvecs):
+        import phonopy._phonopy as phonoc
+
+        if eigvecs is None:
+            _eigvecs = None
+        else:
+            _eigvecs = np.array(eigvecs, dtype='c16', order='C').view(
+                dtype='double')
+        phonoc.phonon_moments(sums,
+                              np.array(freqs, dtype='double', order='C'),
+                              _eigvecs,
+                              np.array(weights, dtype='intc'),
+                              orders,
+                              self._fmin,
+                              self._fmax)
+
+    def _run_py_sums(self, sums, orders, freqs, weights, eigvecs):
+        cond = (self._fmin < freqs) & (freqs < self._fmax)
+        c = cond * np.array(weights, dtype='double')[:, None]
+        f = np.where(cond, freqs, 1)
+        # shape=(qpoints, orders + 1, bands)
+        coef = np.concatenate(
+            (c[:, None, :], c[:, None, :] * f[:, None, :] ** orders[:, None]),
+            axis=1)
+        if eigvecs is None:
+            sums += coef.sum(axis=(0, 2))
         else:
-            self._get_projected_moment(order)
-
-    def _get_moment(self, order):
-        moment = 0
-        norm0 = 0
-        for i, w in enumerate(self._weights):
-            for freq in self._frequencies[i]:
-                if self._fmin < freq and freq < self._fmax :
-                    norm0 += w
-                    moment += freq ** order * w
-        self._moment = moment / norm0
-
-    def _get_projected_moment(self, order):
-        moment = np.zeros(self._frequencies.shape[1], dtype='double')
-        norm0 = np.zeros_like(moment)
-        for i, w in enumerate(self._weights):
-            for freq, eigvec in zip(self._frequencies[i],
-                                    self._eigenvectors[i].T):
-                if self._fmin < freq and freq < self._fmax :
-                    projection = np.abs(eigvec) ** 2
-                    norm0 += w * projection
-                    moment += freq ** order * w * projection
-        self._moment = np.array([np.sum((moment / norm0)[i * 3:(i + 1) * 3])
-                                 for i in range(len(moment) // 3)]) / 3
+            sums += np.einsum('ikj,ilj->kl', coef, np.abs(eigvecs) ** 2)
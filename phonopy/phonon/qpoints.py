@@ -34,6 +34,7 @@
 
 import numpy as np
 from phonopy.units import VaspToTHz
+from phonopy.profiling import stage
 
 
 class QpointsPhonon(object):
@@ -182,11 +183,12 @@ class QpointsPhonon(object):
             dm = self._get_dynamical_matrix(q)
             if self._with_dynamical_matrices:
                 dynamical_matrices.append(dm)
-            if self._with_eigenvectors:
-                eigvals, eigvecs = np.linalg.eigh(dm)
-                self._eigenvectors.append(eigvecs)
-            else:
-                eigvals = np.linalg.eigvalsh(dm)
+            with stage('eigh'):
+                if self._with_eigenvectors:
+                    eigvals, eigvecs = np.linalg.eigh(dm)
+                    self._eigenvectors.append(eigvecs)
+                else:
+                    eigvals = np.linalg.eigvalsh(dm)
             eigvals = eigvals.real
             self._frequencies.append(np.sqrt(np.abs(eigvals)) *
                                      np.sign(eigvals) * self._factor)
@@ -38,6 +38,53 @@ from phonopy.structure.brillouin_zone import get_qpoints_in_Brillouin_zone
 from phonopy.units import VaspToTHz, THzToEv, Kb, Hbar, AMU, EV, Angstrom, THz
 
 
+def get_normal_random_numbers(num, key, snapshots, qpoint_index):
+    """Standard normal random numbers of Philox streams
+
+    Python implementation of get_normal_random_numbers in _phonopy.c.
+    Uniform random numbers (x + 0.5) / 2**32 of Philox4x32-10 with
+    counter (n, snapshot & 0xffffffff, snapshot >> 32, qpoint_index) of
+    block n are transformed by Box-Muller transform.
+
+    Returns
+    -------
+    ndarray
+        shape=(len(snapshots), num), dtype='double'
+
+    """
+
+    snapshots = np.array(snapshots, dtype='uint64')
+    num_blocks = (num + 3) // 4
+    shape = (len(snapshots), num_blocks)
+    ctr = [np.broadcast_to(np.arange(num_blocks, dtype='uint64'), shape),
+           np.broadcast_to((snapshots & 0xffffffff)[:, None], shape),
+           np.broadcast_to((snapshots >> 32)[:, None], shape),
+           np.full(shape, qpoint_index, dtype='uint64')]
+    x = (np.array(_philox4x32(ctr, key), dtype='double') + 0.5) / 2.0 ** 32
+    r = np.sqrt(-2 * np.log(x[[0, 2]]))
+    theta = 2 * np.pi * x[[1, 3]]
+    z = np.array([r[0] * np.cos(theta[0]), r[0] * np.sin(theta[0]),
+                  r[1] * np.cos(theta[1]), r[1] * np.sin(theta[1])])
+    return z.transpose(1, 2, 0).reshape(len(snapshots), -1)[:, :num]
+
+
+def _philox4x32(ctr, key):
+    mask = np.uint64(0xffffffff)
+    ctr = [np.array(c, dtype='uint64') for c in ctr]
+    k0, k1 = np.uint64(key[0]), np.uint64(key[1])
+    for i in range(10):
+        if i > 0:
+            k0 = (k0 + np.uint64(0x9E3779B9)) & mask
+            k1 = (k1 + np.uint64(0xBB67AE85)) & mask
+        prod0 = np.uint64(0xD2511F53) * ctr[0]
+        prod1 = np.uint64(0xCD9E8D57) * ctr[2]
+        ctr = [(prod1 >> np.uint64(32)) ^ ctr[1] ^ k0,
+               prod1 & mask,
+               (prod0 >> np.uint64(32)) ^ ctr[3] ^ k1,
+               prod0 & mask]
+    return ctr
+
+
 class RandomDisplacements(object):
     """Generate Random displacements by Canonical ensenmble.
 
@@ -95,15 +142,19 @@ class RandomDisplacements(object):
         p2p = self._dynmat.primitive.p2p_map
         self._s2pp = [p2p[i] for i in s2p]
 
-        self._eigvals_ii = []
-        self._eigvecs_ii = []
-        self._phase_ii = []
-        self._eigvals_ij = []
-        self._eigvecs_ij = []
-        self._phase_ij = []
+        self._eigvals_ii = None
+        self._eigvecs_ii = None
+        self._phase_ii = None
+        self._eigvals_ij = None
+        self._eigvecs_ij = None
+        self._phase_ij = None
         self._prepare()
 
-    def run(self, T, number_of_snapshots=1, seed=None):
+        self._seed = None
+        self._A_ii = None
+        self._A_ij = None
+
+    def run(self, T, number_of_snapshots=1, seed=None, chunk_size=None):
         """
 
         Parameters
@@ -113,20 +164,101 @@ class RandomDisplacements(object):
         number_of_snapshots : int
             Number of snapshots to be generated.
         seed : int or None, optional
-            Random seed passed to np.random.seed. Default is None. Integer
-            number has to be positive.
+            Random seed of the Philox random number streams. Default is
+            None, where a seed is drawn by np.random.randint. Integer
+            number has to be non-negative and smaller than 2**64.
+        chunk_size : int, optional
+            Number of snapshots generated at once. Default is all.
 
         """
 
-        np.random.seed(seed=seed)
+        if chunk_size is None:
+            chunk_size = max(number_of_snapshots, 1)
+        chunks = list(self.generate(T,
+                                    number_of_snapshots,
+                                    seed=seed,
+                                    chunk_size=chunk_size))
+        if chunks:
+            self.u = np.array(np.concatenate(chunks),
+                              dtype='double', order='C')
+        else:
+            natom = self._dynmat.supercell.get_number_of_atoms()
+            self.u = np.zeros((0, natom, 3), dtype='double')
 
-        N = len(self._comm_points)
-        u_ii = self._solve_ii(T, number_of_snapshots)
-        u_ij = self._solve_ij(T, number_of_snapshots)
-        mass = self._dynmat.supercell.get_masses().reshape(-1, 1)
-        u = np.array((u_ii + u_ij) / np.sqrt(mass * N),
-                     dtype='double', order='C')
-        self.u = u
+    def generate(self, T, number_of_snapshots, seed=None, chunk_size=100):
+        """Generate snapshots chunk by chunk
+
+        Normal random numbers of each snapshot and each commensurate
+        q-point are drawn from a counter-based Philox4x32-10 stream whose
+        counter contains the snapshot index. Therefore snapshots are
+        reproducible for the same seed regardless of chunk size and
+        number of OpenMP threads.
+
+        Parameters
+        ----------
+        T, number_of_snapshots, seed : See run.
+        chunk_size : int, optional
+            Number of snapshots in each chunk. Default is 100.
+
+        Yields
+        ------
+        u : ndarray
+            Displacements in Angstrom.
+            shape=(chunk_size or less, supercell_atoms, 3), dtype='double'
+
+        """
+
+        if seed is None:
+            seed = np.random.randint(0, 2 ** 31 - 1)
+        self._seed = int(seed)
+        self._set_mode_matrices(T)
+        for i in range(0, number_of_snapshots, chunk_size):
+            n = min(chunk_size, number_of_snapshots - i)
+            yield self._get_snapshots(i, n)
+
+    def write_hdf5(self,
+                   filename,
+                   T,
+                   number_of_snapshots,
+                   seed=None,
+                   chunk_size=100):
+        """Write snapshots to hdf5 file without holding all of them
+
+        Datasets of 'displacements' (Angstrom), 'temperature', and 'seed'
+        are written.
+
+        Parameters
+        ----------
+        filename : str
+            Output file name.
+        T, number_of_snapshots, seed, chunk_size : See generate.
+
+        """
+
+        import h5py
+
+        natom = self._dynmat.supercell.get_number_of_atoms()
+        with h5py.File(filename, 'w') as w:
+            dset = w.create_dataset(
+                'displacements',
+                (number_of_snapshots, natom, 3),
+                dtype='double',
+                chunks=(max(min(chunk_size, number_of_snapshots), 1),
+                        natom, 3))
+            i = 0
+            for u in self.generate(T,
+                                   number_of_snapshots,
+                                   seed=seed,
+                                   chunk_size=chunk_size):
+                dset[i:(i + len(u))] = u
+                i += len(u)
+            w.create_dataset('temperature', data=T)
+            w.create_dataset('seed', data=self._seed)
+
+    @property
+    def seed(self):
+        """Seed used at the last run"""
+        return self._seed
 
     def _prepare(self):
         pos = self._dynmat.supercell.get_scaled_positions()
@@ -136,56 +268,102 @@ class RandomDisplacements(object):
             self._rec_lat,
             self._comm_points[self._ii] / float(N),
             only_unique=True)
-        for q in qpoints_ii:
-            self._dynmat.set_dynamical_matrix(q)
-            dm = self._dynmat.dynamical_matrix
-            eigvals, eigvecs = np.linalg.eigh(dm.real)
-            self._eigvals_ii.append(eigvals)
-            self._eigvecs_ii.append(eigvecs)
-            self._phase_ii.append(
-                np.cos(2 * np.pi * np.dot(pos, q)).reshape(-1, 1))
-
-        qpoints_ij = get_qpoints_in_Brillouin_zone(
-            self._rec_lat,
-            self._comm_points[self._ij] / float(N),
-            only_unique=True)
-        for q in qpoints_ij:
-            self._dynmat.set_dynamical_matrix(q)
-            dm = self._dynmat.dynamical_matrix
-            eigvals, eigvecs = np.linalg.eigh(dm)
-            self._eigvals_ij.append(eigvals)
-            self._eigvecs_ij.append(eigvecs)
-            self._phase_ij.append(
-                np.exp(2j * np.pi * np.dot(pos, q)).reshape(-1, 1))
-
-    def _solve_ii(self, T, number_of_snapshots):
+        dms = self._dynmat.get_dynamical_matrices(qpoints_ii)
+        self._eigvals_ii, self._eigvecs_ii = np.linalg.eigh(dms.real)
+        self._phase_ii = np.array(np.cos(2 * np.pi * np.dot(qpoints_ii,
+                                                            pos.T)),
+                                  dtype='double', order='C')
+
+        dtype = "c%d" % (np.dtype('double').itemsize * 2)
+        num_dim = dms.shape[1]
+        if len(self._ij) > 0:
+            qpoints_ij = get_qpoints_in_Brillouin_zone(
+                self._rec_lat,
+                self._comm_points[self._ij] / float(N),
+                only_unique=True)
+            dms = self._dynmat.get_dynamical_matrices(qpoints_ij)
+            self._eigvals_ij, self._eigvecs_ij = np.linalg.eigh(dms)
+            self._phase_ij = np.array(
+                np.exp(2j * np.pi * np.dot(qpoints_ij, pos.T)),
+                dtype=dtype, order='C')
+        else:
+            self._eigvals_ij = np.zeros((0, num_dim), dtype='double')
+            self._eigvecs_ij = np.zeros((0, num_dim, num_dim), dtype=dtype)
+            self._phase_ij = np.zeros((0, len(pos)), dtype=dtype)
+
+    def _set_mode_matrices(self, T):
+        """Eigenvectors multiplied by standard deviations of mode amplitudes
+
+        shape=(q-points, primitive atoms * 3, bands) for ii and ij
+
+        """
+
+        sigma_ii = np.reshape([self._get_sigma(eigvals, T)
+                               for eigvals in self._eigvals_ii],
+                              self._eigvals_ii.shape)
+        sigma_ij = np.reshape([self._get_sigma(eigvals, T)
+                               for eigvals in self._eigvals_ij],
+                              self._eigvals_ij.shape)
+        self._A_ii = np.array(self._eigvecs_ii * sigma_ii[:, None, :],
+                              dtype='double', order='C')
+        self._A_ij = np.array(self._eigvecs_ij * sigma_ij[:, None, :],
+                              dtype=self._eigvecs_ij.dtype, order='C')
+
+    def _get_snapshots(self, snapshot_offset, number_of_snapshots):
         natom = self._dynmat.supercell.get_number_of_atoms()
+        key = (self._seed & 0xffffffff, (self._seed >> 32) & 0xffffffff)
         u = np.zeros((number_of_snapshots, natom, 3), dtype='double')
+        try:
+            import phonopy._phonopy as phonoc
+            phonoc.random_displacements(
+                u,
+                self._A_ii,
+                self._phase_ii,
+                self._A_ij,
+                self._phase_ij,
+                np.array(self._s2pp, dtype='intc'),
+                self._dynmat.supercell.get_masses(),
+                len(self._comm_points),
+                key[0],
+                key[1],
+                snapshot_offset)
+        except ImportError:
+            snapshots = np.arange(snapshot_offset,
+                                  snapshot_offset + number_of_snapshots)
+            N = len(self._comm_points)
+            mass = self._dynmat.supercell.get_masses().reshape(-1, 1)
+            u = self._solve_ii(key, snapshots) + self._solve_ij(key, snapshots)
+            u /= np.sqrt(mass * N)
+        return u
+
+    def _solve_ii(self, key, snapshots):
+        natom = self._dynmat.supercell.get_number_of_atoms()
+        u = np.zeros((len(snapshots), natom, 3), dtype='double')
 
-        for eigvals, eigvecs, phase in zip(
-                self._eigvals_ii, self._eigvecs_ii, self._phase_ii):
-            sigma = self._get_sigma(eigvals, T)
-            dist_func = np.random.randn(
-                number_of_snapshots, len(eigvals)) * sigma
-            u_red = np.dot(dist_func, eigvecs.T).reshape(
-                number_of_snapshots, -1, 3)[:, self._s2pp, :]
-            u += u_red * phase
+        for i, (A, phase) in enumerate(zip(self._A_ii, self._phase_ii)):
+            dist_func = get_normal_random_numbers(
+                A.shape[1], key, snapshots, i)
+            u_red = np.dot(dist_func, A.T).reshape(
+                len(snapshots), -1, 3)[:, self._s2pp, :]
+            u += u_red * phase.reshape(-1, 1)
 
         return u
 
-    def _solve_ij(self, T, number_of_snapshots):
+    def _solve_ij(self, key, snapshots):
         natom = self._dynmat.supercell.get_number_of_atoms()
-        u = np.zeros((number_of_snapshots, natom, 3), dtype='double')
+        u = np.zeros((len(snapshots), natom, 3), dtype='double')
+        num_ii = len(self._A_ii)
 
-        for eigvals, eigvecs, phase in zip(
-                self._eigvals_ij, self._eigvecs_ij, self._phase_ij):
-            sigma = self._get_sigma(eigvals, T)
-            dist_func = sigma * np.random.randn(
-                2, number_of_snapshots, len(eigvals))
-            u_red = np.dot(dist_func, eigvecs.T).reshape(
-                2, number_of_snapshots, -1, 3)[:, :, self._s2pp, :]
-            u += (u_red[0] * phase).real
-            u -= (u_red[1] * phase).imag
+        for i, (A, phase) in enumerate(zip(self._A_ij, self._phase_ij)):
+            num_band = A.shape[1]
+            dist_func = get_normal_random_numbers(
+                num_band * 2, key, snapshots, num_ii + i)
+            dist_func = np.array([dist_func[:, :num_band],
+                                  dist_func[:, num_band:]])
+            u_red = np.dot(dist_func, A.T).reshape(
+                2, len(snapshots), -1, 3)[:, :, self._s2pp, :]
+            u += (u_red[0] * phase.reshape(-1, 1)).real
+            u -= (u_red[1] * phase.reshape(-1, 1)).imag
 
         return u * np.sqrt(2)
 
@@ -221,15 +399,30 @@ class RandomDisplacements(object):
         return sigma
 
     def _categorize_points(self):
+        """Pair commensurate points q and -q
+
+        Integer representations of the points modulo N are hashed into
+        integers, and the partner of each point is found by binary search
+        in the sorted hashes.
+
+        Returns
+        -------
+        ii : ndarray
+            Indices of points with q = -q.
+        ij : ndarray
+            Smaller indices of pairs of q and -q with q != -q.
+
+        """
+
         N = len(self._comm_points)
-        ii = []
-        ij = []
-        for i, p in enumerate(self._comm_points):
-            for j, _p in enumerate(self._comm_points):
-                if ((p + _p) % N == 0).all():
-                    if i == j:
-                        ii.append(i)
-                    elif i < j:
-                        ij.append(i)
-                    break
+        weights = np.array([1, N, N ** 2], dtype='int64')
+        points = np.array(self._comm_points, dtype='int64')
+        keys = np.dot(points % N, weights)
+        keys_minus = np.dot(-points % N, weights)
+        order = np.argsort(keys)
+        partners = order[np.searchsorted(keys[order], keys_minus)]
+        assert (keys[partners] == keys_minus).all()
+        indices = np.arange(N)
+        ii = indices[partners == indices]
+        ij = indices[indices < partners]
         return ii, ij
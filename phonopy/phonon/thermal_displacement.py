@@ -310,8 +310,6 @@ class ThermalDisplacementMatrices(ThermalMotion):
                                      self._ANinv.T)
                     self._disp_matrices_cif[i, j] = mat_cif
 
-        self._get_disp_matrices()
-
     def _get_disp_matrices(self):
         dtype_complex = "c%d" % (np.dtype('double').itemsize * 2)
         disps = np.zeros((len(self._temperatures), len(self._masses),
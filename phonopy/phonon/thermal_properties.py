@@ -61,6 +61,20 @@ def mode_zero(temp, freqs):
     return np.zeros_like(freqs)
 
 
+class FrequenciesOnMesh(object):
+    """Frequencies and weights on mesh in the form of Mesh attributes
+
+    This is used to run ThermalProperties with frequencies that are not
+    computed by Mesh.
+
+    """
+
+    def __init__(self, frequencies, weights):
+        self.frequencies = frequencies
+        self.weights = weights
+        self.eigenvectors = None
+
+
 class ThermalPropertiesBase(object):
     def __init__(self,
                  mesh,
@@ -0,0 +1,249 @@
+# Copyright (C) 2026 Atsushi Togo
+# All rights reserved.
+#
+# This file is part of phonopy.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# * Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in
+#   the documentation and/or other materials provided with the
+#   distribution.
+#
+# * Neither the name of the phonopy project nor the names of its
+#   contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+# ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+import os
+import time
+import json
+import threading
+import functools
+
+try:
+    _timer = time.perf_counter
+except AttributeError:
+    _timer = time.time
+
+_profiler = None
+_started_tracemalloc = False
+
+
+class _NullStage(object):
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        return False
+
+
+_null_stage = _NullStage()
+
+
+class _Stage(object):
+    def __init__(self, profiler, name):
+        self._profiler = profiler
+        self._name = name
+        self._start = None
+        self._mem_start = None
+
+    def __enter__(self):
+        if self._profiler.trace_memory:
+            import tracemalloc
+            self._mem_start = tracemalloc.get_traced_memory()[0]
+        self._start = _timer()
+        return self
+
+    def __exit__(self, *exc):
+        end = _timer()
+        if self._mem_start is None:
+            nbytes = 0
+        else:
+            import tracemalloc
+            nbytes = tracemalloc.get_traced_memory()[0] - self._mem_start
+        self._profiler.add(self._name, self._start, end, nbytes)
+        return False
+
+
+class Profiler(object):
+    """Wall time, call counts, bytes, and threads of named stages
+
+    Stages are recorded by phonopy.profiling.stage when this profiler is
+    enabled by enable_profiling. Times of nested stages are included in
+    those of outer stages.
+
+    Attributes
+    ----------
+    trace_memory : bool
+        Net bytes allocated in stages are measured by tracemalloc. This
+        slows down python code noticeably. This requires python 3.
+
+    """
+
+    def __init__(self, trace_memory=False):
+        self.trace_memory = trace_memory
+        self._lock = threading.Lock()
+        self._origin = _timer()
+        self._stats = {}
+        self._events = []
+
+    def stage(self, name):
+        return _Stage(self, name)
+
+    def add(self, name, start, end, nbytes=0):
+        from phonopy.parallel import get_num_threads
+        num_threads = get_num_threads()
+        tid = threading.current_thread().ident
+        with self._lock:
+            if name not in self._stats:
+                self._stats[name] = {'time': 0.0,
+                                     'count': 0,
+                                     'bytes': 0,
+                                     'num_threads': 0}
+            stat = self._stats[name]
+            stat['time'] += end - start
+            stat['count'] += 1
+            stat['bytes'] += nbytes
+            stat['num_threads'] = max(stat['num_threads'], num_threads)
+            self._events.append((name, start, end, nbytes, num_threads, tid))
+
+    def clear(self):
+        with self._lock:
+            self._origin = _timer()
+            self._stats = {}
+            self._events = []
+
+    def get_stats(self):
+        """Return accumulated values of stages
+
+        Returns
+        -------
+        dict
+            Stage names as keys. Each value is a dict of 'time' (wall time
+            in seconds), 'count' (number of calls), 'bytes' (net bytes
+            allocated, zero without trace_memory), and 'num_threads'
+            (maximum number of OpenMP threads available).
+
+        """
+
+        with self._lock:
+            return dict((k, dict(v)) for k, v in self._stats.items())
+
+    def get_chrome_trace(self):
+        """Return stages as Chrome trace events
+
+        The returned dict can be loaded by chrome://tracing or Perfetto
+        after json serialization.
+
+        """
+
+        pid = os.getpid()
+        with self._lock:
+            events = list(self._events)
+            origin = self._origin
+        trace_events = []
+        for name, start, end, nbytes, num_threads, tid in events:
+            trace_events.append({'name': name,
+                                 'cat': 'phonopy',
+                                 'ph': 'X',
+                                 'ts': (start - origin) * 1e6,
+                                 'dur': (end - start) * 1e6,
+                                 'pid': pid,
+                                 'tid': tid,
+                                 'args': {'bytes': nbytes,
+                                          'num_threads': num_threads}})
+        return {'traceEvents': trace_events, 'displayTimeUnit': 'ms'}
+
+    def write_chrome_trace(self, filename="phonopy_trace.json"):
+        with open(filename, 'w') as w:
+            json.dump(self.get_chrome_trace(), w)
+
+    def show(self):
+        stats = self.get_stats()
+        print("-------------------------- Stages --------------------------")
+        print("%-28s %10s %8s %12s %7s"
+              % ("Name", "Time (s)", "Calls", "Bytes", "Threads"))
+        for name in sorted(stats, key=lambda k: -stats[k]['time']):
+            stat = stats[name]
+            print("%-28s %10.4f %8d %12d %7d"
+                  % (name, stat['time'], stat['count'], stat['bytes'],
+                     stat['num_threads']))
+
+
+def enable_profiling(trace_memory=False):
+    """Start recording stages and return the profiler
+
+    When a profiler is already enabled, it is returned as it is.
+
+    """
+
+    global _profiler, _started_tracemalloc
+    if _profiler is None:
+        _profiler = Profiler(trace_memory=trace_memory)
+        if trace_memory:
+            import tracemalloc
+            if not tracemalloc.is_tracing():
+                tracemalloc.start()
+                _started_tracemalloc = True
+    return _profiler
+
+
+def disable_profiling():
+    """Stop recording stages and return the profiler used"""
+
+    global _profiler, _started_tracemalloc
+    profiler = _profiler
+    _profiler = None
+    if _started_tracemalloc:
+        import tracemalloc
+        tracemalloc.stop()
+        _started_tracemalloc = False
+    return profiler
+
+
+def get_profiler():
+    return _profiler
+
+
+def stage(name):
+    """Context manager to record a named stage
+
+    Nothing is recorded unless profiling is enabled.
+
+    """
+
+    if _profiler is None:
+        return _null_stage
+    return _profiler.stage(name)
+
+
+def profiled(name):
+    """Decorator to record a function call as a named stage"""
+
+    def decorator(func):
+        @functools.wraps(func)
+        def wrapper(*args, **kwargs):
+            if _profiler is None:
+                return func(*args, **kwargs)
+            with _profiler.stage(name):
+                return func(*args, **kwargs)
+        return wrapper
+    return decorator
@@ -34,7 +34,8 @@
 
 import numpy as np
 from phonopy.units import Avogadro, EvTokJmol, EVAngstromToGPa
-from phonopy.qha.eos import get_eos, fit_to_eos
+from phonopy.qha.eos import (get_eos, get_eos_jacobian, fit_to_eos,
+                              fit_to_eos_stacked)
 
 
 class BulkModulus(object):
@@ -119,6 +120,7 @@ class QHA(object):
         self._fe_phonon = np.array(fe_phonon) / EvTokJmol
 
         self._eos = get_eos(eos)
+        self._eos_jacobian = get_eos_jacobian(eos)
         self._t_max = t_max
         self._energy_plot_factor = energy_plot_factor
 
@@ -141,12 +143,25 @@ class QHA(object):
         self._gruneisen_parameters = None
         self._len = None
 
-    def run(self, verbose=False):
+    def run(self, verbose=False, stacked=False):
         """Fit parameters to EOS at temperatures
 
         Even if fitting failed, simply omit the volume point. In this case,
         the failed temperature point doesn't exist in the returned arrays.
 
+        Fitting at each temperature starts from the parameters at the
+        previous temperature.
+
+        Parameters
+        ----------
+        verbose : bool, optional
+            Show fitted parameters. Default is False.
+        stacked : bool, optional
+            Fit at all temperatures at once by Levenberg-Marquardt
+            iterations of stacked normal equations starting from the
+            parameters at the first temperature. Temperatures where it
+            does not converge are fitted one by one. Default is False.
+
         """
 
         if verbose:
@@ -157,22 +172,37 @@ class QHA(object):
         if num_elems > len(self._all_temperatures):
             num_elems -= 1
 
+        if self._electronic_energies.ndim == 1:
+            el_energies = self._electronic_energies
+        else:
+            el_energies = self._electronic_energies[:num_elems]
+        fe_all = self._fe_phonon[:num_elems] + el_energies
+
+        if stacked:
+            stacked_parameters, converged = self._fit_to_eos_stacked(fe_all)
+        else:
+            converged = np.zeros(num_elems, dtype='bool')
+
         temperatures = []
         parameters = []
         free_energies = []
+        ep_prev = None
 
         for i in range(num_elems):  # loop over temperaturs
-            if self._electronic_energies.ndim == 1:
-                el_energy = self._electronic_energies
+            fe = fe_all[i]
+            if converged[i]:
+                ep = stacked_parameters[i]
             else:
-                el_energy = self._electronic_energies[i]
-            fe = [ph_e + el_e
-                  for ph_e, el_e in zip(self._fe_phonon[i], el_energy)]
-
-            try:
-                ep = fit_to_eos(self._volumes, fe, self._eos)
-            except TypeError:
-                print("Fitting failure at T=%.1f" % self._all_temperatures[i])
+                try:
+                    ep = fit_to_eos(self._volumes,
+                                    fe,
+                                    self._eos,
+                                    initial_parameters=ep_prev,
+                                    jacobian=self._eos_jacobian)
+                except TypeError:
+                    print("Fitting failure at T=%.1f" %
+                          self._all_temperatures[i])
+                    ep = None
 
             if ep is None:
                 # Simply omit volume point where the fitting failed.
@@ -183,6 +213,7 @@ class QHA(object):
                 temperatures.append(t)
                 parameters.append(ep)
                 free_energies.append(fe)
+                ep_prev = ep
 
                 if verbose:
                     print(("%14.6f" * 5) %
@@ -780,6 +811,23 @@ class QHA(object):
         ax.set_xlim(self._temperatures[0],
                     self._temperatures[self._len - 1])
 
+    def _fit_to_eos_stacked(self, fe_all):
+        try:
+            ep = fit_to_eos(self._volumes,
+                            fe_all[0],
+                            self._eos,
+                            jacobian=self._eos_jacobian)
+        except TypeError:
+            ep = None
+        if ep is None:
+            ep = [fe_all[0][len(self._volumes) // 2], 1.0, 4.0,
+                  self._volumes[len(self._volumes) // 2]]
+        return fit_to_eos_stacked(self._volumes,
+                                  fe_all,
+                                  self._eos,
+                                  self._eos_jacobian,
+                                  ep)
+
     def _set_thermal_expansion(self):
         beta = [0.]
         for i in range(1, self._num_elems - 1):
@@ -37,13 +37,10 @@ from phonopy.units import Kb
 
 
 def get_free_energy_at_T(tmin, tmax, tstep, eigenvalues, weights, n_electrons):
-    free_energies = []
     efe = ElectronFreeEnergy(eigenvalues, weights, n_electrons)
     temperatures = np.arange(tmin, tmax + 1e-8, tstep)
-    for T in temperatures:
-        efe.run(T)
-        free_energies.append(efe.free_energy)
-    return temperatures, free_energies
+    efe.run_at_temperatures(temperatures)
+    return temperatures, efe.free_energy
 
 
 class ElectronFreeEnergy(object):
@@ -75,16 +72,24 @@ class ElectronFreeEnergy(object):
 
        E_\text{el}(V) = g\sum_i f_i(V) \epsilon_i(V)
 
+    Eigenvalues are sorted once with their weights. Occupation numbers are
+    evaluated only in the window of mu +/- 50 kT, and states below the
+    window are counted as fully occupied by the cumulative sums. Windows
+    at temperatures are treated by chunks whose numbers of temperatures
+    times states in window are bounded, so that memory usage does not
+    grow with number of temperatures at high temperatures.
+
     Attributes
     ----------
-    entropy: float
+    entropy: float or ndarray
         Entropy in eV (T * S).
-    energy: float
+    energy: float or ndarray
         Energy in eV.
-    free_energy: float
+    free_energy: float or ndarray
         energy - entropy in eV.
-    mu: float
+    mu: float or ndarray
         Chemical potential in eV.
+    These are ndarray of shape=(temperatures,) after run_at_temperatures.
 
     """
 
@@ -108,21 +113,34 @@ class ElectronFreeEnergy(object):
 
         """
 
-        # shape=(kpoints, spin, bands)
-        self._eigenvalues = np.array(
-            eigenvalues.swapaxes(0, 1), dtype='double', order='C')
-        self._weights = weights
-        self._n_electrons = n_electrons
-
-        if self._eigenvalues.shape[1] == 1:
+        if eigenvalues.shape[0] == 1:
             self._g = 2
-        elif self._eigenvalues.shape[1] == 2:
+        elif eigenvalues.shape[0] == 2:
             self._g = 1
         else:
             raise RuntimeError
 
-        self._T = None
-        self._f = None
+        self._weights = weights
+        self._n_electrons = n_electrons
+
+        # Sorted eigenvalues of all states and their weights normalized to
+        # give number of electrons.
+        state_weights = np.zeros(eigenvalues.shape, dtype='double')
+        state_weights[:] = (np.array(weights, dtype='double')[None, :, None]
+                            * self._g / np.sum(weights))
+        eigvals = np.array(eigenvalues, dtype='double').ravel()
+        order = np.argsort(eigvals, kind='mergesort')
+        self._eigenvalues = eigvals[order]
+        self._state_weights = state_weights.ravel()[order]
+        self._cumulative_weights = np.zeros(len(eigvals) + 1, dtype='double')
+        self._cumulative_weights[1:] = np.cumsum(self._state_weights)
+        self._cumulative_energies = np.zeros(len(eigvals) + 1,
+                                             dtype='double')
+        self._cumulative_energies[1:] = np.cumsum(
+            self._state_weights * self._eigenvalues)
+        self._window = 50
+        self._max_window_elements = 2 ** 20
+
         self.mu = None
         self.entropy = None
         self.energy = None
@@ -137,59 +155,152 @@ class ElectronFreeEnergy(object):
 
         """
 
-        if T < 1e-10:
-            self._T = 1e-10
-        else:
-            self._T = T * Kb
-        self.mu = self._chemical_potential()
-        self._f = self._occupation_number(self._eigenvalues, self.mu)
-        self.entropy = self._entropy()
-        self.energy = self._energy()
+        self.run_at_temperatures([T])
+        self.mu = self.mu[0]
+        self.entropy = self.entropy[0]
+        self.energy = self.energy[0]
+
+    def run_at_temperatures(self, temperatures):
+        """Chemical potentials, entropies, and energies at temperatures
+
+        Parameters
+        ----------
+        temperatures: array_like
+            Temperatures in K
+            shape=(temperatures,)
+
+        """
+
+        kTs = np.array(temperatures, dtype='double').ravel() * Kb
+        kTs = np.where(kTs < 1e-10 * Kb, 1e-10, kTs)
+        self.mu = self._chemical_potential(kTs)
+        self.entropy = np.zeros_like(kTs)
+        self.energy = np.zeros_like(kTs)
+        for s, idx, w, f, i_min in self._iter_windows(self.mu, kTs):
+            self.entropy[s] = self._entropy(w, f) * kTs[s]
+            self.energy[s] = self._energy(idx, w, f, i_min)
 
     @property
     def free_energy(self):
         return self.energy - self.entropy
 
-    def _entropy(self):
-        S = 0
-        for f_k, w in zip(self._f.reshape(len(self._weights), -1),
-                          self._weights):
-            _f = np.extract((f_k > 1e-12) * (f_k < 1 - 1e-12), f_k)
-            S -= (_f * np.log(_f) + (1 - _f) * np.log(1 - _f)).sum() * w
-        return S * self._g * self._T / self._weights.sum()
-
-    def _energy(self):
-        occ_eigvals = self._f * self._eigenvalues
-        return np.dot(
-            occ_eigvals.reshape(len(self._weights), -1).sum(axis=1),
-            self._weights) * self._g / self._weights.sum()
-
-    def _chemical_potential(self):
-        emin = np.min(self._eigenvalues)
-        emax = np.max(self._eigenvalues)
-        mu = (emin + emax) / 2
+    def _entropy(self, w, f):
+        cond = (f > 1e-12) * (f < 1 - 1e-12)
+        _f = np.where(cond, f, 0.5)
+        S = np.where(cond, _f * np.log(_f) + (1 - _f) * np.log(1 - _f), 0)
+        return -(S * w).sum(axis=1)
+
+    def _energy(self, idx, w, f, i_min):
+        return (self._cumulative_energies[i_min] +
+                (f * w * self._eigenvalues[idx]).sum(axis=1))
+
+    def _chemical_potential(self, kTs):
+        """Solve number of electrons for mu at temperatures
+
+        Newton steps are taken while they stay in the bracket of mu, and
+        otherwise bisection steps are taken.
+
+        """
+
+        emin = np.full_like(kTs, self._eigenvalues[0])
+        emax = np.full_like(kTs, self._eigenvalues[-1])
+        i_F = np.searchsorted(self._cumulative_weights[1:],
+                              self._n_electrons - 1e-10)
+        i_F = min(i_F, len(self._eigenvalues) - 1)
+        mu = np.full_like(kTs, (self._eigenvalues[i_F] +
+                                self._eigenvalues[min(
+                                    i_F + 1, len(self._eigenvalues) - 1)]) / 2)
+        active = np.arange(len(kTs))
 
         for i in range(1000):
-            n = self._number_of_electrons(mu)
-            if abs(n - self._n_electrons) < 1e-10:
+            n, dn = self._number_of_electrons(mu[active], kTs[active])
+            dev = n - self._n_electrons
+            # Converged or bracket shrunk to the floating point resolution
+            done = ((np.abs(dev) < 1e-10) |
+                    (emax[active] - emin[active] <=
+                     1e-15 * np.abs(mu[active])))
+            active, dev, dn = active[~done], dev[~done], dn[~done]
+            if len(active) == 0:
                 break
-            elif (n < self._n_electrons):
-                emin = mu
-            else:
-                emax = mu
-            mu = (emin + emax) / 2
+            emin[active] = np.where(dev < 0, mu[active], emin[active])
+            emax[active] = np.where(dev < 0, emax[active], mu[active])
+            with np.errstate(divide='ignore', invalid='ignore'):
+                mu_newton = mu[active] - dev / dn
+            in_bracket = ((mu_newton > emin[active]) &
+                          (mu_newton < emax[active]))
+            mu[active] = np.where(in_bracket, mu_newton,
+                                  (emin[active] + emax[active]) / 2)
 
         return mu
 
-    def _number_of_electrons(self, mu):
-        eigvals = self._eigenvalues.reshape(len(self._weights), -1)
-        n = np.dot(
-            self._occupation_number(eigvals, mu).sum(axis=1),
-            self._weights) * self._g / self._weights.sum()
-        return n
+    def _number_of_electrons(self, mu, kTs):
+        """Number of electrons and its derivative with respect to mu"""
+        n = np.zeros_like(kTs)
+        dn = np.zeros_like(kTs)
+        for s, _, w, f, i_min in self._iter_windows(mu, kTs):
+            n[s] = self._cumulative_weights[i_min] + (f * w).sum(axis=1)
+            dn[s] = (f * (1 - f) * w).sum(axis=1) / kTs[s]
+        return n, dn
+
+    def _iter_windows(self, mu, kTs):
+        """Yield windows at chunks of temperatures
+
+        Consecutive temperatures are put in a chunk as long as number of
+        temperatures times the largest number of states in window does not
+        exceed _max_window_elements. A chunk has at least one temperature.
+
+        Yields
+        ------
+        s : slice
+            Temperatures in chunk.
+        idx, w, f, i_min
+            See _get_window.
+
+        """
+
+        i_min = np.searchsorted(self._eigenvalues, mu - self._window * kTs)
+        i_max = np.searchsorted(self._eigenvalues, mu + self._window * kTs)
+        widths = np.maximum(i_max - i_min, 1)
+        start = 0
+        while start < len(kTs):
+            end = start + 1
+            width = widths[start]
+            while end < len(kTs):
+                next_width = max(width, widths[end])
+                if next_width * (end + 1 - start) > self._max_window_elements:
+                    break
+                width = next_width
+                end += 1
+            s = slice(start, end)
+            idx, w, f = self._get_window(mu[s], kTs[s], i_min[s], i_max[s])
+            yield s, idx, w, f, i_min[s]
+            start = end
+
+    def _get_window(self, mu, kTs, i_min, i_max):
+        """Occupation numbers of states in mu +/- window * kT
+
+        Returns
+        -------
+        idx : ndarray
+            Indices of states in window padded by zeros.
+            shape=(temperatures, max states in window), dtype=int
+        w : ndarray
+            Weights of states in window. Zero for padding.
+        f : ndarray
+            Occupation numbers of states in window.
+
+        """
+
+        idx = i_min[:, None] + np.arange(max((i_max - i_min).max(), 1))
+        in_window = idx < i_max[:, None]
+        idx = np.where(in_window, idx, 0)
+        w = np.where(in_window, self._state_weights[idx], 0)
+        f = self._occupation_number(self._eigenvalues[idx],
+                                    mu[:, None], kTs[:, None])
+        return idx, w, f
 
-    def _occupation_number(self, e, mu):
-        de = (e - mu) / self._T
+    def _occupation_number(self, e, mu, kT):
+        de = (e - mu) / kT
         de = np.where(de < 100, de, 100.0)  # To avoid overflow
         de = np.where(de > -100, de, -100.0)  # To avoid underflow
         return 1.0 / (1 + np.exp(de))
@@ -82,13 +82,172 @@ def get_eos(eos):
         return vinet
 
 
-def fit_to_eos(volumes, fe, eos):
-    fit = EOSFit(volumes, fe, eos)
-    fit.fit([fe[len(fe) // 2], 1.0, 4.0, volumes[len(volumes) // 2]])
+def get_eos_jacobian(eos):
+    """Return function of derivatives of EOS with respect to parameters
+
+    The returned function f(v, *p) gives an array of shape
+    v.shape + (4, ), whose last axis is for derivatives with respect to
+    E_0, B_0, B'_0 and V_0. v and p are broadcast.
+
+    """
+
+    def birch_murnaghan(v, *p):
+        y = (p[3] / v) ** (2.0 / 3)
+        u = y - 1
+        f = u ** 3 * p[2] + u ** 2 * (6 - 4 * y)
+        df_dy = 3 * u ** 2 * p[2] + 2 * u * (6 - 4 * y) - 4 * u ** 2
+        return np.stack(np.broadcast_arrays(
+            1.0,
+            9.0 / 16 * p[3] * f,
+            9.0 / 16 * p[3] * p[1] * u ** 3,
+            9.0 / 16 * p[1] * (f + 2.0 / 3 * y * df_dy)), axis=-1)
+
+    def murnaghan(v, *p):
+        w = (p[3] / v) ** p[2]
+        bp1 = p[2] - 1
+        return np.stack(np.broadcast_arrays(
+            1.0,
+            v / p[2] * (w / bp1 + 1) - p[3] / bp1,
+            p[1] * v * (w * np.log(p[3] / v) / (p[2] * bp1)
+                        - w * (2 * p[2] - 1) / (p[2] * bp1) ** 2
+                        - 1 / p[2] ** 2) + p[1] * p[3] / bp1 ** 2,
+            p[1] * (v * w / p[3] - 1) / bp1), axis=-1)
+
+    def vinet(v, *p):
+        x = (v / p[3]) ** (1.0 / 3)
+        xi = 3.0 / 2 * (p[2] - 1)
+        z = xi * (1 - x)
+        g = 1 + (z - 1) * np.exp(z)
+        dg_dz = z * np.exp(z)
+        return np.stack(np.broadcast_arrays(
+            1.0,
+            9 * p[3] / xi ** 2 * g,
+            9 * p[1] * p[3] * (-2 / xi ** 3 * g
+                               + dg_dz * (1 - x) / xi ** 2) * 3.0 / 2,
+            9 * p[1] / xi ** 2 * (g + dg_dz * xi * x / 3)), axis=-1)
+
+    if eos == 'murnaghan':
+        return murnaghan
+    elif eos == 'birch_murnaghan':
+        return birch_murnaghan
+    else:
+        return vinet
+
+
+def fit_to_eos(volumes, fe, eos, initial_parameters=None, jacobian=None):
+    """Fit energies to EOS
+
+    Parameters
+    ----------
+    volumes, fe : array_like
+        Volumes and energies.
+    eos : function
+        EOS returned by get_eos.
+    initial_parameters : array_like, optional
+        Initial [E_0, B_0, B'_0, V_0], e.g., the solution at the previous
+        temperature. By default the energy and volume at the middle of the
+        points, B_0=1 and B'_0=4 are used.
+    jacobian : function, optional
+        Derivatives of EOS returned by get_eos_jacobian. By default they
+        are estimated by finite difference.
+
+    """
+
+    fit = EOSFit(volumes, fe, eos, jacobian=jacobian)
+    if initial_parameters is None:
+        fit.fit([fe[len(fe) // 2], 1.0, 4.0, volumes[len(volumes) // 2]])
+    else:
+        fit.fit(initial_parameters)
 
     return fit.parameters
 
 
+def fit_to_eos_stacked(volumes,
+                       energies,
+                       eos,
+                       jacobian,
+                       initial_parameters,
+                       max_iterations=200,
+                       tolerance=1e-12):
+    """Fit sets of energies to EOS at once by Levenberg-Marquardt method
+
+    Normal equations of all sets are solved at once at each iteration
+    with damping adjusted for each set.
+
+    Parameters
+    ----------
+    volumes : array_like
+        Volumes common to all sets. shape=(volumes, )
+    energies : array_like
+        Energies, e.g., free energies at temperatures.
+        shape=(sets, volumes)
+    eos, jacobian : function
+        EOS and its derivatives returned by get_eos and get_eos_jacobian.
+    initial_parameters : array_like
+        Initial parameters for all sets. shape=(4, ) or (sets, 4)
+
+    Returns
+    -------
+    parameters : ndarray
+        [E_0, B_0, B'_0, V_0] of sets. shape=(sets, 4), dtype='double'
+    converged : ndarray
+        Whether fitting of each set converged. shape=(sets, ),
+        dtype='bool'
+
+    """
+
+    v = np.array(volumes, dtype='double')
+    e = np.array(energies, dtype='double')
+    num_sets = len(e)
+    p = np.array(np.broadcast_to(initial_parameters, (num_sets, 4)),
+                 dtype='double')
+    damping = np.full(num_sets, 1e-3)
+    converged = np.zeros(num_sets, dtype='bool')
+    stalled = np.zeros(num_sets, dtype='bool')
+
+    def get_residuals(params, energies):
+        return eos(v, *params.T[:, :, None]) - energies
+
+    with np.errstate(all='ignore'):
+        r = get_residuals(p, e)
+        cost = (r ** 2).sum(axis=1)
+        for _ in range(max_iterations):
+            idx = np.nonzero(~(converged | stalled))[0]
+            if len(idx) == 0:
+                break
+            J = jacobian(v, *p[idx].T[:, :, None])  # (sets, volumes, 4)
+            Jt = J.transpose(0, 2, 1)
+            JtJ = np.matmul(Jt, J)
+            Jtr = np.matmul(Jt, r[idx][:, :, None])[:, :, 0]
+            A = JtJ + (damping[idx, None] *
+                       np.einsum('ijj->ij', JtJ))[:, :, None] * np.eye(4)
+            solvable = np.isfinite(A).all(axis=(1, 2))
+            solvable[solvable] = np.abs(np.linalg.det(A[solvable])) > 0
+            dp = np.zeros_like(Jtr)
+            if solvable.any():
+                dp[solvable] = -np.linalg.solve(
+                    A[solvable], Jtr[solvable][:, :, None])[:, :, 0]
+            p_new = p[idx] + dp
+            r_new = get_residuals(p_new, e[idx])
+            cost_new = (r_new ** 2).sum(axis=1)
+            accept = solvable & np.isfinite(cost_new) & (cost_new <= cost[idx])
+
+            acc = idx[accept]
+            p[acc] = p_new[accept]
+            r[acc] = r_new[accept]
+            cost[acc] = cost_new[accept]
+            damping[acc] /= 10
+            damping[idx[~accept]] *= 10
+
+            small_step = (np.abs(dp) <=
+                          tolerance * (np.abs(p_new) + tolerance)).all(axis=1)
+            converged[idx[solvable & small_step]] = True
+            stalled[idx[~solvable | (damping[idx] > 1e10)]] = True
+
+    converged &= np.isfinite(p).all(axis=1)
+    return p, converged
+
+
 class EOSFit(object):
     """
 
@@ -101,10 +260,11 @@ class EOSFit(object):
 
     """
 
-    def __init__(self, volume, energy, eos):
+    def __init__(self, volume, energy, eos, jacobian=None):
         self._energy = np.array(energy)
         self._volume = np.array(volume)
         self._eos = eos
+        self._jacobian = jacobian
 
         self.parameters = None
 
@@ -125,10 +285,17 @@ class EOSFit(object):
         def residuals(p, eos, v, e):
             return eos(v, *p) - e
 
+        if self._jacobian is None:
+            Dfun = None
+        else:
+            def Dfun(p, eos, v, e):
+                return self._jacobian(v, *p)
+
         try:
             result = leastsq(residuals,
                              initial_parameters,
                              args=(self._eos, self._volume, self._energy),
+                             Dfun=Dfun,
                              full_output=1)
         except RuntimeError:
             logging.exception('Fitting to EOS failed.')
@@ -36,7 +36,8 @@ import numpy as np
 from phonopy.units import THzToEv, Kb, AMU, THz
 from phonopy.structure.brillouin_zone import get_qpoints_in_Brillouin_zone
 from phonopy.phonon.qpoints import QpointsPhonon
-from phonopy.phonon.thermal_displacement import ThermalDisplacements
+from phonopy.phonon.thermal_displacement import ThermalDisplacementMatrices
+from phonopy.phonon.dos import NormalDistribution
 
 
 # D. Waasmaier and A. Kirfel, Acta Cryst. A51, 416 (1995)
@@ -74,12 +75,10 @@ class DynamicStructureFactor(object):
 
     Note
     ----
-    In computation, the heaviest part is the calculation of thermal
-    displacements that is used in Deby-Waller factor. The heavy part
-    of the thermal displacement is computed many times for the same
-    values. Therefore It is possible to improve the performance of
-    dynamic structure factor, but it requires to make
-    ThermalDisplacements keep Q2 values in its instance.
+    Debye-Waller factor is computed from thermal displacement matrices
+    B of atoms as exp(-1/2 (2pi)^2 Q.B.Q). B is computed only once at
+    the temperature when the instance is created, i.e., the loop over
+    the mesh points is not repeated for each Q-point.
 
     Attributes
     ----------
@@ -144,7 +143,6 @@ class DynamicStructureFactor(object):
         self._mesh_phonon = mesh_phonon
         self._dynamical_matrix = mesh_phonon.dynamical_matrix
         self._primitive = self._dynamical_matrix.primitive
-        self._Qpoints = np.array(Qpoints)  # (n_q, 3) array
 
         self._func_AFF = atomic_form_factor_func
         self._b = scattering_lengths
@@ -159,18 +157,18 @@ class DynamicStructureFactor(object):
             self._fmax = freq_max
 
         self._rec_lat = np.linalg.inv(self._primitive.get_cell())
+        self._Qpoints = None
         self.qpoints = None
         self._Gpoints = None
-        self._set_qpoints()  # self.qpoints needed in self._set_phonon()
         self.frequencies = None
         self._eigvecs = None
-        self._set_phonon()
-
+        self.dynamic_structure_factors = None
         self._q_count = 0
-        self._unit_convertion_factor = 1.0 / (AMU * (2 * np.pi * THz) ** 2)
+        self._set_Qpoints(Qpoints)
+        self._disp_matrices = None
+        self._set_thermal_displacement_matrices()
 
-        self.dynamic_structure_factors = np.zeros(self.frequencies.shape,
-                                                  dtype='double', order='C')
+        self._unit_convertion_factor = 1.0 / (AMU * (2 * np.pi * THz) ** 2)
 
     def __iter__(self):
         return self
@@ -189,29 +187,70 @@ class DynamicStructureFactor(object):
             return S
 
     def run(self):
-        for S in self:
-            pass
+        num_Q = len(self._Qpoints)
+        self.dynamic_structure_factors[:] = self._run_at_Qpoints(0, num_Q)
+        self._q_count = 0
 
     def _run_at_Q(self):
-        freqs = self.frequencies[self._q_count]
-        eigvecs = self._eigvecs[self._q_count]
-        Q_cart = np.dot(self._rec_lat, self._Qpoints[self._q_count])
-        Q_length = np.linalg.norm(Q_cart)
-        if Q_length < 1e-8:
-            DW = np.zeros(len(self._primitive.get_number_of_atoms()),
-                          dtype='double')
-        else:
-            _, disps = self._get_thermal_displacements(Q_cart)
-            DW = np.exp(-0.5 * (2 * np.pi * Q_length) ** 2 * disps[0])
-        S = np.zeros(len(freqs), dtype='double')
-        for i, f in enumerate(freqs):
-            if self._fmin < f:
-                F = self._phonon_structure_factor(
-                    Q_cart, self._Gpoints[self._q_count], DW, f, eigvecs[:, i])
-                n = 1.0 / (np.exp(f * THzToEv / (Kb * self._T)) - 1)
-                S[i] = abs(F) ** 2 * (n + 1)
+        i = self._q_count
+        return self._run_at_Qpoints(i, i + 1)[0]
+
+    def _run_at_Qpoints(self, i_start, i_end):
+        """Compute S(Q, nu) of Q-points in range(i_start, i_end) at once"""
+
+        freqs = self.frequencies[i_start:i_end]
+        eigvecs = self._eigvecs[i_start:i_end]
+        G = np.array(self._Gpoints[i_start:i_end], dtype='double', order='C')
+        Q_cart = np.array(np.dot(self._Qpoints[i_start:i_end],
+                                 self._rec_lat.T),
+                          dtype='double', order='C')
+        DW = self._get_Debye_Waller_factors(Q_cart)
+        f = self._get_scattering_factors(Q_cart)
+        S = np.zeros(freqs.shape, dtype='double', order='C')
+
+        try:
+            import phonopy._phonopy as phonoc
+            self._run_c_dsf(S, Q_cart, G, f, DW, freqs, eigvecs)
+        except ImportError:
+            self._run_py_dsf(S, Q_cart, G, f, DW, freqs, eigvecs)
+
         return S * self._unit_convertion_factor
 
+    def _run_c_dsf(self, S, Q_cart, G, f, DW, freqs, eigvecs):
+        import phonopy._phonopy as phonoc
+
+        phonoc.dynamic_structure_factor(
+            S,
+            Q_cart,
+            G,
+            np.array(self._primitive.get_scaled_positions(),
+                     dtype='double', order='C'),
+            np.array(self._primitive.get_masses(), dtype='double'),
+            f,
+            DW,
+            np.array(freqs, dtype='double', order='C'),
+            np.array(eigvecs, dtype='c%d' % (np.dtype('double').itemsize * 2),
+                     order='C'),
+            float(self._T),
+            float(self._fmin),
+            THzToEv)
+
+    def _run_py_dsf(self, S, Q_cart, G, f, DW, freqs, eigvecs):
+        masses = self._primitive.get_masses()
+        pos = self._primitive.get_scaled_positions()
+        phase = np.exp(-2j * np.pi * np.dot(G, pos.T))
+        W = eigvecs.reshape(len(freqs), len(masses), 3, -1)
+        QW = np.einsum('ni,nlib->nlb', Q_cart, W) * 2 * np.pi
+        coef = f / np.sqrt(2 * masses) * DW * phase
+        F2 = abs(np.einsum('nl,nlb->nb', coef, QW)) ** 2
+        condition = freqs > self._fmin
+        fs = freqs[condition]
+        if self._T > 0:
+            n = 1.0 / (np.exp(fs * THzToEv / (Kb * self._T)) - 1)
+        else:
+            n = 0
+        S[condition] = F2[condition] / fs * (n + 1)
+
     def _set_phonon(self):
         qpoints_phonon = QpointsPhonon(self.qpoints,
                                        self._dynamical_matrix,
@@ -219,36 +258,225 @@ class DynamicStructureFactor(object):
         self.frequencies = qpoints_phonon.frequencies
         self._eigvecs = qpoints_phonon.eigenvectors
 
-    def _get_thermal_displacements(self, proj_dir):
-        td = ThermalDisplacements(self._mesh_phonon,
-                                  projection_direction=proj_dir,
-                                  freq_min=self._fmin,
-                                  freq_max=self._fmax)
+    def _set_thermal_displacement_matrices(self):
+        td = ThermalDisplacementMatrices(self._mesh_phonon,
+                                         freq_min=self._fmin,
+                                         freq_max=self._fmax)
         td.set_temperatures([self._T])
         td.run()
-        return td.get_thermal_displacements()
+        self._disp_matrices = td.thermal_displacement_matrices[0]
+
+    def _get_Debye_Waller_factors(self, Q_cart):
+        """Return Debye-Waller factors of atoms at Q-points
+
+        exp(-1/2 <|2pi Q.u|^2>) = exp(-1/2 (2pi)^2 Q.B.Q)
 
-    def _phonon_structure_factor(self, Q_cart, G, DW, freq, eigvec):
+        """
+        QBQ = np.einsum('ni,lij,nj->nl', Q_cart, self._disp_matrices, Q_cart)
+        return np.exp(-0.5 * (2 * np.pi) ** 2 * QBQ)
+
+    def _get_scattering_factors(self, Q_cart):
+        """Return atomic form factors or scattering lengths at Q-points
+
+        Atomic form factor is evaluated only once for each pair of
+        Q-point and chemical species.
+
+        """
         symbols = self._primitive.get_chemical_symbols()
-        masses = self._primitive.get_masses()
-        pos = self._primitive.get_scaled_positions()
-        phase = np.exp(-2j * np.pi * np.dot(pos, G))
-        W = eigvec.reshape(-1, 3)
-        val = 0
-        for i, m in enumerate(masses):
-            if self._func_AFF is not None:
-                f = self._func_AFF(symbols[i], np.linalg.norm(Q_cart))
-            elif self._b is not None:
-                f = self._b[symbols[i]]
-            else:
-                raise RuntimeError
-            QW = np.dot(Q_cart, W[i]) * 2 * np.pi
-            val += f / np.sqrt(2 * m) * DW[i] * QW * phase[i]
-        val /= np.sqrt(freq)
-        return val
+        f = np.zeros((len(Q_cart), len(symbols)), dtype='double', order='C')
+        if self._func_AFF is not None:
+            Q_lengths = np.linalg.norm(Q_cart, axis=1)
+            for s in set(symbols):
+                indices = [i for i, x in enumerate(symbols) if x == s]
+                f[:, indices] = np.array(
+                    [self._func_AFF(s, Q) for Q in Q_lengths])[:, None]
+        elif self._b is not None:
+            f[:] = [self._b[s] for s in symbols]
+        else:
+            raise RuntimeError
+        return f
+
+    def _set_Qpoints(self, Qpoints):
+        self._Qpoints = np.array(Qpoints)  # (n_q, 3) array
+        self._set_qpoints()  # self.qpoints needed in self._set_phonon()
+        self._set_phonon()
+        self._q_count = 0
+        self.dynamic_structure_factors = np.zeros(self.frequencies.shape,
+                                                  dtype='double', order='C')
 
     def _set_qpoints(self):
         qpoints = get_qpoints_in_Brillouin_zone(self._rec_lat, self._Qpoints)
         self.qpoints = np.array([q[0] for q in qpoints],
                                 dtype='double', order='C')
         self._Gpoints = self._Qpoints - self.qpoints
+
+
+class DynamicStructureFactorMap(object):
+    """Calculate S(Q, omega) map on a grid of Q-points
+
+    Q-points are processed chunk by chunk. For each chunk, phonons are
+    solved, one-phonon dynamic structure factors are computed by
+    DynamicStructureFactor, and the intensities are accumulated on
+    frequency points either by histogram or by convolution with
+    Gaussian resolution function. When filename is given, the map is
+    written to the HDF5 file chunk by chunk and is not kept in memory.
+
+    Attributes
+    ----------
+    Qpoints: ndarray
+        Q-points in reduced coordinates. The grid shape given at
+        initialization is kept.
+        dtype='double'
+        shape=grid_shape + (3,)
+    frequency_points: ndarray
+        Frequency points in THz.
+        dtype='double'
+        shape=(frequency_points,)
+    dynamic_structure_factor_map: ndarray or None
+        S(Q, omega) in the same unit as
+        DynamicStructureFactor.dynamic_structure_factors per THz. None
+        when the map is written to a file.
+        dtype='double'
+        shape=grid_shape + (frequency_points,)
+
+    """
+
+    def __init__(self,
+                 mesh_phonon,
+                 Qpoints,
+                 T,
+                 frequency_points,
+                 sigma=None,
+                 atomic_form_factor_func=None,
+                 scattering_lengths=None,
+                 freq_min=None,
+                 freq_max=None,
+                 chunk_size=100,
+                 filename=None):
+        """
+
+        Parameters
+        ----------
+        mesh_phonon: Mesh or IterMesh
+            Mesh phonon instance that is ready to get frequencies and
+            eigenvectors.
+        Qpoints: array_like
+            Q-points in any Brillouin zone, e.g., a slice (n1, n2, 3) or a
+            volume (n1, n2, n3, 3) in reciprocal space.
+            dtype='double'
+            shape=grid_shape + (3,)
+        T: float
+            Temperature in K.
+        frequency_points: array_like
+            Frequency points in THz where S(Q, omega) is sampled. They
+            have to be equally spaced when sigma is None.
+            dtype='double'
+            shape=(frequency_points,)
+        sigma: float, function object, or None
+            Standard deviation of Gaussian resolution function in THz. A
+            function that receives an array of phonon frequencies and
+            returns the widths at those frequencies can be given for
+            instrument specific resolution. With None, intensities are
+            accumulated by histogram whose bins are centred at frequency
+            points.
+        atomic_form_factor_func, scattering_lengths, freq_min, freq_max:
+            See DynamicStructureFactor.
+        chunk_size: int
+            Number of Q-points treated at once.
+        filename: str or None
+            HDF5 filename to which S(Q, omega) is written.
+
+        """
+
+        self._mesh_phonon = mesh_phonon
+        Qpoints = np.array(Qpoints, dtype='double')
+        self._grid_shape = Qpoints.shape[:-1]
+        self._Qpoints = Qpoints
+        self._T = T
+        self._frequency_points = np.array(frequency_points, dtype='double')
+        self._sigma = sigma
+        self._func_AFF = atomic_form_factor_func
+        self._b = scattering_lengths
+        self._fmin = freq_min
+        self._fmax = freq_max
+        self._chunk_size = chunk_size
+        self._filename = filename
+        self._sqw = None
+
+    @property
+    def Qpoints(self):
+        return self._Qpoints
+
+    @property
+    def frequency_points(self):
+        return self._frequency_points
+
+    @property
+    def dynamic_structure_factor_map(self):
+        return self._sqw
+
+    def run(self):
+        Qpoints = self._Qpoints.reshape(-1, 3)
+        num_Q = len(Qpoints)
+        num_freq = len(self._frequency_points)
+
+        if self._filename is None:
+            self._sqw = np.zeros((num_Q, num_freq), dtype='double', order='C')
+            self._run_chunks(Qpoints, self._sqw)
+            self._sqw = self._sqw.reshape(self._grid_shape + (num_freq, ))
+        else:
+            import h5py
+            with h5py.File(self._filename, 'w') as w:
+                w.create_dataset('temperature', data=self._T)
+                w.create_dataset('grid_shape', data=self._grid_shape)
+                w.create_dataset('qpoint', data=Qpoints)
+                w.create_dataset('frequency_point',
+                                 data=self._frequency_points)
+                sqw = w.create_dataset(
+                    'dynamic_structure_factor',
+                    (num_Q, num_freq),
+                    dtype='double',
+                    chunks=(min(self._chunk_size, num_Q), num_freq))
+                self._run_chunks(Qpoints, sqw)
+
+    def _run_chunks(self, Qpoints, sqw):
+        dsf = None
+        for i in range(0, len(Qpoints), self._chunk_size):
+            Q_chunk = Qpoints[i:(i + self._chunk_size)]
+            if dsf is None:
+                dsf = DynamicStructureFactor(
+                    self._mesh_phonon,
+                    Q_chunk,
+                    self._T,
+                    atomic_form_factor_func=self._func_AFF,
+                    scattering_lengths=self._b,
+                    freq_min=self._fmin,
+                    freq_max=self._fmax)
+            else:
+                dsf._set_Qpoints(Q_chunk)
+            dsf.run()
+            sqw[i:(i + len(Q_chunk))] = self._get_spectra(
+                dsf.frequencies, dsf.dynamic_structure_factors)
+
+    def _get_spectra(self, freqs, S):
+        fpts = self._frequency_points
+        spectra = np.zeros((len(freqs), len(fpts)), dtype='double')
+        if self._sigma is None:
+            df = fpts[1] - fpts[0]
+            indices = np.rint((freqs - fpts[0]) / df).astype(int)
+            condition = (indices >= 0) * (indices < len(fpts))
+            rows = np.repeat(np.arange(len(freqs)), freqs.shape[1]).reshape(
+                freqs.shape)
+            np.add.at(spectra,
+                      (rows[condition], indices[condition]),
+                      S[condition] / df)
+        else:
+            if callable(self._sigma):
+                sigmas = np.array(self._sigma(freqs), dtype='double')
+            else:
+                sigmas = np.full(freqs.shape, self._sigma, dtype='double')
+            for f, sigma, S_band in zip(freqs.T, sigmas.T, S.T):
+                dist = NormalDistribution(sigma[:, None])
+                spectra += S_band[:, None] * dist.calc(fpts[None, :] -
+                                                       f[:, None])
+        return spectra
@@ -0,0 +1,350 @@
+# Copyright (C) 2026 Atsushi Togo
+# All rights reserved.
+#
+# This file is part of phonopy.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# * Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in
+#   the documentation and/or other materials provided with the
+#   distribution.
+#
+# * Neither the name of the phonopy project nor the names of its
+#   contributors may be used to endorse or promote products derived
+#   from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+# ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+import numpy as np
+from phonopy.units import VaspToTHz
+from phonopy.phonon.qpoints import QpointsPhonon
+from phonopy.spectrum.velocity import VelocityQpoints
+from phonopy.harmonic.dynmat_to_fc import get_commensurate_points
+
+
+def lorentzian(x, area, x0, gamma):
+    """Lorentzian function normalized to area with FWHM of gamma"""
+    return area / np.pi * (gamma / 2) / ((x - x0) ** 2 + (gamma / 2) ** 2)
+
+
+class SpectralEnergyDensity(object):
+    """Phonon spectral energy density projected on harmonic eigenmodes
+
+    Mass-weighted velocities (and optionally displacements) of a MD
+    trajectory in supercell are transformed to commensurate q-points
+    and projected onto phonon eigenvectors of the dynamical matrix. The
+    power spectra of the mode amplitudes are computed by FFT with Welch
+    averaging over Hann-windowed segments overlapping by half, and
+    the contributions at +omega and -omega are summed up.
+
+    By fitting Lorentzians to the spectra, peak frequencies and
+    linewidths (FWHM) are obtained, which give anharmonic frequency
+    shifts and phonon lifetimes tau = 1 / (2 pi linewidth).
+
+    Attributes
+    ----------
+    qpoints: ndarray
+        q-points in reduced coordinates.
+        dtype='double'
+        shape=(qpoints, 3)
+    frequencies: ndarray
+        Harmonic phonon frequencies in THz.
+        dtype='double'
+        shape=(qpoints, bands)
+    frequency_points: ndarray
+        Frequency points of spectra in THz.
+        dtype='double'
+        shape=(frequency_points,)
+    spectral_energy_density: ndarray
+        Mode projected spectral energy density in AMU Angstrom^2 / ps^2 /
+        THz.
+        dtype='double'
+        shape=(qpoints, bands, frequency_points)
+    peak_frequencies, linewidths, lifetimes: ndarray
+        Results of Lorentzian fitting in THz, THz, and ps. NaN is stored
+        when fitting failed or mode frequency is below cutoff frequency.
+        dtype='double'
+        shape=(qpoints, bands)
+
+    """
+
+    def __init__(self,
+                 dynamical_matrix,
+                 supercell,
+                 velocities,
+                 timestep,
+                 displacements=None,
+                 qpoints=None,
+                 factor=VaspToTHz):
+        """
+
+        Parameters
+        ----------
+        dynamical_matrix: DynamicalMatrix
+            Dynamical matrix whose supercell is that of the MD.
+        supercell: PhonopyAtoms
+            Supercell of the MD.
+        velocities: array_like
+            Velocities in m/s. An array-like object that supports slicing,
+            e.g., h5py dataset, can be given.
+            shape=(time steps, supercell atoms, 3)
+        timestep: float
+            Time step in femtosecond.
+        displacements: array_like, optional
+            Atomic displacements from the equilibrium positions in
+            Angstrom. When given, potential energy part is included.
+            shape=(time steps, supercell atoms, 3)
+        qpoints: array_like, optional
+            q-points in reduced coordinates. They have to be commensurate
+            with the supercell. Default is all commensurate points.
+            shape=(qpoints, 3)
+        factor: float
+            Unit conversion factor of phonon frequency to THz.
+
+        """
+
+        self._dynamical_matrix = dynamical_matrix
+        self._primitive = dynamical_matrix.primitive
+        self._supercell = supercell
+        self._velocities = velocities
+        self._displacements = displacements
+        self._timestep = timestep
+        self._factor = factor
+
+        if qpoints is None:
+            smat = np.rint(np.linalg.inv(
+                self._primitive.get_primitive_matrix())).astype('intc')
+            self._qpoints = get_commensurate_points(smat)
+        else:
+            self._qpoints = np.array(qpoints, dtype='double', order='C')
+
+        self._frequencies = None
+        self._eigenvectors = None
+        self._frequency_points = None
+        self._sed = None
+        self._peak_frequencies = None
+        self._linewidths = None
+
+    @property
+    def qpoints(self):
+        return self._qpoints
+
+    @property
+    def frequencies(self):
+        return self._frequencies
+
+    @property
+    def frequency_points(self):
+        return self._frequency_points
+
+    @property
+    def spectral_energy_density(self):
+        return self._sed
+
+    @property
+    def peak_frequencies(self):
+        return self._peak_frequencies
+
+    @property
+    def frequency_shifts(self):
+        return self._peak_frequencies - self._frequencies
+
+    @property
+    def linewidths(self):
+        return self._linewidths
+
+    @property
+    def lifetimes(self):
+        return 1.0 / (2 * np.pi * self._linewidths)
+
+    def run(self,
+            num_frequency_points,
+            chunk_size=None,
+            qpoint_chunk_size=None,
+            num_workers=None):
+        """Compute spectral energy density
+
+        Parameters
+        ----------
+        num_frequency_points: int
+            Number of frequency points from zero. Length of FFT segments is
+            twice of this number, which determines frequency resolution
+            1 / (2 * num_frequency_points * timestep).
+        chunk_size: int, optional
+            Number of time steps read from velocities at once.
+        qpoint_chunk_size: int, optional
+            Number of q-points treated at once. Memory usage is
+            proportional to this number times number of time steps.
+            Default is 1.
+        num_workers: int, optional
+            Number of threads to treat chunks of q-points in parallel.
+            FFT and matrix products release GIL. Default is 1.
+
+        """
+
+        qpoints_phonon = QpointsPhonon(self._qpoints,
+                                       self._dynamical_matrix,
+                                       with_eigenvectors=True,
+                                       factor=self._factor)
+        self._frequencies = qpoints_phonon.frequencies
+        self._eigenvectors = qpoints_phonon.eigenvectors
+
+        n_seg = num_frequency_points * 2
+        if len(self._velocities) < n_seg:
+            msg = "Number of time steps is smaller than FFT segment length."
+            raise RuntimeError(msg)
+        self._frequency_points = (np.arange(num_frequency_points) /
+                                  (n_seg * self._timestep * 1e-3))
+        num_band = self._frequencies.shape[1]
+        self._sed = np.zeros(
+            (len(self._qpoints), num_band, num_frequency_points),
+            dtype='double', order='C')
+
+        if qpoint_chunk_size is None:
+            qpoint_chunk_size = 1
+        chunks = [np.arange(i, min(i + qpoint_chunk_size, len(self._qpoints)))
+                  for i in range(0, len(self._qpoints), qpoint_chunk_size)]
+
+        def run_chunk(q_indices):
+            self._sed[q_indices] = self._get_spectra(
+                q_indices, n_seg, chunk_size)
+
+        if num_workers is None or num_workers < 2:
+            for q_indices in chunks:
+                run_chunk(q_indices)
+        else:
+            from phonopy.parallel import thread_pool
+            with thread_pool(num_workers) as executor:
+                list(executor.map(run_chunk, chunks))
+
+    def fit_lorentzians(self, cutoff_frequency=0.1):
+        """Fit Lorentzians to spectral energy density of each mode
+
+        Fitting range is the peak position plus/minus five times of
+        the half width at half maximum estimated from the spectrum.
+
+        Parameters
+        ----------
+        cutoff_frequency: float
+            Modes whose harmonic frequencies are below this value in THz
+            are not fitted.
+
+        """
+
+        from scipy.optimize import curve_fit
+
+        fpts = self._frequency_points
+        df = fpts[1] - fpts[0]
+        self._peak_frequencies = np.full(self._frequencies.shape, np.nan)
+        self._linewidths = np.full(self._frequencies.shape, np.nan)
+        for i, j in np.ndindex(self._frequencies.shape):
+            if self._frequencies[i, j] < cutoff_frequency:
+                continue
+            spectrum = self._sed[i, j]
+            i_max = np.argmax(spectrum)
+            half = spectrum[i_max] / 2
+            i_l = i_max
+            while i_l > 0 and spectrum[i_l] > half:
+                i_l -= 1
+            i_r = i_max
+            while i_r < len(spectrum) - 1 and spectrum[i_r] > half:
+                i_r += 1
+            gamma = max((i_r - i_l) * df, df)
+            condition = abs(fpts - fpts[i_max]) < max(2.5 * gamma, 3 * df)
+            p0 = (spectrum.sum() * df, fpts[i_max], gamma)
+            try:
+                popt, _ = curve_fit(lorentzian,
+                                    fpts[condition],
+                                    spectrum[condition],
+                                    p0=p0)
+            except (RuntimeError, TypeError, ValueError):
+                continue
+            self._peak_frequencies[i, j] = popt[1]
+            self._linewidths[i, j] = abs(popt[2])
+
+    def _get_spectra(self, q_indices, n_seg, chunk_size):
+        qpoints = self._qpoints[q_indices]
+        eigvecs = self._eigenvectors[q_indices]
+        # Angstrom/ps
+        q_dot = self._project(self._velocities, qpoints, eigvecs,
+                              chunk_size) * 1e-2
+        sed = self._get_power_spectra(q_dot, n_seg) / 2
+        if self._displacements is not None:
+            q_disp = self._project(self._displacements, qpoints, eigvecs,
+                                   chunk_size)
+            omega2 = (self._frequencies[q_indices] * 2 * np.pi) ** 2
+            sed += (self._get_power_spectra(q_disp, n_seg) *
+                    omega2[:, :, None] / 2)
+        return sed
+
+    def _project(self, v, qpoints, eigvecs, chunk_size):
+        """Mode amplitudes of mass-weighted v at q-points
+
+        Returns
+        -------
+        ndarray
+            dtype=complex
+            shape=(time steps, qpoints, bands)
+
+        """
+
+        vq = VelocityQpoints(self._supercell, self._primitive, v)
+        vq.set_qpoints(qpoints)
+        vq.run(chunk_size=chunk_size)
+        v_q = vq.get_velocities()  # [timestep, p_atom, qpoints, 3]
+
+        # VelocityQpoints uses relative vectors from primitive cell atoms.
+        # Phase factors by their positions are multiplied to be consistent
+        # with the phase convention of the dynamical matrix.
+        p2s = self._primitive.get_primitive_to_supercell_map()
+        pos = np.dot(self._supercell.get_positions()[p2s],
+                     np.linalg.inv(self._primitive.get_cell()))
+        phases = np.exp(-2j * np.pi * np.dot(pos, qpoints.T))
+        masses = self._primitive.get_masses()
+        num_cells = (self._supercell.get_number_of_atoms() //
+                     self._primitive.get_number_of_atoms())
+        v_q *= (np.sqrt(masses)[:, None] * phases)[None, :, :, None]
+        v_q /= np.sqrt(num_cells)
+        W = eigvecs.reshape(len(qpoints), len(masses), 3, -1).conj()
+        return np.einsum('tpqa,qpab->tqb', v_q, W)
+
+    def _get_power_spectra(self, x, n_seg):
+        """Welch averaged power spectra folded to non-negative frequencies
+
+        Returns
+        -------
+        ndarray
+            dtype='double'
+            shape=(qpoints, bands, n_seg // 2)
+
+        """
+
+        step = n_seg // 2
+        window = np.hanning(n_seg)
+        starts = range(0, len(x) - n_seg + 1, step)
+        ps = np.zeros((n_seg, ) + x.shape[1:], dtype='double')
+        for i in starts:
+            X = np.fft.fft(x[i:(i + n_seg)] * window[:, None, None], axis=0)
+            ps += abs(X) ** 2
+        ps *= self._timestep * 1e-3 / ((window ** 2).sum() * len(starts))
+        n_f = n_seg // 2
+        folded = ps[:n_f].copy()
+        folded[1:] += ps[:-n_f:-1]
+        return folded.transpose(1, 2, 0)
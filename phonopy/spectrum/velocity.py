@@ -87,12 +87,20 @@ class VelocityQpoints(object):
 
         self._velocities_q = None # [timestep, p_atom, qpoitns, 3]
 
-    def run(self):
-        num_s = self._supercell.get_number_of_atoms()
-        num_p = self._primitive.get_number_of_atoms()
-        N = num_s / num_p
-        v = self._velocities
-        self._velocities_q = self._transform(self._qpoints)
+    def run(self, chunk_size=None):
+        """Transform velocities to those at q-points
+
+        Parameters
+        ----------
+        chunk_size: int, optional
+            Number of time steps transformed at once. Velocities may be
+            given by an array-like object that supports slicing, e.g.,
+            h5py dataset, then only this number of time steps are read
+            into memory at a time. Default is None, all at once.
+
+        """
+        self._velocities_q = self._transform(self._qpoints,
+                                             chunk_size=chunk_size)
 
     def get_velocities(self):
         return self._velocities_q
@@ -117,32 +125,53 @@ class VelocityQpoints(object):
     def get_qpoints(self):
         return self._qpoints, self._weights
 
-    def _transform(self, q):
-        """ exp(i q.r(i)) v(i)"""
+    def _transform(self, q, chunk_size=None):
+        """ exp(i q.r(i)) v(i)
+
+        Phase factors are tabulated once for each primitive atom as a
+        matrix of shape (q-points, supercell atoms) and are applied to
+        velocities of a chunk of time steps by a matrix product.
+
+        """
 
         s2p = self._primitive.get_supercell_to_primitive_map()
         p2s = self._primitive.get_primitive_to_supercell_map()
 
-        num_s = self._supercell.get_number_of_atoms()
         num_p = self._primitive.get_number_of_atoms()
         v = self._velocities
+        num_steps = len(v)
+        if chunk_size is None:
+            chunk_size = num_steps
 
         q_array = np.reshape(q, (-1, 3))
         dtype = "c%d" % (np.dtype('double').itemsize * 2)
-        v_q = np.zeros((v.shape[0], num_p, len(q_array), 3), dtype=dtype)
-
-        for p_i, s_i in enumerate(p2s):
-            for s_j, s2p_j in enumerate(s2p):
-                if s2p_j == s_i:
-                    for q_i, pf in enumerate(
-                            self._get_phase_factor(p_i, s_j, q_array)):
-                        v_q[:, p_i, q_i, :] += pf * v[:, s_j, :]
+        v_q = np.zeros((num_steps, num_p, len(q_array), 3), dtype=dtype)
+
+        atom_lists = [np.where(s2p == s_i)[0] for s_i in p2s]
+        phase_factors = [self._get_phase_factors(p_i, s_js, q_array)
+                         for p_i, s_js in enumerate(atom_lists)]
+
+        for i in range(0, num_steps, chunk_size):
+            v_chunk = np.array(v[i:(i + chunk_size)])
+            n_t = len(v_chunk)
+            for p_i, (s_js, pf) in enumerate(zip(atom_lists, phase_factors)):
+                v_s = v_chunk[:, s_js, :].transpose(1, 0, 2).reshape(
+                    len(s_js), -1)
+                if np.iscomplexobj(v_s):
+                    v_p = np.dot(pf, v_s)
+                else:
+                    v_p = np.dot(pf.real, v_s) + 1j * np.dot(pf.imag, v_s)
+                v_q[i:(i + n_t), p_i] = v_p.reshape(
+                    len(q_array), n_t, 3).transpose(1, 0, 2)
         return v_q
 
-    def _get_phase_factor(self, p_i, s_j, q_array):
-        multi = self._multiplicity[s_j, p_i]
-        pos = self._shortest_vectors[s_j, p_i, :multi]
-        return np.exp(-2j * np.pi * np.dot(q_array, pos.T)).sum(axis=1) / multi
+    def _get_phase_factors(self, p_i, s_js, q_array):
+        multi = self._multiplicity[s_js, p_i]
+        max_multi = multi.max()
+        pos = self._shortest_vectors[s_js, p_i, :max_multi]
+        phases = np.exp(-2j * np.pi * np.dot(pos, q_array.T))
+        phases[np.arange(max_multi)[None, :] >= multi[:, None]] = 0
+        return (phases.sum(axis=1) / multi[:, None]).T
 
 
 class AutoCorrelation(object):
@@ -157,7 +186,29 @@ class AutoCorrelation(object):
         self._vv = None
         self._n_elements = 0
 
-    def run(self, num_frequency_points, verbose=False):
+    def run(self, num_frequency_points, block_length=None, verbose=False):
+        """Calculate velocity autocorrelation function
+
+        The autocorrelation is computed through FFT with zero padding
+        (Wiener-Khinchin theorem), i.e., O(n log n) with respect to the
+        number of time steps. Lags from -num_frequency_points to
+        num_frequency_points - 1 are stored in FFT order, i.e., lag k is
+        found at index k % (2 * num_frequency_points).
+
+        Parameters
+        ----------
+        num_frequency_points: int
+            Half of the number of lags.
+        block_length: int, optional
+            When given, the trajectory is processed by overlapping blocks
+            of this number of time steps. Neighbouring blocks overlap by
+            the number of lags and their contributions are summed up, so
+            the result is identical to that without blocks while memory
+            usage is bounded by the block length. Velocities may then be
+            given by an array-like object that supports slicing, e.g.,
+            h5py dataset. Default is None, processing all at once.
+
+        """
         v = self._velocities
         max_lag = num_frequency_points * 2
         n_elem = len(v) - max_lag
@@ -165,24 +216,21 @@ class AutoCorrelation(object):
         if n_elem < 1:
             return False
 
-        vv = np.zeros((max_lag,) + v.shape[1:], dtype=v.dtype, order='C')
-
-        if np.iscomplexobj(vv):
-            v_c = v.conj()
+        if block_length is None:
+            block_n_elem = n_elem
+        else:
+            block_n_elem = max(block_length - max_lag, 1)
 
-        # Here is the bottle neck.
-        d = max_lag / 2
-        for i in range(max_lag):
+        vv = np.zeros((max_lag,) + v.shape[1:], dtype=v.dtype, order='C')
+        starts = range(0, n_elem, block_n_elem)
+        for count, i in enumerate(starts):
             if verbose:
-                if (i + 1) % (max_lag // 100) == 0:
-                    sys.stdout.write("\r%d%%" % (((i + 1) * 100) // max_lag))
-                    sys.stdout.flush()
-            if np.iscomplexobj(vv):
-                vv[i - d] = (v[d:(d + n_elem)] *
-                             v_c[i:(i + n_elem)]).sum(axis=0)
-            else:
-                vv[i - d] = (v[d:(d + n_elem)] *
-                             v[i:(i + n_elem)]).sum(axis=0)
+                sys.stdout.write("\r%d%%" % (((count + 1) * 100) //
+                                              len(starts)))
+                sys.stdout.flush()
+            n = min(block_n_elem, n_elem - i)
+            vv += self._get_autocorrelation_of_block(
+                np.array(v[i:(i + n + max_lag)]), max_lag)
         if verbose:
             sys.stdout.write("\r    \n")
             sys.stdout.flush()
@@ -196,6 +244,26 @@ class AutoCorrelation(object):
 
         return True
 
+    def _get_autocorrelation_of_block(self, v, max_lag):
+        """sum_t v(t) v*(t + lag) for d <= t < len(v) - d, -d <= lag < d"""
+
+        d = max_lag // 2
+        n_elem = len(v) - max_lag
+        n_fft = 2 ** int(np.ceil(np.log2(len(v)))) * 2
+        v_part = np.zeros_like(v)
+        v_part[d:(d + n_elem)] = v[d:(d + n_elem)]
+
+        if np.iscomplexobj(v):
+            X = np.fft.fft(v_part, n=n_fft, axis=0)
+            Y = np.fft.fft(v, n=n_fft, axis=0)
+            c = np.fft.ifft(X.conj() * Y, axis=0).conj()
+        else:
+            X = np.fft.rfft(v_part, n=n_fft, axis=0)
+            Y = np.fft.rfft(v, n=n_fft, axis=0)
+            c = np.fft.irfft(X.conj() * Y, n=n_fft, axis=0)
+
+        return np.concatenate((c[:d], c[(n_fft - d):]), axis=0)
+
     def get_autocorrelation(self):
         return self._vv
 
@@ -71,6 +71,7 @@ class Symmetry(object):
         self._independent_atoms = None
         self._set_independent_atoms()
         self._map_operations = None
+        self._site_symmetry_masks = None
 
     def get_symmetry_operations(self):
         return self._symmetry_operations
@@ -123,6 +124,36 @@ class Symmetry(object):
                                        translations,
                                        self._symprec)
 
+    def get_site_symmetry_masks(self):
+        """Return site-symmetry operations of independent atoms as masks
+
+        Site symmetries of all independent atoms are computed in one pass
+        and cached. See get_site_symmetry.
+
+        Returns
+        -------
+        ndarray
+            True if the symmetry operation leaves the atom invariant.
+            shape=(independent_atoms, symmetry operations), dtype=bool
+
+        """
+
+        if self._site_symmetry_masks is None:
+            positions = self._cell.get_scaled_positions()[
+                self._independent_atoms]
+            lattice = self._cell.get_cell()
+            rotations = self._symmetry_operations['rotations']
+            translations = self._symmetry_operations['translations']
+            # shape=(operations, atoms, 3)
+            rot_pos = (np.einsum('ijk,lk->ilj', rotations, positions)
+                       + translations[:, None, :])
+            diff = positions[None, :, :] - rot_pos
+            diff -= np.rint(diff)
+            dist = np.linalg.norm(np.dot(diff, lattice), axis=2)
+            self._site_symmetry_masks = np.array(dist.T < self._symprec,
+                                                 dtype='bool', order='C')
+        return self._site_symmetry_masks
+
     def get_symmetry_tolerance(self):
         return self._symprec
 
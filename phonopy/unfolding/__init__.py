@@ -32,4 +32,4 @@
 # ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 # POSSIBILITY OF SUCH DAMAGE.
 
-from phonopy.unfolding.core import Unfolding
+from phonopy.unfolding.core import Unfolding, UnfoldedSpectralFunction
@@ -108,23 +108,30 @@ class Unfolding(object):
         self._atom_mapping = None
         self._index_map_inv = None
         self._set_index_map(atom_mapping)
+        self._phases = None  # exp(2pi i j.G) for each q-point
 
     def __iter__(self):
         return self
 
     def run(self, verbose=False):
+        """Compute unfolding weights at all q-points at once"""
+
         self.prepare()
-        for x in self:
-            if verbose:
-                print(self._q_count)
+        num_qpoints = len(self._eigvecs)
+        self._unfolding_weights[:] = self._get_unfolding_weights(
+            0, num_qpoints)
+        self._q_count = num_qpoints
+        if verbose:
+            print(self._q_count)
 
     def __next__(self):
         if self._q_count == len(self._eigvecs):
             raise StopIteration
 
-        self._unfolding_weights[self._q_count] = self._get_unfolding_weights()
+        i = self._q_count
+        self._unfolding_weights[i] = self._get_unfolding_weights(i, i + 1)[0]
         self._q_count += 1
-        return self._unfolding_weights[self._q_count - 1]
+        return self._unfolding_weights[i]
 
     def next(self):
         return self.__next__()
@@ -132,6 +139,7 @@ class Unfolding(object):
     def prepare(self):
         self._q_count = 0
         self._solve_phonon()
+        self._set_phases()
         self._unfolding_weights = np.zeros(
             (self._eigvecs.shape[0], self._eigvecs.shape[2]), dtype='double')
 
@@ -191,19 +199,39 @@ class Unfolding(object):
             represented.
             shape=(num_trans, num_sites), dtype='intc'
 
+        Positions are matched by integer keys of fractional coordinates
+        rounded on grids finer than symprec, which are sorted once. A
+        position whose key is not found, e.g., near a boundary of grid
+        cells, is searched among all positions.
+
         """
 
         lattice = self._phonon.supercell.get_cell()
         natom = len(self._ideal_positions)
+        # Grid intervals are about twice symprec along reciprocal vectors.
+        rec_lengths = np.sqrt((np.linalg.inv(lattice) ** 2).sum(axis=0))
+        mesh = np.array(np.clip(1.0 / (2 * self._symprec * rec_lengths),
+                                1, 2 ** 20), dtype='int64')
+        keys = self._get_position_keys(self._ideal_positions, mesh)
+        order = np.argsort(keys, kind='mergesort')
+        sorted_keys = keys[order]
+
         index_map_inv = np.zeros((self._N, natom), dtype='intc')
         for i, shift in enumerate(self._trans_s):
-            for j, p in enumerate(self._ideal_positions - shift):  # minus r_i
-                diff = self._ideal_positions - p
+            p = self._ideal_positions - shift  # minus r_i
+            k = np.searchsorted(sorted_keys,
+                                self._get_position_keys(p, mesh))
+            k = order[np.minimum(k, natom - 1)]
+            # k is index in _ideal_positions.
+            diff = self._ideal_positions[k] - p
+            diff -= np.rint(diff)
+            dist = np.sqrt((np.dot(diff, lattice) ** 2).sum(axis=1))
+            for j in np.nonzero(dist > self._symprec)[0]:
+                diff = self._ideal_positions - p[j]
                 diff -= np.rint(diff)
-                dist = np.sqrt((np.dot(diff, lattice) ** 2).sum(axis=1))
-                # k is index in _ideal_positions.
-                k = np.where(dist < self._symprec)[0][0]
-                index_map_inv[i, j] = k
+                dist_j = np.sqrt((np.dot(diff, lattice) ** 2).sum(axis=1))
+                k[j] = np.where(dist_j < self._symprec)[0][0]
+            index_map_inv[i] = k
         self._index_map_inv = index_map_inv
 
         self._atom_mapping = np.zeros(len(atom_mapping), dtype='int')
@@ -213,6 +241,10 @@ class Unfolding(object):
             else:
                 self._atom_mapping[i] = idx
 
+    def _get_position_keys(self, positions, mesh):
+        grid = np.rint(positions * mesh).astype('int64') % mesh
+        return grid[:, 0] + mesh[0] * (grid[:, 1] + mesh[1] * grid[:, 2])
+
     def _solve_phonon(self):
         self._phonon.run_qpoints(self._qpoints_s, with_eigenvectors=True)
         qpt = self._phonon.get_qpoints_dict()
@@ -221,9 +253,8 @@ class Unfolding(object):
         pos = self._phonon.supercell.get_scaled_positions()
 
         # To make eigvecs for D-type dynamical matrix (unnecessary)
-        for i, q in enumerate(self._qpoints_s):
-            phases = np.exp(2j * np.dot(pos, q))
-            eigvecs[i] = np.multiply(eigvecs[i].T, np.repeat(phases, 3)).T
+        phases = np.exp(2j * np.dot(self._qpoints_s, pos.T))
+        eigvecs *= np.repeat(phases, 3, axis=1)[:, :, None]
 
         if -1 in self._atom_mapping:
             shape = list(eigvecs.shape)
@@ -233,8 +264,29 @@ class Unfolding(object):
         else:
             self._eigvecs = eigvecs
 
-    def _get_unfolding_weights(self):
-        """Calculate Eq. (7)
+    def _set_phases(self):
+        """Search G points corresponding to k = G + K at all q-points
+
+        Phase factors exp(2pi i j.G) of primitive translations j are stored
+        with shape=(num_qpoints, num_trans).
+
+        """
+
+        diff = self._qpoints_p - np.dot(
+            self._qpoints_s, np.linalg.inv(self._supercell_matrix))
+        d = diff[:, None, :] - self._comm_points[None, :, :]
+        d -= np.rint(d)
+        found = (np.abs(d) < 1e-5).all(axis=2)
+        G_indices = np.where(found.any(axis=1),
+                             np.argmax(found, axis=1),
+                             len(self._comm_points) - 1)
+        G = self._comm_points[G_indices]
+        self._phases = np.array(
+            np.exp(2j * np.pi * np.dot(G, self._trans_p.T)),
+            dtype='c%d' % (np.dtype('double').itemsize * 2), order='C')
+
+    def _get_unfolding_weights(self, i_start, i_end):
+        """Calculate Eq. (7) at q-points of indices [i_start, i_end)
 
         k = K + G + g
 
@@ -248,48 +300,330 @@ class Unfolding(object):
         The phase factor corresponding to K is not included in eigvecs
         with our choice of dynamical matrix.
 
+        Returns
+        -------
+        weights : ndarray
+            shape=(i_end - i_start, num_band), dtype='double'
+
+        """
+
+        index_map = np.array(self._atom_mapping[self._index_map_inv],
+                             dtype='intc', order='C')
+        eigvecs = np.ascontiguousarray(self._eigvecs[i_start:i_end])
+        phases = self._phases[i_start:i_end]
+        weights = np.zeros((eigvecs.shape[0], eigvecs.shape[2]),
+                           dtype='double')
+
+        try:
+            import phonopy._phonopy as phonoc
+            phonoc.unfolding_weights(weights, eigvecs, phases, index_map)
+        except ImportError:
+            # Indices of -1 (vacancy) point to zero-padded last three rows.
+            eig_indices = (index_map[:, :, None] * 3
+                           + np.arange(3)[None, None, :]).reshape(self._N, -1)
+            for i, (eigvecs_q, phases_q) in enumerate(zip(eigvecs, phases)):
+                e = np.einsum('i,isb->sb', phases_q, eigvecs_q[eig_indices])
+                e /= self._N
+                weights[i] = (e.conj() * e).real.sum(axis=0)
+
+        return weights
+
+
+class UnfoldedSpectralFunction(Unfolding):
+    """Unfolded phonon spectral function by kernel polynomial method
+
+    Spectral function
+
+        A(k, omega) = sum_J W_kJ delta(omega - omega_J)
+
+    is computed without diagonalization of supercell dynamical matrix,
+    where W_kJ is the unfolding weight of Eq. (7) computed by Unfolding.
+    Density of eigenvalues lambda of supercell dynamical matrix D(K)
+    projected on Bloch states of the primitive cell sites at k is
+    expanded in Chebyshev polynomials of the rescaled matrix
+
+        x = (2 D - (upper + lower)) / (upper - lower),
+
+    and the Gibbs oscillation is damped by the Jackson kernel. Only
+    products of the sparse D(K) made of non-zero force constant blocks
+    with the Bloch states are needed. Computational cost at each k is
+    proportional to number of non-zero blocks times number of moments.
+    Non-analytical term correction is not included.
+
+    The sparse D(K) is extracted from the dense supercell force constants
+    and shortest vectors held by the Phonopy instance, which are already
+    quadratic in number of atoms. Therefore memory usage and setup time
+    remain quadratic, though only the force constants are scanned by
+    chunks of rows without making full size temporary arrays.
+
+    Attributes
+    ----------
+    frequency_points : ndarray
+        Frequency points in the unit of phonon frequency.
+        shape=(frequency_points,), dtype='double'
+    spectral_function : ndarray
+        A(k, omega) in the inverse unit of phonon frequency.
+        shape=(qpoints, frequency_points), dtype='double'
+    moments : ndarray
+        Chebyshev moments mu_n = sum_J W_kJ T_n(x_J).
+        shape=(qpoints, num_moments), dtype='double'
+    eigenvalue_bounds : ndarray
+        Lower and upper bounds of eigenvalues of D(K) used to rescale.
+        shape=(qpoints, 2), dtype='double'
+
+    """
+
+    def __init__(self,
+                 phonon,
+                 supercell_matrix,
+                 ideal_positions,
+                 atom_mapping,
+                 qpoints,
+                 frequency_points,
+                 num_moments=256,
+                 fc_tolerance=1e-10):
+        """
+
+        Parameters
+        ----------
+        phonon, supercell_matrix, ideal_positions, atom_mapping, qpoints :
+            See Unfolding.
+        frequency_points : array_like
+            Frequency points in the unit of phonon frequency, where
+            imaginary frequencies are given as negative values.
+            shape=(frequency_points,), dtype='double'
+        num_moments : int, optional
+            Number of Chebyshev moments. Energy resolution is roughly
+            pi * (upper - lower) / 2 / num_moments in eigenvalue.
+        fc_tolerance : float, optional
+            Force constant blocks whose elements are all smaller than this
+            value are dropped from the sparse dynamical matrix. Use
+            Phonopy.set_force_constants_zero_with_radius to impose a cutoff
+            radius.
+
+        """
+
+        super(UnfoldedSpectralFunction, self).__init__(
+            phonon, supercell_matrix, ideal_positions, atom_mapping, qpoints)
+        self._frequency_points = np.array(frequency_points, dtype='double')
+        self._num_moments = num_moments
+        self._fc_tolerance = fc_tolerance
+        self._factor = phonon.unit_conversion_factor
+
+        self._spectral_function = None
+        self._moments = None
+        self._eigenvalue_bounds = None
+
+        # Non-zero force constant blocks divided by sqrt(m_i m_j)
+        self._fc_blocks = None
+        self._fc_indices = None  # (i, j) of blocks, sorted by i
+        self._fc_vectors = None  # Smallest vectors of (j, i)
+        self._fc_multiplicity = None
+        # Rows of Bloch states in eigenvectors and translation indices
+        self._bloch_rows = None
+        self._bloch_trans = None
+
+    def run(self, num_workers=None, verbose=False):
+        """Compute spectral functions at all q-points
+
+        Parameters
+        ----------
+        num_workers : int, optional
+            Number of threads to treat q-points in parallel. Sparse
+            matrix products release GIL. Default is 1.
+
         """
 
-        eigvecs = self._eigvecs[self._q_count]
+        self.prepare()
+        num_qpoints = len(self._qpoints_p)
+
+        def run_at_q(i):
+            self._run_at_q(i)
+            if verbose:
+                print(i)
+
+        if num_workers is None or num_workers < 2:
+            for i in range(num_qpoints):
+                run_at_q(i)
+        else:
+            from phonopy.parallel import thread_pool
+            with thread_pool(num_workers) as executor:
+                list(executor.map(run_at_q, range(num_qpoints)))
+        self._q_count = num_qpoints
+
+    def __next__(self):
+        if self._q_count == len(self._qpoints_p):
+            raise StopIteration
+
+        i = self._q_count
+        self._run_at_q(i)
+        self._q_count += 1
+        return self._spectral_function[i]
+
+    def prepare(self):
+        self._q_count = 0
+        self._set_sparse_force_constants()
+        self._set_bloch_states()
+        self._set_phases()
+        num_qpoints = len(self._qpoints_p)
+        self._spectral_function = np.zeros(
+            (num_qpoints, len(self._frequency_points)), dtype='double')
+        self._moments = np.zeros((num_qpoints, self._num_moments),
+                                 dtype='double')
+        self._eigenvalue_bounds = np.zeros((num_qpoints, 2), dtype='double')
+
+    @property
+    def frequency_points(self):
+        return self._frequency_points
+
+    @property
+    def spectral_function(self):
+        return self._spectral_function
+
+    @property
+    def moments(self):
+        return self._moments
+
+    @property
+    def eigenvalue_bounds(self):
+        return self._eigenvalue_bounds
+
+    def _set_sparse_force_constants(self, chunk_size=64):
+        fc = self._phonon.force_constants
+        primitive = self._phonon.primitive
+        masses = primitive.get_masses()
+        svecs, multiplicity = primitive.get_smallest_vectors()
+        i_s = []
+        j_s = []
+        for i in range(0, len(fc), chunk_size):
+            i_chunk, j_chunk = np.nonzero(
+                (np.abs(fc[i:(i + chunk_size)]) >
+                 self._fc_tolerance).any(axis=(2, 3)))
+            i_s.append(i_chunk + i)
+            j_s.append(j_chunk)
+        i_s = np.concatenate(i_s)
+        j_s = np.concatenate(j_s)
+        sqrt_mm = np.sqrt(masses[i_s] * masses[j_s])
+        self._fc_indices = (i_s, j_s)
+        self._fc_blocks = fc[i_s, j_s] / sqrt_mm[:, None, None]
+        self._fc_vectors = svecs[j_s, i_s]
+        self._fc_multiplicity = multiplicity[j_s, i_s]
+
+    def _set_bloch_states(self):
+        """Set Bloch states of primitive cell sites
+
+        Among sites related by the primitive translations, only one
+        representative site is taken because the other sites give the
+        same contribution. With this, the Bloch states are normalized.
+
+        """
+
+        num_sites = self._index_map_inv.shape[1]
+        reps = [j for j in range(num_sites)
+                if self._index_map_inv[:, j].min() == j]
+        atoms = self._atom_mapping[self._index_map_inv[:, reps]]
+        rows = []
+        trans = []
+        for atoms_j in atoms.T:
+            (i_trans, ) = np.nonzero(atoms_j > -1)
+            for k in range(3):
+                rows.append(atoms_j[i_trans] * 3 + k)
+                trans.append(i_trans)
+        self._bloch_rows = rows
+        self._bloch_trans = trans
+
+    def _get_dynamical_matrix(self, q):
+        from scipy.sparse import bsr_matrix
+
+        i_s, j_s = self._fc_indices
+        num_atom = self._phonon.primitive.get_number_of_atoms()
+        mask = (np.arange(self._fc_vectors.shape[1])[None, :]
+                < self._fc_multiplicity[:, None])
+        phases = (np.exp(2j * np.pi * np.dot(self._fc_vectors, q)) * mask
+                  ).sum(axis=1) / self._fc_multiplicity
+        indptr = np.searchsorted(i_s, np.arange(num_atom + 1))
+        dm = bsr_matrix((self._fc_blocks * phases[:, None, None], j_s, indptr),
+                        shape=(num_atom * 3, num_atom * 3)).tocsr()
+        return (dm + dm.conj().T) / 2
+
+    def _get_bloch_states(self, i):
+        """Bloch states as columns
+
+        Phase convention of eigenvectors is the same as that in
+        Unfolding._solve_phonon.
+
+        """
+
+        pos = self._phonon.supercell.get_scaled_positions()
         dtype = "c%d" % (np.dtype('double').itemsize * 2)
-        weights = np.zeros(eigvecs.shape[1], dtype=dtype)
-        q_p = self._qpoints_p[self._q_count]  # k
-        q_s = self._qpoints_s[self._q_count]  # K
-        diff = q_p - np.dot(q_s, np.linalg.inv(self._supercell_matrix))
-
-        # Search G points corresponding to k = G + K
-        for G in self._comm_points:
-            d = diff - G
-            d -= np.rint(d)
-            if (np.abs(d) < 1e-5).all():
-                break
+        states = np.zeros((len(pos) * 3, len(self._bloch_rows)), dtype=dtype)
+        d_phases = np.exp(2j * np.dot(pos, self._qpoints_s[i]))
+        for j, (rows, trans) in enumerate(
+                zip(self._bloch_rows, self._bloch_trans)):
+            states[rows, j] = (self._phases[i, trans] *
+                               d_phases[rows // 3]).conj()
+        states /= np.sqrt(self._N)
+        return states
+
+    def _run_at_q(self, i):
+        dm = self._get_dynamical_matrix(self._qpoints_s[i])
+        diag = dm.diagonal().real
+        radii = np.array(abs(dm).sum(axis=1)).ravel() - np.abs(diag)
+        lower = (diag - radii).min()
+        upper = (diag + radii).max()
+        margin = (upper - lower) * 0.005
+        lower -= margin
+        upper += margin
+        a = (upper - lower) / 2
+        b = (upper + lower) / 2
+
+        states = self._get_bloch_states(i)
+        moments = self._get_moments(dm, states, a, b)
+        self._moments[i] = moments
+        self._eigenvalue_bounds[i] = [lower, upper]
+        self._spectral_function[i] = self._get_spectral_function(
+            moments, a, b)
+
+    def _get_moments(self, dm, states, a, b):
+        """Chebyshev moments with two moments per product
+
+        mu_{2n} = 2 <t_n|t_n> - mu_0
+        mu_{2n+1} = 2 <t_{n+1}|t_n> - mu_1
 
-        e = np.zeros(eigvecs.shape[:2], dtype=dtype)
-        phases = np.exp(2j * np.pi * np.dot(self._trans_p, G))
-        for phase, indices in zip(
-                phases, self._atom_mapping[self._index_map_inv]):
-            eig_indices = (
-                np.c_[indices * 3, indices * 3 + 1, indices * 3 + 2]).ravel()
-            e += eigvecs[eig_indices, :] * phase
-        e /= self._N
-        weights[:] = (e.conj() * e).sum(axis=0)
-
-        # e = np.zeros(eigvecs.shape[:2], dtype=dtype)
-        # phases = np.exp(2j * np.pi * np.dot(self._trans_p, G))
-        # indices = self._atom_mapping
-        # eig_indices_r = (
-        #     np.c_[indices * 3, indices * 3 + 1, indices * 3 + 2]).ravel()
-        # for phase, indices in zip(
-        #         phases, self._atom_mapping[self._index_map_inv]):
-        #     eig_indices_l = (
-        #         np.c_[indices * 3, indices * 3 + 1, indices * 3 + 2]).ravel()
-        #     e += eigvecs[eig_indices_l, :] * eigvecs[eig_indices_r, :].conj() * phase
-        # e /= self._N
-        # weights[:] = e.sum(axis=0)
-
-        if (weights.imag > 1e-5).any():
-            print("Phonopy warning: Encountered imaginary values.")
-
-        # assert (np.abs(weights.real.sum(axis=1) - 1) < 1e-5).all()
-
-        return weights.real
+        """
+
+        num_moments = self._num_moments
+        moments = np.zeros(num_moments, dtype='double')
+        t_0 = states
+        t_1 = (dm.dot(t_0) - b * t_0) / a
+        moments[0] = np.vdot(t_0, t_0).real
+        moments[1] = np.vdot(t_1, t_0).real
+        for n in range(1, (num_moments + 1) // 2):
+            moments[2 * n] = 2 * np.vdot(t_1, t_1).real - moments[0]
+            if 2 * n + 1 == num_moments:
+                break
+            t_2 = 2 * (dm.dot(t_1) - b * t_1) / a - t_0
+            moments[2 * n + 1] = 2 * np.vdot(t_2, t_1).real - moments[1]
+            t_0, t_1 = t_1, t_2
+        return moments
+
+    def _get_spectral_function(self, moments, a, b):
+        num_moments = len(moments)
+        n = np.arange(num_moments)
+        c = np.pi / (num_moments + 1)
+        jackson = ((num_moments - n + 1) * np.cos(c * n) +
+                   np.sin(c * n) / np.tan(c)) / (num_moments + 1)
+        coefs = moments * jackson
+        coefs[1:] *= 2
+
+        freqs = self._frequency_points
+        eigvals = np.sign(freqs) * (freqs / self._factor) ** 2
+        x = (eigvals - b) / a
+        inside = np.abs(x) < 1
+        theta = np.arccos(x[inside])
+        rho = np.dot(np.cos(np.outer(theta, n)), coefs) / (
+            np.pi * np.sin(theta))
+        spectrum = np.zeros_like(freqs)
+        spectrum[inside] = (rho / a * 2 * np.abs(freqs[inside]) /
+                            self._factor ** 2)
+        return spectrum
@@ -0,0 +1,64 @@
+import unittest
+import os
+import numpy as np
+from phonopy import Phonopy, PhonopyGruneisen
+from phonopy.interface.vasp import read_vasp
+from phonopy.file_IO import parse_FORCE_SETS
+from phonopy.phonon.thermal_properties import (ThermalProperties,
+                                               FrequenciesOnMesh)
+
+data_dir = os.path.dirname(os.path.abspath(__file__))
+
+
+class TestGruneisenThermalProperties(unittest.TestCase):
+    def setUp(self):
+        phonons = [self._get_phonon(scale, fc_scale)
+                   for scale, fc_scale in ((1, 1),
+                                           (1.01, 0.95),
+                                           (0.99, 1.05))]
+        self._gruneisen = PhonopyGruneisen(*phonons)
+        self._gruneisen.set_mesh([4, 4, 4])
+        self._V0 = phonons[0].get_primitive().get_volume()
+
+    def tearDown(self):
+        pass
+
+    def test_thermal_properties(self):
+        volumes = self._V0 * np.array([0.97, 1.0, 1.03])
+        self._gruneisen.set_thermal_properties(volumes, t_step=50, t_max=500)
+        (temperatures,
+         free_energy,
+         entropy,
+         cv) = self._gruneisen.get_thermal_properties().thermal_properties
+        self.assertEqual(free_energy.shape, (len(temperatures), 3))
+
+        _, weights, frequencies, _, gammas = self._gruneisen.get_mesh()
+        for i, V in enumerate(volumes):
+            freqs = frequencies * (V / self._V0) ** (-gammas)
+            tp = ThermalProperties(FrequenciesOnMesh(freqs, weights))
+            tp.set_temperatures(temperatures)
+            tp.run()
+            _, fe_V, entropy_V, cv_V = tp.thermal_properties
+            np.testing.assert_allclose(free_energy[:, i], fe_V, atol=1e-8)
+            np.testing.assert_allclose(entropy[:, i], entropy_V, atol=1e-8)
+            np.testing.assert_allclose(cv[:, i], cv_V, atol=1e-8)
+
+    def _get_phonon(self, scale, fc_scale):
+        cell = read_vasp(os.path.join(data_dir, "..", "POSCAR_NaCl"))
+        cell.set_cell(cell.get_cell() * scale)
+        phonon = Phonopy(cell,
+                         np.diag([2, 2, 2]),
+                         primitive_matrix=[[0, 0.5, 0.5],
+                                           [0.5, 0, 0.5],
+                                           [0.5, 0.5, 0]])
+        filename = os.path.join(data_dir, "..", "FORCE_SETS_NaCl")
+        phonon.set_displacement_dataset(parse_FORCE_SETS(filename=filename))
+        phonon.produce_force_constants()
+        phonon.set_force_constants(phonon.get_force_constants() * fc_scale)
+        return phonon
+
+
+if __name__ == '__main__':
+    suite = unittest.TestLoader().loadTestsFromTestCase(
+        TestGruneisenThermalProperties)
+    unittest.TextTestRunner(verbosity=2).run(suite)
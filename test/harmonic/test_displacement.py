@@ -0,0 +1,85 @@
+import unittest
+import numpy as np
+from phonopy import Phonopy
+from phonopy.interface.vasp import read_vasp
+from phonopy.structure.symmetry import Symmetry
+from phonopy.harmonic.displacement import (
+    get_least_displacements, get_displacement_datasets, get_displacement,
+    is_minus_displacement, directions_diag, directions_axis)
+import os
+
+data_dir = os.path.dirname(os.path.abspath(__file__))
+spacegroups = ('Amm2', 'P-3m1', 'P-43m', 'P2_13', 'P4_1', 'P6_222', 'Pa-3')
+
+
+class TestDisplacement(unittest.TestCase):
+
+    def setUp(self):
+        pass
+
+    def tearDown(self):
+        pass
+
+    def _get_cell(self, spacegroup):
+        return read_vasp(os.path.join(data_dir, "..", "phonon",
+                                      "POSCAR_%s" % spacegroup))
+
+    def _get_least_displacements_ref(self, symmetry, is_plusminus,
+                                     is_diagonal, is_trigonal):
+        if is_diagonal:
+            directions = directions_diag
+        else:
+            directions = directions_axis
+        displacements = []
+        for atom_num in symmetry.get_independent_atoms():
+            site_symmetry = symmetry.get_site_symmetry(atom_num)
+            for disp in get_displacement(site_symmetry, directions,
+                                         is_trigonal):
+                displacements.append([atom_num] + list(disp))
+                if ((is_plusminus == 'auto' and
+                     is_minus_displacement(disp, site_symmetry)) or
+                    is_plusminus is True):
+                    displacements.append([atom_num] + list(-disp))
+        return displacements
+
+    def test_get_least_displacements(self):
+        for spacegroup in spacegroups:
+            symmetry = Symmetry(self._get_cell(spacegroup))
+            rotations = symmetry.get_symmetry_operations()['rotations']
+            for atom_num, mask in zip(symmetry.get_independent_atoms(),
+                                      symmetry.get_site_symmetry_masks()):
+                np.testing.assert_array_equal(
+                    rotations[mask], symmetry.get_site_symmetry(atom_num))
+            for is_plusminus in ('auto', True, False):
+                for is_diagonal in (True, False):
+                    for is_trigonal in (True, False):
+                        disps = get_least_displacements(
+                            symmetry,
+                            is_plusminus=is_plusminus,
+                            is_diagonal=is_diagonal,
+                            is_trigonal=is_trigonal)
+                        disps_ref = self._get_least_displacements_ref(
+                            symmetry, is_plusminus, is_diagonal, is_trigonal)
+                        np.testing.assert_array_equal(disps, disps_ref)
+
+    def test_get_displacement_datasets(self):
+        cells = [self._get_cell(spacegroup) for spacegroup in spacegroups]
+        datasets = get_displacement_datasets(cells, distance=0.03)
+        for cell, dataset in zip(cells, datasets):
+            phonon = Phonopy(cell, np.eye(3, dtype='intc'))
+            phonon.generate_displacements(distance=0.03)
+            dataset_ref = phonon.get_displacement_dataset()
+            self.assertEqual(dataset['natom'], dataset_ref['natom'])
+            self.assertEqual(len(dataset['first_atoms']),
+                             len(dataset_ref['first_atoms']))
+            for d, d_ref in zip(dataset['first_atoms'],
+                                dataset_ref['first_atoms']):
+                self.assertEqual(d['number'], d_ref['number'])
+                np.testing.assert_allclose(d['displacement'],
+                                           d_ref['displacement'],
+                                           atol=1e-12)
+
+
+if __name__ == '__main__':
+    suite = unittest.TestLoader().loadTestsFromTestCase(TestDisplacement)
+    unittest.TextTestRunner(verbosity=2).run(suite)
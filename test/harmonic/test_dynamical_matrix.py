@@ -16,7 +16,7 @@ class TestDynamicalMatrix(unittest.TestCase):
     def tearDown(self):
         pass
 
-    def test_properties(self):
+    def _get_phonon_NaCl(self):
         cell = read_vasp(os.path.join(data_dir, "..", "POSCAR_NaCl"))
         phonon = Phonopy(cell,
                          np.diag([2, 2, 2]),
@@ -27,6 +27,10 @@ class TestDynamicalMatrix(unittest.TestCase):
         force_sets = parse_FORCE_SETS(filename=filename)
         phonon.set_displacement_dataset(force_sets)
         phonon.produce_force_constants()
+        return phonon
+
+    def test_properties(self):
+        phonon = self._get_phonon_NaCl()
         dynmat = phonon.dynamical_matrix
         dynmat.set_dynamical_matrix([0, 0, 0])
         self.assertTrue(id(dynmat.primitive)
@@ -36,6 +40,17 @@ class TestDynamicalMatrix(unittest.TestCase):
         np.testing.assert_allclose(dynmat.dynamical_matrix,
                                    dynmat.get_dynamical_matrix())
 
+    def test_get_dynamical_matrices(self):
+        phonon = self._get_phonon_NaCl()
+        dynmat = phonon.dynamical_matrix
+        qpoints = [[0, 0, 0], [0.1, 0.2, 0.3], [0.5, 0.5, 0], [0.5, 0, 0]]
+        dms = dynmat.get_dynamical_matrices(qpoints)
+        self.assertEqual(dms.shape, (4, 6, 6))
+        for q, dm in zip(qpoints, dms):
+            dynmat.set_dynamical_matrix(q)
+            np.testing.assert_allclose(dm, dynmat.dynamical_matrix,
+                                       atol=1e-12)
+
 
 if __name__ == '__main__':
     suite = unittest.TestLoader().loadTestsFromTestCase(TestDynamicalMatrix)
@@ -1,10 +1,13 @@
 import unittest
 import os
+import tempfile
+import shutil
 import numpy as np
 from phonopy import Phonopy
 from phonopy.interface.vasp import read_vasp
 from phonopy.file_IO import parse_FORCE_SETS, parse_BORN
-from phonopy.phonon.band_structure import get_band_qpoints
+from phonopy.phonon.band_structure import (
+    get_band_qpoints, get_band_connections, estimate_band_connection)
 
 data_dir = os.path.dirname(os.path.abspath(__file__))
 
@@ -52,6 +55,129 @@ class TestBandStructure(unittest.TestCase):
         self.assertTrue(id(band_structure.group_velocities),
                         id(band_structure.get_group_velocities()))
 
+    def testBandConnection(self):
+        band_paths = [[[0, 0, 0], [0.5, 0.25, 0.75], [0.5, 0.5, 0.5]]]
+        qpoints = get_band_qpoints(band_paths, npoints=21)
+        phonon = self._get_phonon()
+        phonon.run_band_structure(qpoints, with_eigenvectors=True)
+        freqs = np.array(phonon.band_structure.frequencies)
+        eigvecs = np.array(phonon.band_structure.eigenvectors)
+        phonon.run_band_structure(qpoints,
+                                  with_group_velocities=True,
+                                  is_band_connection=True)
+        freqs_conn = np.array(phonon.band_structure.frequencies)
+        np.testing.assert_allclose(np.sort(freqs_conn, axis=2), freqs,
+                                   atol=1e-8)
+
+        # Compare with connection by neighboring pairs
+        band_orders = get_band_connections(eigvecs[0])
+        band_order = list(range(6))
+        band_order_ref = list(range(6))
+        for i in range(1, len(eigvecs[0])):
+            band_order = estimate_band_connection(
+                eigvecs[0, i - 1], eigvecs[0, i], band_order)
+            band_order_ref = _estimate_band_connection(
+                eigvecs[0, i - 1], eigvecs[0, i], band_order_ref)
+            np.testing.assert_array_equal(band_order, band_order_ref)
+            np.testing.assert_array_equal(band_orders[i], band_order_ref)
+        np.testing.assert_allclose(
+            freqs_conn[0], freqs[0][np.arange(21)[:, None], band_orders],
+            atol=1e-8)
+
+    def testAdaptiveBand(self):
+        band_paths = [[[0, 0, 0], [0.5, 0, 0.5], [0.5, 0.25, 0.75]]]
+        phonon = self._get_phonon()
+        phonon.run_band_structure(get_band_qpoints(band_paths, npoints=201))
+        ref_distances = phonon.band_structure.distances
+        ref_freqs = phonon.band_structure.frequencies
+
+        qpoints = get_band_qpoints(band_paths, npoints=5)
+        phonon.run_band_structure(qpoints,
+                                  with_group_velocities=True,
+                                  is_band_connection=True,
+                                  adaptive_tolerance=0.02)
+        band_structure = phonon.band_structure
+        for path, path_coarse in zip(band_structure.qpoints, qpoints):
+            self.assertTrue(len(path_coarse) < len(path) < 100)
+            np.testing.assert_allclose(path[[0, -1]], path_coarse[[0, -1]])
+        for d, f, ref_d, ref_f in zip(band_structure.distances,
+                                      band_structure.frequencies,
+                                      ref_distances,
+                                      ref_freqs):
+            f_sorted = np.sort(f, axis=1)
+            for i, ref_f_band in enumerate(np.sort(ref_f, axis=1).T):
+                np.testing.assert_allclose(
+                    np.interp(ref_d, d, f_sorted[:, i]), ref_f_band,
+                    atol=0.05)
+
+    def testAdaptiveBandHDF5(self):
+        try:
+            import h5py
+        except ImportError:
+            self.skipTest("h5py is not installed.")
+        band_paths = [[[0, 0, 0], [0.5, 0, 0.5], [0.5, 0.25, 0.75]]]
+        phonon = self._get_phonon()
+        qpoints = get_band_qpoints(band_paths, npoints=5)
+        tmpdir = tempfile.mkdtemp()
+        try:
+            for adaptive_tolerance in (None, 0.02):
+                phonon.run_band_structure(
+                    qpoints,
+                    with_eigenvectors=True,
+                    with_group_velocities=True,
+                    adaptive_tolerance=adaptive_tolerance,
+                    adaptive_min_overlap=0.95)
+                band_structure = phonon.band_structure
+                nqpoints = [len(path) for path in band_structure.qpoints]
+                filename = os.path.join(tmpdir, "band.hdf5")
+                phonon.write_hdf5_band_structure(filename=filename)
+                with h5py.File(filename, 'r') as f:
+                    np.testing.assert_array_equal(f['segment_nqpoint'][:],
+                                                  nqpoints)
+                    data = dict((key, f[key][:]) for key in
+                                ('path', 'distance', 'frequency',
+                                 'eigenvector', 'group_velocity'))
+                if adaptive_tolerance is None:
+                    self.assertEqual(len(set(nqpoints)), 1)
+                    self.assertEqual(data['frequency'].shape[:2],
+                                     (len(nqpoints), nqpoints[0]))
+                else:
+                    self.assertTrue(len(set(nqpoints)) > 1)
+                    self.assertEqual(len(data['frequency']), sum(nqpoints))
+                sections = np.cumsum(nqpoints)[:-1]
+                for key, values in (
+                        ('path', band_structure.qpoints),
+                        ('distance', band_structure.distances),
+                        ('frequency', band_structure.frequencies),
+                        ('eigenvector', band_structure.eigenvectors),
+                        ('group_velocity', band_structure.group_velocities)):
+                    if adaptive_tolerance is None:
+                        written = data[key]
+                    else:
+                        written = np.split(data[key], sections)
+                    for v_w, v in zip(written, values):
+                        np.testing.assert_allclose(v_w, v)
+        finally:
+            shutil.rmtree(tmpdir)
+
+
+def _estimate_band_connection(prev_eigvecs, eigvecs, prev_band_order):
+    """Band connection by overlaps in pure python"""
+
+    metric = np.abs(np.dot(prev_eigvecs.conjugate().T, eigvecs))
+    connection_order = []
+    for overlaps in metric:
+        maxval = 0
+        for i in reversed(range(len(metric))):
+            val = overlaps[i]
+            if i in connection_order:
+                continue
+            if val > maxval:
+                maxval = val
+                maxindex = i
+        connection_order.append(maxindex)
+    return [connection_order[x] for x in prev_band_order]
+
 
 if __name__ == '__main__':
     suite = unittest.TestLoader().loadTestsFromTestCase(TestBandStructure)
@@ -0,0 +1,46 @@
+import unittest
+import numpy as np
+from phonopy.phonon.degeneracy import (
+    rotate_eigenvectors, rotate_eigenvectors_at_qpoints)
+
+
+class TestDegeneracy(unittest.TestCase):
+    def setUp(self):
+        pass
+
+    def tearDown(self):
+        pass
+
+    def _get_random_hermitian(self, rng, size):
+        a = rng.rand(size, size) + 1j * rng.rand(size, size)
+        return a + a.T.conj()
+
+    def test_rotate_eigenvectors_at_qpoints(self):
+        rng = np.random.RandomState(7)
+        eigvals = np.array([[0, 0, 0, 1, 2, 2],
+                            [-1, 0.5, 0.5, 0.5, 0.5, 3],
+                            [1, 2, 3, 4, 5, 6]], dtype='double')
+        eigvecs = []
+        dDs = []
+        for _ in eigvals:
+            _, vecs = np.linalg.eigh(self._get_random_hermitian(rng, 6))
+            eigvecs.append(vecs)
+            dDs.append(self._get_random_hermitian(rng, 6))
+        eigvecs = np.array(eigvecs)
+        dDs = np.array(dDs)
+
+        rot_eigvecs, eigvals_dD = rotate_eigenvectors_at_qpoints(
+            eigvals, eigvecs, dDs)
+        for i in range(len(eigvals)):
+            rot_ref, eigvals_dD_ref = rotate_eigenvectors(
+                eigvals[i], eigvecs[i], dDs[i])
+            np.testing.assert_allclose(eigvals_dD[i], eigvals_dD_ref,
+                                       atol=1e-10)
+            # Each column is unique up to phase factor.
+            overlaps = np.abs((rot_ref.conj() * rot_eigvecs[i]).sum(axis=0))
+            np.testing.assert_allclose(overlaps, 1, atol=1e-10)
+
+
+if __name__ == '__main__':
+    suite = unittest.TestLoader().loadTestsFromTestCase(TestDegeneracy)
+    unittest.TextTestRunner(verbosity=2).run(suite)
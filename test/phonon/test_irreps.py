@@ -1,5 +1,6 @@
 import unittest
 import os
+import sys
 try:
     from StringIO import StringIO
 except ImportError:
@@ -8,6 +9,7 @@ import numpy as np
 from phonopy import Phonopy
 from phonopy.interface.vasp import read_vasp
 from phonopy.file_IO import parse_FORCE_SETS
+from phonopy.phonon.irreps import IrReps, IrRepsAtQpoints
 
 data_dir = os.path.dirname(os.path.abspath(__file__))
 
@@ -847,6 +849,81 @@ class TestIrreps(unittest.TestCase):
         chars = phonon.get_irreps().get_characters()
         np.testing.assert_allclose(chars, data, atol=1e-5)
 
+    def test_irreps_at_qpoints(self):
+        data = self._load_data(chars_P4mm)
+        phonon = self._get_phonon("P4mm",
+                                  [3, 3, 2],
+                                  np.eye(3))
+        qpoints = [[0, 0, 0], [0.5, 0, 0], [0.1, 0, 0], [0, 0.5, 0],
+                   [0.5, 0.5, 0], [0.25, 0.25, 0]]
+        irreps_qpoints = IrRepsAtQpoints(phonon.dynamical_matrix, qpoints)
+        irreps_qpoints.run()
+        ids = irreps_qpoints.little_group_ids
+        self.assertEqual(ids[0], ids[4])
+        self.assertEqual(ids[1], ids[3])
+        self.assertEqual(len(np.unique(ids)), 4)
+
+        deg_sets = irreps_qpoints.degenerate_sets[0]
+        masks = irreps_qpoints.little_group_masks
+        chars = irreps_qpoints.characters[0][np.unique(deg_sets)]
+        np.testing.assert_allclose(chars, data, atol=1e-5)
+        for i, q in enumerate(qpoints):
+            irreps = IrReps(phonon.dynamical_matrix, q)
+            irreps.run()
+            for deg_set, chars in zip(irreps.get_band_indices(),
+                                      irreps.get_characters()):
+                np.testing.assert_allclose(
+                    irreps_qpoints.characters[i][deg_set][:, masks[i]],
+                    [chars] * len(deg_set), atol=1e-5)
+
+    def test_ground_representation_NaCl(self):
+        cell = read_vasp(os.path.join(data_dir, "..", "POSCAR_NaCl"))
+        phonon = Phonopy(cell,
+                         np.diag([2, 2, 2]),
+                         primitive_matrix=[[0, 0.5, 0.5],
+                                           [0.5, 0, 0.5],
+                                           [0.5, 0.5, 0]])
+        filename = os.path.join(data_dir, "..", "FORCE_SETS_NaCl")
+        phonon.set_displacement_dataset(parse_FORCE_SETS(filename=filename))
+        phonon.produce_force_constants()
+        qpoints = [[0, 0, 0], [0.5, 0, 0.5], [0.5, 0.5, 0.5],
+                   [0.1, 0, 0.1], [0.5, 0.25, 0.75]]
+        self._compare_ground_representation(phonon, qpoints)
+
+    def test_ground_representation_P4_1(self):
+        # Phase factors of screw operations are not trivial.
+        phonon = self._get_phonon("P4_1",
+                                  [2, 2, 1],
+                                  np.eye(3))
+        qpoints = [[0, 0, 0], [0, 0, 0.5], [0, 0, 0.2], [0.5, 0.5, 0.3]]
+        self._compare_ground_representation(phonon, qpoints)
+
+    def _compare_ground_representation(self, phonon, qpoints):
+        for is_python in (False, True):
+            for q in qpoints:
+                for is_little_cogroup in (False, True):
+                    if is_python:
+                        phonoc = sys.modules.get('phonopy._phonopy')
+                        sys.modules['phonopy._phonopy'] = None
+                    try:
+                        irreps = IrReps(phonon.dynamical_matrix, q,
+                                        is_little_cogroup=is_little_cogroup)
+                        irreps.run()
+                    finally:
+                        if is_python:
+                            if phonoc is None:
+                                del sys.modules['phonopy._phonopy']
+                            else:
+                                sys.modules['phonopy._phonopy'] = phonoc
+                    ground_matrices = _get_ground_matrices(irreps)
+                    np.testing.assert_allclose(irreps.get_ground_matrices(),
+                                               ground_matrices, atol=1e-10)
+                    irreps_cmp = _get_irreps(irreps, ground_matrices)
+                    self.assertEqual(len(irreps._irreps), len(irreps_cmp))
+                    for irrep, irrep_cmp in zip(irreps._irreps, irreps_cmp):
+                        np.testing.assert_allclose(irrep, irrep_cmp,
+                                                   atol=1e-10)
+
     def _get_phonon(self, spgtype, dim, pmat):
         cell = read_vasp(os.path.join(data_dir, "POSCAR_%s" % spgtype))
         phonon = Phonopy(cell,
@@ -870,6 +947,52 @@ class TestIrreps(unittest.TestCase):
         return data
 
 
+def _get_ground_matrices(irreps):
+    """Dense ground representation matrices kron(P, R) atom by atom"""
+
+    primitive = irreps._primitive
+    lat = primitive.get_cell().T
+    pos = primitive.get_scaled_positions()
+    q = irreps._q
+    matrices = []
+    for r, t in zip(irreps._rotations_at_q, irreps._translations_at_q):
+        r_cart = np.dot(lat, np.dot(r, np.linalg.inv(lat)))
+        perm_mat = np.zeros((len(pos), len(pos)), dtype=complex)
+        for i, p1 in enumerate(pos):
+            p_rot = np.dot(r, p1) + t
+            for j, p2 in enumerate(pos):
+                diff = p_rot - p2
+                if (abs(diff - np.rint(diff)) < irreps._symprec).all():
+                    phase_factor = np.dot(
+                        q, np.dot(np.linalg.inv(r), p2 - p_rot))
+                    if irreps._is_little_cogroup:
+                        phase_factor += np.dot(t, q)
+                    perm_mat[j, i] = np.exp(2j * np.pi * phase_factor)
+        matrices.append(np.kron(perm_mat, r_cart))
+    return np.array(matrices)
+
+
+def _get_irreps(irreps, ground_matrices):
+    """<e_i|G|e_j> of degenerate sets by dense matrix products"""
+
+    phases = np.kron(
+        [np.exp(2j * np.pi * np.dot(irreps._q, pos))
+         for pos in irreps._primitive.get_scaled_positions()], [1, 1, 1])
+    eigvecs = [vec * phases for vec in irreps._eigvecs.T]
+    irrep = []
+    for band_indices in irreps._degenerate_sets:
+        irrep_Rs = []
+        for mat in ground_matrices:
+            irrep_R = np.zeros((len(band_indices),) * 2, dtype=complex)
+            for i, b_i in enumerate(band_indices):
+                for j, b_j in enumerate(band_indices):
+                    irrep_R[i, j] = np.vdot(eigvecs[b_i],
+                                            np.dot(mat, eigvecs[b_j]))
+            irrep_Rs.append(irrep_R)
+        irrep.append(irrep_Rs)
+    return irrep
+
+
 if __name__ == '__main__':
     suite = unittest.TestLoader().loadTestsFromTestCase(TestIrreps)
     unittest.TextTestRunner(verbosity=2).run(suite)
@@ -0,0 +1,114 @@
+import unittest
+import os
+import shutil
+import tempfile
+import numpy as np
+from phonopy import Phonopy
+from phonopy.interface.vasp import read_vasp
+from phonopy.file_IO import parse_FORCE_SETS
+
+data_dir = os.path.dirname(os.path.abspath(__file__))
+
+
+class TestModulation(unittest.TestCase):
+    def setUp(self):
+        cell = read_vasp(os.path.join(data_dir, "..", "POSCAR_NaCl"))
+        self._phonon = Phonopy(cell,
+                               np.diag([2, 2, 2]),
+                               primitive_matrix=[[0, 0.5, 0.5],
+                                                 [0.5, 0, 0.5],
+                                                 [0.5, 0.5, 0]])
+        filename = os.path.join(data_dir, "..", "FORCE_SETS_NaCl")
+        force_sets = parse_FORCE_SETS(filename=filename)
+        self._phonon.set_displacement_dataset(force_sets)
+        self._phonon.produce_force_constants()
+
+    def tearDown(self):
+        pass
+
+    def test_get_modulations(self):
+        qpoints = [[0, 0.5, 0.5], [0, 0.5, 0.5], [0.25, 0.25, 0]]
+        bands = [0, 2, 4]
+        amplitudes = [[1.0, 0.5, 2.0], [0.3, 0, 1.2]]
+        arguments = [[0, 45, 90], [10, 20, 30]]
+
+        phonon_modes = [[q, b, 1, 0] for q, b in zip(qpoints, bands)]
+        self._phonon.set_modulations([2, 2, 2], phonon_modes)
+        modulations = self._phonon.modulation.get_modulations(amplitudes,
+                                                              arguments)
+        self.assertEqual(modulations.shape, (2, 16, 3))
+
+        for amps, args, u in zip(amplitudes, arguments, modulations):
+            phonon_modes = [list(mode) for mode in
+                            zip(qpoints, bands, amps, args)]
+            self._phonon.set_modulations([2, 2, 2], phonon_modes)
+            u_modes, _ = self._phonon.get_modulations_and_supercell()
+            np.testing.assert_allclose(np.sum(u_modes, axis=0), u,
+                                       atol=1e-12)
+
+    def test_run(self):
+        phonon_modes = [[[0, 0.5, 0.5], 0, 1.0, 0],
+                        [[0, 0.5, 0.5], 2, 0.5, 45],
+                        [[0.25, 0.25, 0], 4, 2.0, 90]]
+        self._phonon.set_modulations([2, 2, 2], phonon_modes)
+        modulation = self._phonon.modulation
+        u_modes, supercell = self._phonon.get_modulations_and_supercell()
+        for mode, eigvec, u in zip(phonon_modes, modulation._eigvecs,
+                                   u_modes):
+            q, _, amplitude, argument = mode
+            u_ref = _get_displacements(supercell, eigvec, q, amplitude,
+                                       argument)
+            np.testing.assert_allclose(u, u_ref, atol=1e-12)
+
+    def test_write_modulated_supercells_crystal(self):
+        phonon_modes = [[[0, 0.5, 0.5], 2, 1, 0]]
+        self._phonon.set_modulations([2, 2, 2], phonon_modes)
+        numbers = self._phonon.unitcell.get_atomic_numbers()
+        conv_numbers = [200 + n for n in numbers]
+        tmpdir = tempfile.mkdtemp()
+        try:
+            filename = os.path.join(tmpdir, "MPOSCAR")
+            self._phonon.modulation.write_modulated_supercells(
+                [[1.0]], [[0]],
+                filename=filename,
+                interface_mode='crystal',
+                optional_structure_info=(None, conv_numbers))
+            with open(filename + "-001.ext") as f:
+                lines = f.readlines()
+        finally:
+            shutil.rmtree(tmpdir)
+        num_atoms = int(lines[9])
+        self.assertEqual(num_atoms, 16)
+        written = [int(line.split()[0]) for line in lines[10:]]
+        _, supercell = self._phonon.get_modulations_and_supercell()
+        np.testing.assert_array_equal(
+            written, 200 + supercell.get_atomic_numbers())
+
+
+def _get_displacements(supercell, eigvec, q, amplitude, argument):
+    """Per-atom construction of modulation used before mode patterns"""
+
+    m = supercell.get_masses()
+    s2u_map = supercell.get_supercell_to_unitcell_map()
+    u2u_map = supercell.get_unitcell_to_unitcell_map()
+    s2uu_map = [u2u_map[x] for x in s2u_map]
+    spos = supercell.get_scaled_positions()
+    dim = supercell.get_supercell_matrix()
+    coefs = (np.exp(2j * np.pi * np.dot(np.dot(spos, dim.T), q))
+             / np.sqrt(m))
+    u = []
+    for i, coef in enumerate(coefs):
+        eig_index = s2uu_map[i] * 3
+        u.append(eigvec[eig_index:eig_index + 3] * coef)
+    u = np.array(u) / np.sqrt(len(m))
+
+    u_flat = np.ravel(u)
+    max_elem = u_flat[np.argmax(abs(u_flat))]
+    phase_factor = (np.exp(1j * np.pi * argument / 180) /
+                    (max_elem / abs(max_elem)))
+    return u * phase_factor * amplitude
+
+
+if __name__ == '__main__':
+    suite = unittest.TestLoader().loadTestsFromTestCase(TestModulation)
+    unittest.TextTestRunner(verbosity=2).run(suite)
@@ -74,6 +74,33 @@ class TestMoment(unittest.TestCase):
 
         # self._show(vals)
 
+    def test_moment_at_orders_with_iter_mesh(self):
+        phonon = self._get_phonon(self._cell)
+        phonon.run_mesh([5, 5, 5], with_eigenvectors=True)
+        f = phonon.mesh.frequencies
+        w = phonon.mesh.weights
+        e = phonon.mesh.eigenvectors
+        orders = [0, 1, 2, 4]
+
+        for eigvecs in (None, e):
+            moment = PhononMoment(f, w, eigenvectors=eigvecs)
+            moment.set_frequency_range(freq_min=3, freq_max=5)
+            moment.run(order=orders)
+            moms = moment.moment
+            self.assertEqual(len(moms), len(orders))
+            for i, order in enumerate(orders):
+                moment.run(order=order)
+                np.testing.assert_allclose(moms[i], moment.moment,
+                                           rtol=1e-12)
+
+            phonon.init_mesh([5, 5, 5],
+                             with_eigenvectors=(eigvecs is not None),
+                             use_iter_mesh=True)
+            moment_iter = PhononMoment(iter_mesh=phonon.mesh, chunk_size=4)
+            moment_iter.set_frequency_range(freq_min=3, freq_max=5)
+            moment_iter.run(order=orders)
+            np.testing.assert_allclose(moment_iter.moment, moms, rtol=1e-10)
+
     def _show(self, vals):
         for v in vals:
             print(("%9.6f " * len(v)) % tuple(v))
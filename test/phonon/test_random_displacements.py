@@ -1,5 +1,6 @@
 import unittest
 import os
+import sys
 import numpy as np
 from phonopy import Phonopy
 from phonopy.interface.vasp import read_vasp
@@ -69,6 +70,51 @@ class TestRandomDisplacements(unittest.TestCase):
 
         # plt.show()
 
+    def test_NaCl_reproducibility(self):
+        phonon = self._get_phonon_NaCl()
+        rd = RandomDisplacements(phonon.dynamical_matrix,
+                                 cutoff_frequency=0.01)
+        rd.run(500, number_of_snapshots=50, seed=1234)
+        u = rd.u.copy()
+        self.assertEqual(u.shape, (50, 64, 3))
+        chunks = list(rd.generate(500, 50, seed=1234, chunk_size=7))
+        self.assertEqual(len(chunks), 8)
+        np.testing.assert_allclose(np.concatenate(chunks), u, atol=1e-12)
+        rd.run(500, number_of_snapshots=50, seed=1235)
+        self.assertTrue(np.abs(rd.u - u).max() > 1e-3)
+
+        # Mean square displacements of Na and Cl
+        rd.run(500, number_of_snapshots=2000, seed=1)
+        msd = (rd.u ** 2).mean(axis=(0, 2))
+        np.testing.assert_allclose(msd[:32].mean(), 0.0317, rtol=0.05)
+        np.testing.assert_allclose(msd[32:].mean(), 0.0236, rtol=0.05)
+
+    def test_NaCl_python_stream(self):
+        """Displacements by C and python implementations are identical"""
+
+        phonon = self._get_phonon_NaCl()
+        rd = RandomDisplacements(phonon.dynamical_matrix,
+                                 cutoff_frequency=0.01)
+        rd.run(500, number_of_snapshots=5, seed=2 ** 40 + 3)
+        u = rd.u.copy()
+        phonoc = sys.modules.get('phonopy._phonopy')
+        # Importing phonopy._phonopy raises ImportError.
+        sys.modules['phonopy._phonopy'] = None
+        try:
+            rd.run(500, number_of_snapshots=5, seed=2 ** 40 + 3)
+        finally:
+            if phonoc is None:
+                del sys.modules['phonopy._phonopy']
+            else:
+                sys.modules['phonopy._phonopy'] = phonoc
+        np.testing.assert_allclose(rd.u, u, atol=1e-12)
+
+    def test_NaCl_no_snapshot(self):
+        phonon = self._get_phonon_NaCl()
+        rd = RandomDisplacements(phonon.dynamical_matrix)
+        rd.run(500, number_of_snapshots=0, seed=1)
+        self.assertEqual(rd.u.shape, (0, 64, 3))
+
 
 if __name__ == '__main__':
     suite = unittest.TestLoader().loadTestsFromTestCase(TestRandomDisplacements)
@@ -1,6 +1,7 @@
 import unittest
 import numpy as np
 from phonopy.qha.electron import ElectronFreeEnergy, get_free_energy_at_T
+from phonopy.units import Kb
 
 eigvals_Al = """ -3.1277  20.6836  20.6836  20.6836  22.1491  22.1491  22.1491  24.4979  27.5181  27.5181  30.3260  32.6840
  -2.9388  18.0492  20.1052  20.1052  22.8186  23.0196  23.0196  26.3365  26.5334  26.5334  29.6719  33.6291
@@ -132,14 +133,7 @@ class TestElectronFreeEnergy(unittest.TestCase):
 
         """
 
-        weights = np.array(
-            [1, 8, 8, 8, 8, 8, 4, 6, 24, 24, 24, 24, 24, 24, 24, 24, 24, 12,
-             6, 24, 24, 24, 24, 24, 24, 24, 12, 6, 24, 24, 24, 24, 24, 12,
-             6, 24, 24, 24, 12, 6, 24, 12, 3, 24, 48, 48, 48, 24, 24, 48,
-             48, 48, 48, 48, 24, 24, 48, 48, 48, 24, 24, 48, 24, 12, 24, 48,
-             24, 24, 48, 24, 12, 6], dtype='intc')
-        eigvals = np.reshape([float(x) for x in eigvals_Al.split()],
-                             (1, len(weights), -1))
+        weights, eigvals = self._get_Al_data()
         n_electrons = 3.0
         efe = ElectronFreeEnergy(eigvals, weights, n_electrons)
         efe.run(1000)
@@ -154,6 +148,54 @@ class TestElectronFreeEnergy(unittest.TestCase):
         (temperaturs,
          free_energy) = get_free_energy_at_T(0, 1000, 10,
                                              eigvals, weights, n_electrons)
+        self.assertTrue(np.abs(free_energy[-1] -
+                               (efe.energy - efe.entropy)) < 1e-8)
+
+    def test_run_at_temperatures(self):
+        weights, eigvals = self._get_Al_data()
+        rng = np.random.RandomState(0)
+        eigvals = np.concatenate(
+            [eigvals, eigvals + rng.rand(*eigvals.shape) * 0.3])
+        n_electrons = 3.3
+        temperatures = [10, 300, 1000, 3000]
+        efe = ElectronFreeEnergy(eigvals, weights, n_electrons)
+        efe.run_at_temperatures(temperatures)
+        for i, T in enumerate(temperatures):
+            # Occupations of all states without windowing
+            f = 1.0 / (1 + np.exp((eigvals - efe.mu[i]) / (Kb * T)))
+            n = (f.sum(axis=2).sum(axis=0) * weights).sum() / weights.sum()
+            self.assertTrue(np.abs(n - n_electrons) < 1e-8)
+            energy = (((f * eigvals).sum(axis=2).sum(axis=0) * weights).sum()
+                      / weights.sum())
+            self.assertTrue(np.abs(energy - efe.energy[i]) < 1e-8)
+            efe_T = ElectronFreeEnergy(eigvals, weights, n_electrons)
+            efe_T.run(T)
+            self.assertTrue(np.abs(efe_T.entropy - efe.entropy[i]) < 1e-10)
+
+    def test_run_at_temperatures_in_chunks(self):
+        weights, eigvals = self._get_Al_data()
+        temperatures = np.arange(0, 3001, 100)
+        efe = ElectronFreeEnergy(eigvals, weights, 3)
+        efe.run_at_temperatures(temperatures)
+        # Windows at high temperatures contain more states than this.
+        efe_chunk = ElectronFreeEnergy(eigvals, weights, 3)
+        efe_chunk._max_window_elements = 100
+        efe_chunk.run_at_temperatures(temperatures)
+        np.testing.assert_allclose(efe_chunk.mu, efe.mu, atol=1e-10)
+        np.testing.assert_allclose(efe_chunk.energy, efe.energy, atol=1e-10)
+        np.testing.assert_allclose(efe_chunk.entropy, efe.entropy,
+                                   atol=1e-10)
+
+    def _get_Al_data(self):
+        weights = np.array(
+            [1, 8, 8, 8, 8, 8, 4, 6, 24, 24, 24, 24, 24, 24, 24, 24, 24, 12,
+             6, 24, 24, 24, 24, 24, 24, 24, 12, 6, 24, 24, 24, 24, 24, 12,
+             6, 24, 24, 24, 12, 6, 24, 12, 3, 24, 48, 48, 48, 24, 24, 48,
+             48, 48, 48, 48, 24, 24, 48, 48, 48, 24, 24, 48, 24, 12, 24, 48,
+             24, 24, 48, 24, 12, 6], dtype='intc')
+        eigvals = np.reshape([float(x) for x in eigvals_Al.split()],
+                             (1, len(weights), -1))
+        return weights, eigvals
 
 
 if __name__ == '__main__':
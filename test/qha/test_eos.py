@@ -0,0 +1,49 @@
+import unittest
+import numpy as np
+from phonopy.qha.eos import (get_eos, get_eos_jacobian, fit_to_eos,
+                             fit_to_eos_stacked)
+
+volumes = np.linspace(60, 72, 9)
+parameters = np.array([[-15.0, 0.45, 4.5, 66.0],
+                       [-15.2, 0.40, 4.8, 67.0],
+                       [-15.5, 0.35, 5.1, 68.5]])
+
+
+class TestEOS(unittest.TestCase):
+    def setUp(self):
+        pass
+
+    def tearDown(self):
+        pass
+
+    def test_jacobian(self):
+        for eos_name in ('vinet', 'murnaghan', 'birch_murnaghan'):
+            eos = get_eos(eos_name)
+            jacobian = get_eos_jacobian(eos_name)(volumes, *parameters[0])
+            for i in range(4):
+                h = 1e-6 * abs(parameters[0, i])
+                dp = np.eye(4)[i] * h
+                fd = (eos(volumes, *(parameters[0] + dp)) -
+                      eos(volumes, *(parameters[0] - dp))) / (2 * h)
+                np.testing.assert_allclose(jacobian[:, i], fd,
+                                           rtol=1e-6, atol=1e-8)
+
+    def test_fit_to_eos_stacked(self):
+        for eos_name in ('vinet', 'murnaghan', 'birch_murnaghan'):
+            eos = get_eos(eos_name)
+            jacobian = get_eos_jacobian(eos_name)
+            rng = np.random.RandomState(1)
+            energies = np.array([eos(volumes, *p) for p in parameters])
+            energies += rng.rand(*energies.shape) * 1e-4
+            ep_0 = fit_to_eos(volumes, energies[0], eos, jacobian=jacobian)
+            ep, converged = fit_to_eos_stacked(volumes, energies, eos,
+                                               jacobian, ep_0)
+            self.assertTrue(converged.all())
+            for e, p in zip(energies, ep):
+                p_ref = fit_to_eos(volumes, e, eos)
+                np.testing.assert_allclose(p, p_ref, rtol=1e-5)
+
+
+if __name__ == '__main__':
+    suite = unittest.TestLoader().loadTestsFromTestCase(TestEOS)
+    unittest.TextTestRunner(verbosity=2).run(suite)
@@ -0,0 +1,73 @@
+import unittest
+import numpy as np
+from phonopy import PhonopyQHA
+from phonopy.qha import QHA
+from phonopy.qha.eos import get_eos, fit_to_eos
+from phonopy.units import EvTokJmol
+
+volumes = np.linspace(60, 72, 9)
+temperatures = np.arange(0, 1001, 50, dtype='double')
+
+
+class TestQHA(unittest.TestCase):
+    def setUp(self):
+        x = temperatures / 1000
+        # E_0, B_0, B'_0, V_0 changing with temperature
+        parameters = np.transpose([-15.0 - 0.5 * x ** 2,
+                                   0.45 - 0.1 * x,
+                                   4.5 + 0.6 * x,
+                                   66.0 + 2.5 * x ** 2])
+        eos = get_eos('vinet')
+        rng = np.random.RandomState(1)
+        fe = np.array([eos(volumes, *p) for p in parameters])
+        fe += rng.rand(*fe.shape) * 1e-4
+        self._electronic_energies = np.zeros_like(volumes)
+        self._free_energy = fe * EvTokJmol
+        self._cv = np.tile(x[:, None] * 20, (1, len(volumes)))
+        self._entropy = np.tile(x[:, None] * 40 + volumes / 100,
+                                (len(temperatures), 1))
+
+    def tearDown(self):
+        pass
+
+    def test_run(self):
+        qha = self._get_qha()
+        qha.run()
+        parameters = qha._equiv_parameters
+        fe = qha._free_energies
+        self.assertEqual(len(parameters), len(fe))
+        # Cold-start fits at temperatures
+        eos = get_eos('vinet')
+        params_ref = [fit_to_eos(volumes, e, eos) for e in fe]
+        np.testing.assert_allclose(parameters, params_ref, rtol=1e-5)
+
+        qha_stacked = self._get_qha()
+        qha_stacked.run(stacked=True)
+        np.testing.assert_allclose(qha_stacked._equiv_parameters,
+                                   params_ref, rtol=1e-5)
+
+        phonopy_qha = PhonopyQHA(volumes=volumes,
+                                 electronic_energies=self._electronic_energies,
+                                 temperatures=temperatures,
+                                 free_energy=self._free_energy,
+                                 cv=self._cv,
+                                 entropy=self._entropy,
+                                 t_max=800,
+                                 stacked_fit=True)
+        np.testing.assert_allclose(phonopy_qha.get_volume_temperature(),
+                                   qha.get_volume_temperature(), rtol=1e-7)
+
+    def _get_qha(self):
+        return QHA(volumes,
+                   self._electronic_energies,
+                   temperatures,
+                   self._cv,
+                   self._entropy,
+                   self._free_energy,
+                   eos='vinet',
+                   t_max=800)
+
+
+if __name__ == '__main__':
+    suite = unittest.TestLoader().loadTestsFromTestCase(TestQHA)
+    unittest.TextTestRunner(verbosity=2).run(suite)
@@ -0,0 +1,74 @@
+import unittest
+import os
+import numpy as np
+import phonopy
+from phonopy import Phonopy
+from phonopy.api_qha import get_thermal_properties_at_volumes
+
+data_dir = os.path.dirname(os.path.abspath(__file__))
+primitive_matrix = [[0, 0.5, 0.5], [0.5, 0, 0.5], [0.5, 0.5, 0]]
+
+
+class TestQHAAtVolumes(unittest.TestCase):
+    def setUp(self):
+        phonon = phonopy.load(
+            supercell_matrix=[2, 2, 2],
+            primitive_matrix=primitive_matrix,
+            unitcell_filename=os.path.join(data_dir, "..", "POSCAR_NaCl"),
+            force_sets_filename=os.path.join(data_dir, "..",
+                                             "FORCE_SETS_NaCl"),
+            is_nac=False)
+        self._unitcells = []
+        self._force_constants = []
+        for i, s in enumerate((0.98, 1.0, 1.02)):
+            cell = phonon.unitcell.copy()
+            lattice = cell.get_cell() * s
+            if i == 2:
+                lattice[2] *= 1.001
+            cell.set_cell(lattice)
+            self._unitcells.append(cell)
+            fc = phonon.force_constants * (1.3 - 0.3 * s ** 3)
+            if i == 2:
+                # zz-elements are scaled to lower the symmetry of force
+                # constants to tetragonal as the lattice.
+                fc[:, :, 2, 2] *= 1.2
+            self._force_constants.append(fc)
+
+    def tearDown(self):
+        pass
+
+    def test_get_thermal_properties_at_volumes(self):
+        (volumes,
+         temperatures,
+         free_energy,
+         cv,
+         entropy) = get_thermal_properties_at_volumes(
+             self._unitcells,
+             [2, 2, 2],
+             self._force_constants,
+             [7, 7, 7],
+             primitive_matrix=primitive_matrix,
+             t_max=500,
+             t_step=50,
+             num_workers=2)
+        for i, (cell, fc) in enumerate(zip(self._unitcells,
+                                           self._force_constants)):
+            phonon = Phonopy(cell, np.diag([2, 2, 2]),
+                             primitive_matrix=primitive_matrix)
+            phonon.force_constants = fc
+            phonon.run_mesh([7, 7, 7])
+            phonon.run_thermal_properties(t_max=500, t_step=50)
+            tp = phonon.get_thermal_properties_dict()
+            self.assertAlmostEqual(volumes[i], cell.get_volume())
+            np.testing.assert_allclose(temperatures, tp['temperatures'])
+            np.testing.assert_allclose(free_energy[:, i], tp['free_energy'],
+                                       atol=1e-8)
+            np.testing.assert_allclose(cv[1:, i], tp['heat_capacity'][1:],
+                                       atol=1e-8)
+            np.testing.assert_allclose(entropy[1:, i], tp['entropy'][1:],
+                                       atol=1e-8)
+
+
+if __name__ == '__main__':
+    suite = unittest.TestLoader().loadTestsFromTestCase(TestQHAAtVolumes)
+    unittest.TextTestRunner(verbosity=2).run(suite)
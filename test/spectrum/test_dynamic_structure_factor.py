@@ -4,6 +4,7 @@ import numpy as np
 from phonopy.api_phonopy import Phonopy
 from phonopy.spectrum.dynamic_structure_factor import atomic_form_factor_WK1995
 from phonopy import load
+from phonopy.units import THzToEv, Kb
 import os
 
 data_dir = os.path.dirname(os.path.abspath(__file__))
@@ -126,6 +127,52 @@ class TestDynamicStructureFactor(unittest.TestCase):
             np.testing.assert_allclose(
                 S[6:, i].sum(axis=1), data_cmp[6:, i].sum(axis=1), atol=1e-5)
 
+    def test_dynamic_structure_factor_map(self):
+        P = np.array([[0, 0.5, 0.5],
+                      [0.5, 0, 0.5],
+                      [0.5, 0.5, 0]])
+        G_prim = np.dot([7, 1, 1], P)
+        x = np.arange(1, 5) / 10.0
+        Qpoints = (G_prim +
+                   x[:, None, None] * np.dot([0.5, 0.5, 0.5], P) +
+                   x[None, :, None] * np.dot([0.5, 0, 0], P))
+        fpts = np.linspace(-2, 12, 281)
+        b = {'Na': 3.63, 'Cl': 9.5770}
+
+        self.phonon.run_dynamic_structure_factor(
+            Qpoints.reshape(-1, 3), 300, scattering_lengths=b, freq_min=1e-3)
+        _, S = self.phonon.get_dynamic_structure_factor()
+
+        for sigma in (None, 0.2, lambda f: 0.1 + 0.02 * f):
+            self.phonon.run_dynamic_structure_factor_map(
+                Qpoints, 300, fpts, sigma=sigma, scattering_lengths=b,
+                freq_min=1e-3, chunk_size=5)
+            sqw = self.phonon.dynamic_structure_factor_map.\
+                dynamic_structure_factor_map
+            self.assertEqual(sqw.shape, (4, 4, 281))
+            np.testing.assert_allclose(
+                sqw.reshape(16, -1).sum(axis=1) * (fpts[1] - fpts[0]),
+                S.sum(axis=1), rtol=1e-5)
+
+    def test_run(self):
+        """Batched structure factors agree with mode-by-mode evaluation"""
+
+        P = np.array([[0, 0.5, 0.5],
+                      [0.5, 0, 0.5],
+                      [0.5, 0.5, 0]])
+        x = np.arange(1, 8) / 8.0
+        Qpoints = (np.dot([7, 1, 1], P) +
+                   x[:, None] * np.dot([0.5, 0.25, 0.1], P))
+        for kwargs in ({'atomic_form_factor_func': get_func_AFF(f_params)},
+                       {'scattering_lengths': {'Na': 3.63, 'Cl': 9.5770}}):
+            self.phonon.run_dynamic_structure_factor(
+                Qpoints, 300, freq_min=1e-3, **kwargs)
+            dsf = self.phonon.dynamic_structure_factor
+            S_ref = [_get_dynamic_structure_factor(dsf, i)
+                     for i in range(len(Qpoints))]
+            np.testing.assert_allclose(dsf.dynamic_structure_factors, S_ref,
+                                       rtol=1e-8, atol=1e-10)
+
     def plot_f_Q(f_params):
         import matplotlib.pyplot as plt
         x = np.linspace(0.0, 6.0, 101)
@@ -192,6 +239,37 @@ class TestDynamicStructureFactor(unittest.TestCase):
         return phonon
 
 
+def _get_dynamic_structure_factor(dsf, i):
+    """S(Q, nu) computed mode by mode and atom by atom"""
+
+    freqs = dsf.frequencies[i]
+    eigvecs = dsf._eigvecs[i]
+    G = dsf._Gpoints[i]
+    Q_cart = np.dot(dsf._rec_lat, dsf._Qpoints[i])
+    DW = dsf._get_Debye_Waller_factors(Q_cart[None, :])[0]
+    primitive = dsf._primitive
+    symbols = primitive.get_chemical_symbols()
+    masses = primitive.get_masses()
+    phase = np.exp(-2j * np.pi * np.dot(primitive.get_scaled_positions(), G))
+    S = np.zeros(len(freqs), dtype='double')
+    for j, freq in enumerate(freqs):
+        if freq <= dsf._fmin:
+            continue
+        W = eigvecs[:, j].reshape(-1, 3)
+        F = 0
+        for k, m in enumerate(masses):
+            if dsf._func_AFF is not None:
+                f = dsf._func_AFF(symbols[k], np.linalg.norm(Q_cart))
+            else:
+                f = dsf._b[symbols[k]]
+            QW = np.dot(Q_cart, W[k]) * 2 * np.pi
+            F += f / np.sqrt(2 * m) * DW[k] * QW * phase[k]
+        F /= np.sqrt(freq)
+        n = 1.0 / (np.exp(freq * THzToEv / (Kb * dsf._T)) - 1)
+        S[j] = abs(F) ** 2 * (n + 1)
+    return S * dsf._unit_convertion_factor
+
+
 if __name__ == '__main__':
     suite = unittest.TestLoader().loadTestsFromTestCase(
         TestDynamicStructureFactor)
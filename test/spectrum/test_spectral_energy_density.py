@@ -0,0 +1,92 @@
+import unittest
+
+import numpy as np
+from phonopy.spectrum.spectral_energy_density import SpectralEnergyDensity
+from phonopy import load
+import os
+
+data_dir = os.path.dirname(os.path.abspath(__file__))
+
+
+class TestSpectralEnergyDensity(unittest.TestCase):
+    def setUp(self):
+        self.phonon = self._get_phonon()
+
+    def tearDown(self):
+        pass
+
+    def test_SpectralEnergyDensity(self):
+        """Damped harmonic modes at a commensurate q-point are recovered"""
+
+        q = [0.5, 0.5, 0]
+        timestep = 2.0
+        self.phonon.run_qpoints([q], with_eigenvectors=True)
+        freqs = self.phonon.get_qpoints_dict()['frequencies'][0]
+        eigvecs = self.phonon.get_qpoints_dict()['eigenvectors'][0]
+        gammas = np.array([0, 0, 2.0, 0, 0, 1.5])  # rad/ps
+        z = self._get_mode_amplitudes(freqs, gammas, timestep, 40000)
+        velocities = self._get_velocities(z, q, eigvecs)
+
+        sed = SpectralEnergyDensity(self.phonon.dynamical_matrix,
+                                    self.phonon.supercell,
+                                    velocities,
+                                    timestep)
+        sed.run(4096, qpoint_chunk_size=4)
+        i_q = np.where(
+            (abs(sed.qpoints - q) < 1e-5).all(axis=1))[0][0]
+        energies = sed.spectral_energy_density.sum(axis=2)
+        max_energy = energies.max()
+        self.assertTrue((energies[i_q, [2, 5]] > 0.1 * max_energy).all())
+        energies[i_q, [2, 5]] = 0
+        self.assertTrue((energies < 1e-8 * max_energy).all())
+
+        sed.fit_lorentzians()
+        np.testing.assert_allclose(sed.peak_frequencies[i_q, [2, 5]],
+                                   freqs[[2, 5]], atol=0.1)
+        np.testing.assert_allclose(sed.linewidths[i_q, [2, 5]],
+                                   gammas[[2, 5]] / np.pi, rtol=0.35)
+
+    def _get_mode_amplitudes(self, freqs, gammas, timestep, num_steps):
+        """Complex mode amplitudes by damped oscillators driven by noise"""
+        rng = np.random.RandomState(11)
+        dt = timestep * 1e-3
+        decay = np.exp((-2j * np.pi * freqs - gammas) * dt)
+        decay[gammas == 0] = 0
+        noise = (rng.normal(size=(num_steps, len(freqs))) +
+                 1j * rng.normal(size=(num_steps, len(freqs))))
+        noise[:, gammas == 0] = 0
+        z = np.zeros((num_steps, len(freqs)), dtype='complex128')
+        for i in range(1, num_steps):
+            z[i] = z[i - 1] * decay + noise[i]
+        return z
+
+    def _get_velocities(self, z, q, eigvecs):
+        supercell = self.phonon.supercell
+        primitive = self.phonon.primitive
+        p2p = primitive.get_primitive_to_primitive_map()
+        s2p = primitive.get_supercell_to_primitive_map()
+        p_indices = [p2p[i] for i in s2p]
+        pos = np.dot(supercell.get_positions(),
+                     np.linalg.inv(primitive.get_cell()))
+        phases = (np.exp(2j * np.pi * np.dot(pos, q)) /
+                  np.sqrt(supercell.get_masses()))
+        e = eigvecs.reshape(-1, 3, eigvecs.shape[1])[p_indices]
+        v = np.einsum('tn,san->tsa', z, e) * phases[None, :, None]
+        return v.real * 100
+
+    def _get_phonon(self):
+        filename_cell = os.path.join(data_dir, "..", "POSCAR_NaCl")
+        filename_forces = os.path.join(data_dir, "..", "FORCE_SETS_NaCl")
+        phonon = load(supercell_matrix=[2, 2, 2],
+                      primitive_matrix=[[0, 0.5, 0.5],
+                                        [0.5, 0, 0.5],
+                                        [0.5, 0.5, 0]],
+                      unitcell_filename=filename_cell,
+                      force_sets_filename=filename_forces)
+        return phonon
+
+
+if __name__ == '__main__':
+    suite = unittest.TestLoader().loadTestsFromTestCase(
+        TestSpectralEnergyDensity)
+    unittest.TextTestRunner(verbosity=2).run(suite)
@@ -1,8 +1,10 @@
 import unittest
 
 import numpy as np
-from phonopy.spectrum.velocity import Velocity
-from phonopy.interface.vasp import read_XDATCAR
+from phonopy import Phonopy
+from phonopy.spectrum.velocity import (Velocity, VelocityQpoints,
+                                       AutoCorrelation)
+from phonopy.interface.vasp import read_XDATCAR, read_vasp
 import os
 
 data_dir = os.path.dirname(os.path.abspath(__file__))
@@ -27,6 +29,65 @@ class TestVelocity(unittest.TestCase):
         self.assertTrue(
             (np.abs(velocity.ravel() - velocity_cmp.ravel()) < 1e-1).all())
 
+    def test_VelocityQpoints(self):
+        cell = read_vasp(os.path.join(data_dir, "..", "POSCAR_NaCl"))
+        phonon = Phonopy(cell,
+                         np.diag([2, 2, 2]),
+                         primitive_matrix=[[0, 0.5, 0.5],
+                                           [0.5, 0, 0.5],
+                                           [0.5, 0.5, 0]])
+        supercell = phonon.get_supercell()
+        primitive = phonon.get_primitive()
+        rng = np.random.RandomState(1)
+        velocities = rng.rand(7, supercell.get_number_of_atoms(), 3) - 0.5
+        qpoints = [[0, 0, 0], [0.1, 0.2, 0.3], [0.5, 0, 0.5], [0.5, 0.5, 0.5]]
+        vq = VelocityQpoints(supercell, primitive, velocities)
+        vq.set_qpoints(qpoints)
+        v_q_cmp = _transform(vq, qpoints)
+        for chunk_size in (None, 1, 3):
+            vq.run(chunk_size=chunk_size)
+            np.testing.assert_allclose(vq.get_velocities(), v_q_cmp,
+                                       atol=1e-10)
+
+        # Velocities already at q-points
+        vq = VelocityQpoints(supercell, primitive, velocities * (1 + 2j))
+        vq.set_qpoints(qpoints)
+        vq.run(chunk_size=3)
+        np.testing.assert_allclose(vq.get_velocities(), v_q_cmp * (1 + 2j),
+                                   atol=1e-10)
+
+    def test_AutoCorrelation(self):
+        velocity = np.loadtxt(os.path.join(data_dir, "velocities.dat"))
+        velocity = velocity.reshape(-1, 2, 3)
+        num_frequency_points = 5
+        vv_cmp = self._get_autocorrelation(velocity, num_frequency_points)
+        for block_length in (None, 13):
+            ac = AutoCorrelation(velocity)
+            self.assertTrue(ac.run(num_frequency_points,
+                                   block_length=block_length))
+            np.testing.assert_allclose(ac.get_autocorrelation(), vv_cmp,
+                                       atol=1e-8)
+            self.assertEqual(ac.get_number_of_elements(),
+                             len(velocity) - num_frequency_points * 2)
+
+        velocity_q = velocity * np.exp(1j * np.arange(len(velocity)))[
+            :, None, None]
+        vv_cmp = self._get_autocorrelation(velocity_q, num_frequency_points)
+        ac = AutoCorrelation(velocity_q)
+        ac.run(num_frequency_points, block_length=13)
+        np.testing.assert_allclose(ac.get_autocorrelation(), vv_cmp,
+                                   atol=1e-8)
+
+    def _get_autocorrelation(self, v, num_frequency_points):
+        max_lag = num_frequency_points * 2
+        n_elem = len(v) - max_lag
+        d = max_lag // 2
+        vv = np.zeros((max_lag,) + v.shape[1:], dtype=v.dtype)
+        for i in range(max_lag):
+            vv[i - d] = (v[d:(d + n_elem)] *
+                         v[i:(i + n_elem)].conj()).sum(axis=0)
+        return vv
+
     def _show(self, velocity):
         print(velocity)
 
@@ -35,6 +96,27 @@ class TestVelocity(unittest.TestCase):
                    velocity.reshape((-1, 3)))
 
 
+def _transform(vq, q):
+    """exp(i q.r(i)) v(i) summed atom by atom"""
+
+    s2p = vq._primitive.get_supercell_to_primitive_map()
+    p2s = vq._primitive.get_primitive_to_supercell_map()
+    num_p = vq._primitive.get_number_of_atoms()
+    v = vq._velocities
+    q_array = np.reshape(q, (-1, 3))
+    v_q = np.zeros((v.shape[0], num_p, len(q_array), 3), dtype=complex)
+    for p_i, s_i in enumerate(p2s):
+        for s_j, s2p_j in enumerate(s2p):
+            if s2p_j == s_i:
+                multi = vq._multiplicity[s_j, p_i]
+                pos = vq._shortest_vectors[s_j, p_i, :multi]
+                phase_factors = np.exp(
+                    -2j * np.pi * np.dot(q_array, pos.T)).sum(axis=1) / multi
+                for q_i, pf in enumerate(phase_factors):
+                    v_q[:, p_i, q_i, :] += pf * v[:, s_j, :]
+    return v_q
+
+
 if __name__ == '__main__':
     suite = unittest.TestLoader().loadTestsFromTestCase(TestVelocity)
     unittest.TextTestRunner(verbosity=2).run(suite)
@@ -4,6 +4,7 @@ import numpy as np
 from phonopy import Phonopy
 from phonopy.interface.vasp import read_vasp
 from phonopy.file_IO import parse_FORCE_SETS, parse_BORN
+from phonopy.profiling import get_profiler
 
 data_dir = os.path.dirname(os.path.abspath(__file__))
 
@@ -42,6 +43,75 @@ class TestPhonopy(unittest.TestCase):
         phonon.run_mesh([11, 11, 11], with_eigenvectors=True)
         phonon.get_mesh_dict()
 
+    def testParallelOptions(self):
+        from phonopy.parallel import thread_pool
+        phonon = self._get_phonon()
+        dynmat = phonon.dynamical_matrix
+        qpoints = [[0, 0, 0.1], [0.1, 0.2, 0.3], [0.5, 0.5, 0]]
+        dms_ref = dynmat.get_dynamical_matrices(qpoints)
+        dynmat.set_dynamical_matrix(qpoints[1])
+        dm_ref = dynmat.dynamical_matrix
+        num_threads = phonon.num_threads
+        try:
+            phonon.set_parallel_options(
+                num_threads=num_threads,
+                parallel_levels={'dynamical_matrices': 'atom_pairs',
+                                 'dynamical_matrix': 'serial'},
+                nested_policy='serial')
+            options = phonon.parallel_options
+            self.assertEqual(options['num_threads'], num_threads)
+            self.assertEqual(options['nested_policy'], 'serial')
+            self.assertEqual(options['parallel_levels'],
+                             {'dynamical_matrices': 'atom_pairs',
+                              'dynamical_matrix': 'serial'})
+            np.testing.assert_allclose(
+                dynmat.get_dynamical_matrices(qpoints), dms_ref, atol=1e-12)
+            dynmat.set_dynamical_matrix(qpoints[1])
+            np.testing.assert_allclose(dynmat.dynamical_matrix, dm_ref,
+                                       atol=1e-12)
+            with thread_pool(2) as executor:
+                nums = list(executor.map(lambda i: phonon.num_threads,
+                                         range(4)))
+            self.assertEqual(nums, [1, 1, 1, 1])
+            self.assertRaises(ValueError, phonon.set_parallel_options,
+                              parallel_levels={'dynamical_matrix': 'qpoints'})
+            self.assertRaises(ValueError, phonon.set_parallel_options,
+                              nested_policy='nested')
+        finally:
+            phonon.set_parallel_options(
+                parallel_levels={'dynamical_matrices': 'qpoints',
+                                 'dynamical_matrix': 'atom_pairs'},
+                nested_policy='none')
+
+    def testProfiling(self):
+        phonon = self._get_phonon()
+        self.assertTrue(phonon.profile is None)
+        phonon.enable_profiling()
+        try:
+            phonon.produce_force_constants()
+            phonon.run_mesh([4, 4, 4])
+            phonon.run_total_dos(use_tetrahedron_method=True)
+            phonon.run_qpoints([[0, 0, 0.1], [0.1, 0.2, 0.3]])
+            profile = phonon.profile
+            for name in ('produce_force_constants', 'dynamical_matrix',
+                         'dipole_dipole', 'eigh', 'tetrahedron_dos', 'mesh'):
+                self.assertTrue(name in profile, msg=name)
+                self.assertTrue(profile[name]['count'] > 0)
+                self.assertTrue(profile[name]['time'] >= 0)
+                self.assertTrue(profile[name]['num_threads'] > 0)
+            self.assertEqual(profile['tetrahedron_dos']['count'], 1)
+            self.assertEqual(profile['dynamical_matrix']['count'],
+                             profile['eigh']['count'])
+            trace = get_profiler().get_chrome_trace()
+            self.assertEqual(len(trace['traceEvents']),
+                             sum([v['count'] for v in profile.values()]))
+            event = trace['traceEvents'][0]
+            for key in ('name', 'ph', 'ts', 'dur', 'pid', 'tid', 'args'):
+                self.assertTrue(key in event)
+        finally:
+            phonon.disable_profiling()
+        self.assertTrue(phonon.profile is None)
+
     def _get_phonon(self):
         cell = read_vasp(os.path.join(data_dir, "POSCAR_NaCl"))
         phonon = Phonopy(cell,
@@ -0,0 +1,66 @@
+import unittest
+import os
+import numpy as np
+from phonopy import Phonopy
+from phonopy.interface.vasp import read_vasp
+from phonopy.file_IO import parse_FORCE_SETS
+from phonopy.structure.cells import get_supercell
+from phonopy.unfolding import Unfolding, UnfoldedSpectralFunction
+
+data_dir = os.path.dirname(os.path.abspath(__file__))
+
+
+class TestUnfoldedSpectralFunction(unittest.TestCase):
+
+    def setUp(self):
+        cell = read_vasp(os.path.join(data_dir, "..", "POSCAR_NaCl"))
+        self._supercell = get_supercell(cell, np.diag([2, 2, 2]))
+        self._phonon = Phonopy(self._supercell, np.diag([1, 1, 1]))
+        self._phonon.dataset = parse_FORCE_SETS(
+            filename=os.path.join(data_dir, "FORCE_SETS"))
+        self._phonon.produce_force_constants()
+
+    def tearDown(self):
+        pass
+
+    def test_UnfoldedSpectralFunction_NaCl(self):
+        qpoints = [[0.1, 0.2, 0.05], [0.3, 0.3, 0.3], [0.5, 0, 0.5]]
+        smat = [[-2, 2, 2], [2, -2, 2], [2, 2, -2]]
+        positions = self._supercell.get_scaled_positions()
+        mapping = list(range(len(positions)))
+        unfolding = Unfolding(self._phonon, smat, positions, mapping,
+                              qpoints)
+        unfolding.run()
+        frequency_points = np.linspace(-1, 10, 1101)
+        num_moments = 301
+        spectral = UnfoldedSpectralFunction(
+            self._phonon, smat, positions, mapping, qpoints,
+            frequency_points, num_moments=num_moments)
+        spectral.run()
+
+        # Moments from diagonalization
+        freqs = unfolding.frequencies
+        weights = unfolding.unfolding_weights
+        factor = self._phonon.unit_conversion_factor
+        eigvals = np.sign(freqs) * (freqs / factor) ** 2
+        lower = spectral.eigenvalue_bounds[:, 0][:, None]
+        upper = spectral.eigenvalue_bounds[:, 1][:, None]
+        x = (2 * eigvals - upper - lower) / (upper - lower)
+        moments = np.array(
+            [(weights * np.cos(n * np.arccos(x))).sum(axis=1)
+             for n in range(num_moments)]).T
+        np.testing.assert_allclose(spectral.moments, moments, atol=1e-8)
+
+        # Sum rule and mean frequency
+        A = spectral.spectral_function
+        norms = np.trapz(A, frequency_points, axis=1)
+        np.testing.assert_allclose(norms, weights.sum(axis=1), rtol=1e-3)
+        means = np.trapz(A * frequency_points, frequency_points,
+                         axis=1) / norms
+        np.testing.assert_allclose(
+            means, (weights * freqs).sum(axis=1) / weights.sum(axis=1),
+            rtol=1e-2)
+
+
+if __name__ == '__main__':
+    unittest.main()
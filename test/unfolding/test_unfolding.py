@@ -0,0 +1,101 @@
+import unittest
+import os
+import numpy as np
+from phonopy import Phonopy
+from phonopy.interface.vasp import read_vasp
+from phonopy.file_IO import parse_FORCE_SETS
+from phonopy.structure.cells import get_supercell
+from phonopy.unfolding import Unfolding
+
+data_dir = os.path.dirname(os.path.abspath(__file__))
+
+
+class TestUnfoldingWeights(unittest.TestCase):
+
+    def setUp(self):
+        cell = read_vasp(os.path.join(data_dir, "..", "POSCAR_NaCl"))
+        self._supercell = get_supercell(cell, np.diag([2, 2, 2]))
+        self._phonon = Phonopy(self._supercell, np.diag([1, 1, 1]))
+        self._phonon.dataset = parse_FORCE_SETS(
+            filename=os.path.join(data_dir, "FORCE_SETS"))
+        self._phonon.produce_force_constants()
+        self._smat = [[-2, 2, 2], [2, -2, 2], [2, 2, -2]]
+
+    def tearDown(self):
+        pass
+
+    def test_unfolding_weights(self):
+        qpoints = [[0.1, 0.2, 0.05], [0.3, 0.3, 0.3], [0.5, 0, 0.5],
+                   [0, 0, 0]]
+        positions = self._supercell.get_scaled_positions()
+        mapping = list(range(len(positions)))
+        unfolding = Unfolding(self._phonon, self._smat, positions, mapping,
+                              qpoints)
+        unfolding.run()
+
+        index_map_inv = _get_index_map_inv(
+            unfolding, self._phonon.supercell.get_cell(), positions)
+        np.testing.assert_array_equal(unfolding._index_map_inv,
+                                      index_map_inv)
+        for i in range(len(qpoints)):
+            np.testing.assert_allclose(
+                unfolding.unfolding_weights[i],
+                _get_unfolding_weights(unfolding, i), atol=1e-10)
+
+    def test_index_map_with_noise(self):
+        """Positions near boundaries of grid cells of keys are matched"""
+
+        positions = self._supercell.get_scaled_positions()
+        mapping = list(range(len(positions)))
+        rng = np.random.RandomState(1)
+        # Displacements are around a half of grid interval of keys.
+        noise = 7e-7 + rng.rand(*positions.shape) * 3.5e-7
+        unfolding = Unfolding(self._phonon, self._smat, positions, mapping,
+                              [[0.0, 0, 0]])
+        unfolding_noise = Unfolding(self._phonon, self._smat,
+                                    positions + noise, mapping, [[0.0, 0, 0]])
+        np.testing.assert_array_equal(unfolding_noise._index_map_inv,
+                                      unfolding._index_map_inv)
+
+
+def _get_index_map_inv(unfolding, lattice, ideal_positions):
+    """Per-atom search of translated positions"""
+
+    index_map_inv = np.zeros((unfolding._N, len(ideal_positions)),
+                             dtype='intc')
+    for i, shift in enumerate(unfolding._trans_s):
+        for j, p in enumerate(ideal_positions - shift):
+            diff = ideal_positions - p
+            diff -= np.rint(diff)
+            dist = np.sqrt((np.dot(diff, lattice) ** 2).sum(axis=1))
+            index_map_inv[i, j] = np.where(dist < unfolding._symprec)[0][0]
+    return index_map_inv
+
+
+def _get_unfolding_weights(unfolding, i):
+    """Eq. (7) at a q-point computed translation by translation"""
+
+    eigvecs = unfolding._eigvecs[i]
+    q_p = unfolding._qpoints_p[i]
+    q_s = unfolding._qpoints_s[i]
+    diff = q_p - np.dot(q_s, np.linalg.inv(unfolding._supercell_matrix))
+    for G in unfolding.commensurate_points:
+        d = diff - G
+        d -= np.rint(d)
+        if (np.abs(d) < 1e-5).all():
+            break
+
+    e = np.zeros(eigvecs.shape[:2], dtype=eigvecs.dtype)
+    phases = np.exp(2j * np.pi * np.dot(unfolding._trans_p, G))
+    for phase, indices in zip(
+            phases, unfolding._atom_mapping[unfolding._index_map_inv]):
+        eig_indices = (
+            np.c_[indices * 3, indices * 3 + 1, indices * 3 + 2]).ravel()
+        e += eigvecs[eig_indices, :] * phase
+    e /= unfolding._N
+    return (e.conj() * e).sum(axis=0).real
+
+
+if __name__ == '__main__':
+    suite = unittest.TestLoader().loadTestsFromTestCase(TestUnfoldingWeights)
+    unittest.TextTestRunner(verbosity=2).run(suite)